@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include "devices/ide.h"
 #include "threads/malloc.h"
+#include "threads/trace.h"
 
 /* A block device. */
 struct block
@@ -121,7 +122,9 @@ void
 block_read (struct block *block, block_sector_t sector, void *buffer)
 {
   check_sector (block, sector);
+  trace_record (TRACE_BLOCK_READ, sector, block->type);
   block->ops->read (block->aux, sector, buffer);
+  trace_record (TRACE_BLOCK_END, sector, block->type);
   block->read_cnt++;
 }
 
@@ -135,7 +138,9 @@ block_write (struct block *block, block_sector_t sector, const void *buffer)
 {
   check_sector (block, sector);
   ASSERT (block->type != BLOCK_FOREIGN);
+  trace_record (TRACE_BLOCK_WRITE, sector, block->type);
   block->ops->write (block->aux, sector, buffer);
+  trace_record (TRACE_BLOCK_END, sector, block->type);
   block->write_cnt++;
 }
 
@@ -14,14 +14,18 @@ input_init (void)
 }
 
 /* Adds a key to the input buffer.
-   Interrupts must be off and the buffer must not be full. */
+   Interrupts must be off and the buffer must not be full.  Only
+   the bootstrap processor's device interrupts add keys, so the
+   buffer cannot fill up between input_full() and this call. */
 void
 input_putc (uint8_t key)
 {
   ASSERT (intr_get_level () == INTR_OFF);
-  ASSERT (!intq_full (&buffer));
 
+  spinlock_acquire (&buffer.spin);
+  ASSERT (!intq_full (&buffer));
   intq_putc (&buffer, key);
+  spinlock_release (&buffer.spin);
   serial_notify ();
 }
 
@@ -34,7 +38,9 @@ input_getc (void)
   uint8_t key;
 
   old_level = intr_disable ();
+  spinlock_acquire (&buffer.spin);
   key = intq_getc (&buffer);
+  spinlock_release (&buffer.spin);
   serial_notify ();
   intr_set_level (old_level);
 
@@ -42,7 +48,10 @@ input_getc (void)
 }
 
 /* Returns true if the input buffer is full,
-   false otherwise.
+   false otherwise.  The buffer is not locked, so the answer may
+   be out of date unless it is called from a device interrupt
+   handler on the bootstrap processor, the only place keys are
+   added.
    Interrupts must be off. */
 bool
 input_full (void)
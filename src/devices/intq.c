@@ -3,6 +3,8 @@
 #include "threads/thread.h"
 
 static int next (int pos);
+static void take_waiter_lock (struct intq *q);
+static void release_waiter_lock (struct intq *q);
 static void wait (struct intq *q, struct thread **waiter);
 static void signal (struct intq *q, struct thread **waiter);
 
@@ -10,24 +12,27 @@ static void signal (struct intq *q, struct thread **waiter);
 void
 intq_init (struct intq *q)
 {
+  spinlock_init (&q->spin);
   lock_init (&q->lock);
   q->not_full = q->not_empty = NULL;
   q->head = q->tail = 0;
 }
 
-/* Returns true if Q is empty, false otherwise. */
+/* Returns true if Q is empty, false otherwise.  Unless Q's
+   spinlock is held, the answer may be out of date by the time it
+   is used. */
 bool
 intq_empty (const struct intq *q)
 {
-  ASSERT (intr_get_level () == INTR_OFF);
   return q->head == q->tail;
 }
 
-/* Returns true if Q is full, false otherwise. */
+/* Returns true if Q is full, false otherwise.  Unless Q's
+   spinlock is held, the answer may be out of date by the time it
+   is used. */
 bool
 intq_full (const struct intq *q)
 {
-  ASSERT (intr_get_level () == INTR_OFF);
   return next (q->head) == q->tail;
 }
 
@@ -43,9 +48,10 @@ intq_getc (struct intq *q)
   while (intq_empty (q))
     {
       ASSERT (!intr_context ());
-      lock_acquire (&q->lock);
-      wait (q, &q->not_empty);
-      lock_release (&q->lock);
+      take_waiter_lock (q);
+      if (intq_empty (q))
+        wait (q, &q->not_empty);
+      release_waiter_lock (q);
     }
 
   byte = q->buf[q->tail];
@@ -64,9 +70,10 @@ intq_putc (struct intq *q, uint8_t byte)
   while (intq_full (q))
     {
       ASSERT (!intr_context ());
-      lock_acquire (&q->lock);
-      wait (q, &q->not_full);
-      lock_release (&q->lock);
+      take_waiter_lock (q);
+      if (intq_full (q))
+        wait (q, &q->not_full);
+      release_waiter_lock (q);
     }
 
   q->buf[q->head] = byte;
@@ -81,18 +88,45 @@ next (int pos)
   return (pos + 1) % INTQ_BUFSIZE;
 }
 
+/* Acquires Q's lock on waiting, which may sleep, so Q's
+   spinlock is dropped meanwhile. */
+static void
+take_waiter_lock (struct intq *q)
+{
+  spinlock_release (&q->spin);
+  lock_acquire (&q->lock);
+  spinlock_acquire (&q->spin);
+}
+
+/* Releases Q's lock on waiting, which may yield the CPU, so Q's
+   spinlock is dropped meanwhile. */
+static void
+release_waiter_lock (struct intq *q)
+{
+  spinlock_release (&q->spin);
+  lock_release (&q->lock);
+  spinlock_acquire (&q->spin);
+}
+
 /* WAITER must be the address of Q's not_empty or not_full
-   member.  Waits until the given condition is true. */
+   member.  Waits until the given condition is true.  Q's
+   spinlock is released while the thread sleeps, and a signal()
+   cannot slip in between because it has to take synch_lock to
+   wake us. */
 static void
-wait (struct intq *q UNUSED, struct thread **waiter)
+wait (struct intq *q, struct thread **waiter)
 {
   ASSERT (!intr_context ());
   ASSERT (intr_get_level () == INTR_OFF);
   ASSERT ((waiter == &q->not_empty && intq_empty (q))
           || (waiter == &q->not_full && intq_full (q)));
 
+  spinlock_acquire (&synch_lock);
   *waiter = thread_current ();
+  spinlock_release (&q->spin);
   thread_block ();
+  spinlock_release (&synch_lock);
+  spinlock_acquire (&q->spin);
 }
 
 /* WAITER must be the address of Q's not_empty or not_full
@@ -108,7 +142,9 @@ signal (struct intq *q UNUSED, struct thread **waiter)
 
   if (*waiter != NULL)
     {
+      spinlock_acquire (&synch_lock);
       thread_unblock (*waiter);
+      spinlock_release (&synch_lock);
       *waiter = NULL;
     }
 }
@@ -9,13 +9,14 @@
 
    Interrupt queue functions can be called from kernel threads or
    from external interrupt handlers.  Except for intq_init(),
-   interrupts must be off in either case.
+   intq_empty() and intq_full(), interrupts must be off and the
+   caller must hold the queue's `spin' lock in either case.
 
    The interrupt queue has the structure of a "monitor".  Locks
    and condition variables from threads/synch.h cannot be used in
    this case, as they normally would, because they can only
    protect kernel threads from one another, not from interrupt
-   handlers. */
+   handlers.  The spinlock protects the queue from other CPUs. */
 
 /* Queue buffer size, in bytes. */
 #define INTQ_BUFSIZE 64
@@ -23,6 +24,8 @@
 /* A circular queue of bytes. */
 struct intq
   {
+    struct spinlock spin;       /* Protects the members below. */
+
     /* Waiting threads. */
     struct lock lock;           /* Only one thread may wait at once. */
     struct thread *not_full;    /* Thread waiting for not-full condition. */
@@ -0,0 +1,238 @@
+#include "devices/lapic.h"
+#include <debug.h>
+#include <stdint.h>
+#include "devices/timer.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/vaddr.h"
+
+/* Local Advanced Programmable Interrupt Controller (APIC).
+   Refer to [IA32-v3a] chapter 10 "Advanced Programmable
+   Interrupt Controller (APIC)" for details.
+
+   Every CPU has its own local APIC, which delivers interrupts to
+   that CPU alone: its own timer and the inter-processor
+   interrupts (IPIs) sent to it by other CPUs.  All of the local
+   APICs answer at the same physical address, each CPU seeing its
+   own, so one uncached mapping of that page serves every CPU.
+
+   Legacy device interrupts still come from the 8259A PICs, which
+   the BIOS leaves wired to the bootstrap processor's LINT0 pin
+   ("virtual wire" mode), so they are handled there only. */
+
+/* CPUID leaf 1, EDX: the CPU has a local APIC. */
+#define CPUID_APIC (1 << 9)
+
+/* Model-specific register holding the local APIC's physical base
+   address. */
+#define MSR_APIC_BASE 0x1b
+
+/* Kernel virtual address of the local APIC's registers.  It lies
+   above the kernel's mapping of physical memory, so it cannot
+   collide with it. */
+#define LAPIC_VADDR 0xfee00000
+
+/* Register offsets, in bytes. */
+#define LAPIC_ID         0x020  /* Local APIC ID. */
+#define LAPIC_TPR        0x080  /* Task priority. */
+#define LAPIC_EOI        0x0b0  /* End of interrupt. */
+#define LAPIC_SVR        0x0f0  /* Spurious interrupt vector. */
+#define LAPIC_ICR_LO     0x300  /* Interrupt command, bits 0...31. */
+#define LAPIC_ICR_HI     0x310  /* Interrupt command, bits 32...63. */
+#define LAPIC_LVT_TIMER  0x320  /* Local vector table: timer. */
+#define LAPIC_LVT_LINT0  0x350  /* Local vector table: LINT0 pin. */
+#define LAPIC_LVT_LINT1  0x360  /* Local vector table: LINT1 pin. */
+#define LAPIC_LVT_ERROR  0x370  /* Local vector table: errors. */
+#define LAPIC_TIMER_INIT 0x380  /* Timer initial count. */
+#define LAPIC_TIMER_CUR  0x390  /* Timer current count. */
+#define LAPIC_TIMER_DIV  0x3e0  /* Timer divide configuration. */
+
+/* Register bits. */
+#define SVR_ENABLE     0x00100  /* APIC software enable. */
+#define LVT_MASKED     0x10000  /* Interrupt masked. */
+#define LVT_PERIODIC   0x20000  /* Timer mode: periodic. */
+#define ICR_INIT       0x00500  /* Delivery mode: INIT. */
+#define ICR_STARTUP    0x00600  /* Delivery mode: start-up. */
+#define ICR_PENDING    0x01000  /* Delivery status: send pending. */
+#define ICR_ASSERT     0x04000  /* Level: assert. */
+#define ICR_LEVEL      0x08000  /* Trigger mode: level. */
+#define TIMER_DIV_16   0x3      /* Timer counts at bus clock / 16. */
+
+/* Number of timer ticks over which the local APIC timer is
+   calibrated. */
+#define CALIBRATE_TICKS 10
+
+static volatile uint32_t *const lapic = (volatile uint32_t *) LAPIC_VADDR;
+
+/* Local APIC timer counts per timer tick.
+   Initialized by lapic_timer_calibrate(). */
+static uint32_t timer_count;
+
+static uint32_t lapic_read (int reg);
+static void lapic_write (int reg, uint32_t value);
+static void send_command (uint8_t apic_id, uint32_t command);
+
+/* Maps the local APIC's registers into the kernel page table
+   and enables the bootstrap processor's local APIC.  Must be
+   called before any process page directory is created, since
+   those copy the kernel's mappings.  Returns false, without
+   doing anything, if the CPU has no local APIC. */
+bool
+lapic_init (void)
+{
+  uint32_t eax, ebx, ecx, edx;
+  uint32_t base_lo, base_hi;
+  uint32_t *pt;
+
+  /* See [IA32-v2a] "CPUID" and "RDMSR". */
+  asm ("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "a" (1));
+  if (!(edx & CPUID_APIC))
+    return false;
+  asm volatile ("rdmsr" : "=a" (base_lo), "=d" (base_hi)
+                : "c" (MSR_APIC_BASE));
+
+  pt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+  init_page_dir[pd_no ((void *) LAPIC_VADDR)] = pde_create (pt);
+  pt[pt_no ((void *) LAPIC_VADDR)] = ((base_lo & PTE_ADDR)
+                                      | PTE_P | PTE_W | PTE_PCD | PTE_PWT);
+
+  /* The BIOS set up LINT0 for the PICs; leave it alone. */
+  lapic_write (LAPIC_SVR, SVR_ENABLE | LAPIC_VEC_SPURIOUS);
+  lapic_write (LAPIC_TPR, 0);
+  return true;
+}
+
+/* Enables the local APIC of an application processor.  Only the
+   bootstrap processor takes PIC interrupts, so the local
+   interrupt pins are masked. */
+void
+lapic_init_ap (void)
+{
+  lapic_write (LAPIC_SVR, SVR_ENABLE | LAPIC_VEC_SPURIOUS);
+  lapic_write (LAPIC_LVT_LINT0, LVT_MASKED);
+  lapic_write (LAPIC_LVT_LINT1, LVT_MASKED);
+  lapic_write (LAPIC_LVT_ERROR, LVT_MASKED);
+  lapic_write (LAPIC_TPR, 0);
+}
+
+/* Returns the running CPU's local APIC ID. */
+uint8_t
+lapic_id (void)
+{
+  return lapic_read (LAPIC_ID) >> 24;
+}
+
+/* Acknowledges the interrupt being handled, which allows the
+   local APIC to deliver the next one. */
+void
+lapic_eoi (void)
+{
+  lapic_write (LAPIC_EOI, 0);
+}
+
+/* Sends interrupt VEC to the CPU whose local APIC ID is
+   APIC_ID. */
+void
+lapic_send_ipi (uint8_t apic_id, uint8_t vec)
+{
+  send_command (apic_id, vec);
+}
+
+/* Starts the application processor with local APIC ID APIC_ID
+   with the INIT-SIPI-SIPI sequence of [IA32-v3a] 8.4.4.1
+   "Typical BSP Initialization Sequence".  The processor begins
+   executing in real mode at physical address START_PADDR, which
+   must be page-aligned and below 1 MB.  Interrupts must be on,
+   because the sequence waits between steps. */
+void
+lapic_start_ap (uint8_t apic_id, uint32_t start_paddr)
+{
+  int i;
+
+  ASSERT (intr_get_level () == INTR_ON);
+  ASSERT (start_paddr % PGSIZE == 0 && start_paddr < 0x100000);
+
+  send_command (apic_id, ICR_INIT | ICR_LEVEL | ICR_ASSERT);
+  timer_udelay (200);
+  send_command (apic_id, ICR_INIT | ICR_LEVEL);
+  timer_mdelay (10);
+
+  for (i = 0; i < 2; i++)
+    {
+      send_command (apic_id, ICR_STARTUP | (start_paddr >> 12));
+      timer_udelay (200);
+    }
+}
+
+/* Measures how fast the local APIC timer counts, against the
+   PIT-driven timer tick.  All local APIC timers count at the
+   same rate, so calling this once, on the bootstrap processor,
+   is enough.  Interrupts must be on. */
+void
+lapic_timer_calibrate (void)
+{
+  int64_t start;
+
+  ASSERT (intr_get_level () == INTR_ON);
+
+  lapic_write (LAPIC_TIMER_DIV, TIMER_DIV_16);
+  lapic_write (LAPIC_LVT_TIMER, LVT_MASKED | LAPIC_VEC_TIMER);
+
+  /* Count down from the top for CALIBRATE_TICKS ticks, starting
+     on a tick boundary. */
+  start = timer_ticks ();
+  while (timer_ticks () == start)
+    continue;
+  lapic_write (LAPIC_TIMER_INIT, UINT32_MAX);
+  start = timer_ticks ();
+  while (timer_elapsed (start) < CALIBRATE_TICKS)
+    continue;
+  timer_count = (UINT32_MAX - lapic_read (LAPIC_TIMER_CUR)) / CALIBRATE_TICKS;
+  lapic_write (LAPIC_TIMER_INIT, 0);
+}
+
+/* Starts the running CPU's local APIC timer, interrupting at
+   LAPIC_VEC_TIMER TIMER_FREQ times per second. */
+void
+lapic_timer_start (void)
+{
+  ASSERT (timer_count > 0);
+
+  lapic_write (LAPIC_TIMER_DIV, TIMER_DIV_16);
+  lapic_write (LAPIC_LVT_TIMER, LVT_PERIODIC | LAPIC_VEC_TIMER);
+  lapic_write (LAPIC_TIMER_INIT, timer_count);
+}
+
+/* Returns the value of local APIC register REG. */
+static uint32_t
+lapic_read (int reg)
+{
+  return lapic[reg / sizeof *lapic];
+}
+
+/* Writes VALUE to local APIC register REG, then reads back the
+   ID register to wait for the write to complete. */
+static void
+lapic_write (int reg, uint32_t value)
+{
+  lapic[reg / sizeof *lapic] = value;
+  lapic_read (LAPIC_ID);
+}
+
+/* Writes COMMAND to the interrupt command register, addressed to
+   the CPU whose local APIC ID is APIC_ID, and waits for the
+   local APIC to accept it. */
+static void
+send_command (uint8_t apic_id, uint32_t command)
+{
+  enum intr_level old_level = intr_disable ();
+
+  lapic_write (LAPIC_ICR_HI, (uint32_t) apic_id << 24);
+  lapic_write (LAPIC_ICR_LO, command);
+  while (lapic_read (LAPIC_ICR_LO) & ICR_PENDING)
+    asm volatile ("pause");
+
+  intr_set_level (old_level);
+}
@@ -0,0 +1,26 @@
+#ifndef DEVICES_LAPIC_H
+#define DEVICES_LAPIC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Interrupt vectors delivered by the local APIC.  They sit above
+   the PIC's 0x20...0x2f and the system call's 0x30, and are
+   handled as external interrupts. */
+#define LAPIC_VEC_TIMER     0xf0    /* Local APIC timer. */
+#define LAPIC_VEC_RESCHED   0xf1    /* Reschedule IPI. */
+#define LAPIC_VEC_TLB       0xf2    /* TLB shootdown IPI. */
+#define LAPIC_VEC_SPURIOUS  0xff    /* Spurious interrupt. */
+
+bool lapic_init (void);
+void lapic_init_ap (void);
+uint8_t lapic_id (void);
+void lapic_eoi (void);
+
+void lapic_send_ipi (uint8_t apic_id, uint8_t vec);
+void lapic_start_ap (uint8_t apic_id, uint32_t start_paddr);
+
+void lapic_timer_calibrate (void);
+void lapic_timer_start (void);
+
+#endif /* devices/lapic.h */
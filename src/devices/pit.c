@@ -3,6 +3,7 @@
 #include <stdint.h>
 #include "threads/interrupt.h"
 #include "threads/io.h"
+#include "threads/synch.h"
 
 /* Interface to 8254 Programmable Interrupt Timer (PIT).
    Refer to [8254] for details. */
@@ -11,8 +12,11 @@
 #define PIT_PORT_CONTROL          0x43                /* Control port. */
 #define PIT_PORT_COUNTER(CHANNEL) (0x40 + (CHANNEL))  /* Counter port. */
 
-/* PIT cycles per second. */
-#define PIT_HZ 1193180
+/* Serializes access to the PIT's ports, which take several
+   writes per command, among CPUs.  Taken with interrupts off.  A
+   zeroed spinlock is free, so it works before any
+   initialization. */
+static struct spinlock pit_lock;
 
 /* Configure the given CHANNEL in the PIT.  In a PC, the PIT's
    three output channels are hooked up like this:
@@ -76,8 +80,61 @@ pit_configure_channel (int channel, int mode, int frequency)
 
   /* Configure the PIT mode and load its counters. */
   old_level = intr_disable ();
+  spinlock_acquire (&pit_lock);
   outb (PIT_PORT_CONTROL, (channel << 6) | 0x30 | (mode << 1));
   outb (PIT_PORT_COUNTER (channel), count);
   outb (PIT_PORT_COUNTER (channel), count >> 8);
+  spinlock_release (&pit_lock);
   intr_set_level (old_level);
 }
+
+/* Starts a one-shot countdown of COUNT PIT cycles on CHANNEL,
+   using mode 0 ("interrupt on terminal count"): the channel's
+   output goes low now and rises once, when the count reaches
+   zero, which raises a single interrupt on channel 0.  Going back
+   to periodic operation takes another pit_configure_channel().
+
+   COUNT must be nonzero (the PIT would treat 0 as 65536). */
+void
+pit_start_oneshot (int channel, uint16_t count)
+{
+  enum intr_level old_level;
+
+  ASSERT (channel == 0 || channel == 2);
+  ASSERT (count != 0);
+
+  old_level = intr_disable ();
+  spinlock_acquire (&pit_lock);
+  outb (PIT_PORT_CONTROL, (channel << 6) | 0x30);
+  outb (PIT_PORT_COUNTER (channel), count);
+  outb (PIT_PORT_COUNTER (channel), count >> 8);
+  spinlock_release (&pit_lock);
+  intr_set_level (old_level);
+}
+
+/* Latches CHANNEL's status and current count together with the
+   8254 read-back command and returns the count.  Stores the state
+   of the channel's output pin in *OUTPUT; in mode 0 it is true
+   once the countdown has reached zero, after which the count
+   keeps wrapping around and is meaningless. */
+uint16_t
+pit_read_back (int channel, bool *output)
+{
+  enum intr_level old_level;
+  uint8_t status;
+  uint16_t count;
+
+  ASSERT (channel == 0 || channel == 2);
+
+  old_level = intr_disable ();
+  spinlock_acquire (&pit_lock);
+  outb (PIT_PORT_CONTROL, 0xc0 | (1 << (channel + 1)));
+  status = inb (PIT_PORT_COUNTER (channel));
+  count = inb (PIT_PORT_COUNTER (channel));
+  count |= inb (PIT_PORT_COUNTER (channel)) << 8;
+  spinlock_release (&pit_lock);
+  intr_set_level (old_level);
+
+  *output = (status & 0x80) != 0;
+  return count;
+}
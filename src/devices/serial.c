@@ -51,7 +51,8 @@
 /* Transmission mode. */
 static enum { UNINIT, POLL, QUEUE } mode;
 
-/* Data to be transmitted. */
+/* Data to be transmitted.  Its spinlock also protects `mode' and
+   the UART's registers once interrupts have been initialized. */
 static struct intq txq;
 
 static void set_serial (int bps);
@@ -88,9 +89,11 @@ serial_init_queue (void)
   ASSERT (mode == POLL);
 
   intr_register_ext (0x20 + 4, serial_interrupt, "serial");
-  mode = QUEUE;
   old_level = intr_disable ();
+  spinlock_acquire (&txq.spin);
+  mode = QUEUE;
   write_ier ();
+  spinlock_release (&txq.spin);
   intr_set_level (old_level);
 }
 
@@ -100,12 +103,17 @@ serial_putc (uint8_t byte)
 {
   enum intr_level old_level = intr_disable ();
 
+  /* This happens before any other CPU is started, so it needs no
+     locking, and it must come first because it initializes the
+     lock. */
+  if (mode == UNINIT)
+    init_poll ();
+
+  spinlock_acquire (&txq.spin);
   if (mode != QUEUE)
     {
       /* If we're not set up for interrupt-driven I/O yet,
          use dumb polling to transmit a byte. */
-      if (mode == UNINIT)
-        init_poll ();
       putc_poll (byte);
     }
   else
@@ -125,6 +133,7 @@ serial_putc (uint8_t byte)
       intq_putc (&txq, byte);
       write_ier ();
     }
+  spinlock_release (&txq.spin);
 
   intr_set_level (old_level);
 }
@@ -135,8 +144,10 @@ void
 serial_flush (void)
 {
   enum intr_level old_level = intr_disable ();
+  spinlock_acquire (&txq.spin);
   while (!intq_empty (&txq))
     putc_poll (intq_getc (&txq));
+  spinlock_release (&txq.spin);
   intr_set_level (old_level);
 }
 
@@ -148,8 +159,11 @@ void
 serial_notify (void)
 {
   ASSERT (intr_get_level () == INTR_OFF);
+
+  spinlock_acquire (&txq.spin);
   if (mode == QUEUE)
     write_ier ();
+  spinlock_release (&txq.spin);
 }
 
 /* Configures the serial port for BPS bits per second. */
@@ -172,7 +186,11 @@ set_serial (int bps)
   outb (LCR_REG, LCR_N81);
 }
 
-/* Update interrupt enable register. */
+/* Update interrupt enable register.  The transmit queue's
+   spinlock must be held.  The input buffer is not locked here,
+   because input.c calls serial_notify() after every change to
+   its fullness and the last such call always sees it up to
+   date. */
 static void
 write_ier (void)
 {
@@ -214,15 +232,19 @@ serial_interrupt (struct intr_frame *f UNUSED)
   inb (IIR_REG);
 
   /* As long as we have room to receive a byte, and the hardware
-     has a byte for us, receive a byte.  */
+     has a byte for us, receive a byte.  input_putc() takes the
+     transmit queue's spinlock itself, through serial_notify(), so
+     this happens before we take it. */
   while (!input_full () && (inb (LSR_REG) & LSR_DR) != 0)
     input_putc (inb (RBR_REG));
 
   /* As long as we have a byte to transmit, and the hardware is
      ready to accept a byte for transmission, transmit a byte. */
+  spinlock_acquire (&txq.spin);
   while (!intq_empty (&txq) && (inb (LSR_REG) & LSR_THRE) != 0)
     outb (THR_REG, intq_getc (&txq));
 
   /* Update interrupt enable register based on queue status. */
   write_ier ();
+  spinlock_release (&txq.spin);
 }
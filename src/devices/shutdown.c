@@ -4,8 +4,15 @@
 #include "devices/kbd.h"
 #include "devices/serial.h"
 #include "devices/timer.h"
+#include "threads/interrupt.h"
 #include "threads/io.h"
+#include "threads/palloc.h"
+#include "threads/profile.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
+#include "threads/workqueue.h"
 #ifdef USERPROG
 #include "userprog/exception.h"
 #endif
@@ -95,6 +102,7 @@ shutdown_power_off (void)
 #endif
 
   print_stats ();
+  trace_dump ();
 
   printf ("Powering off...\n");
   serial_flush ();
@@ -129,10 +137,16 @@ static void
 print_stats (void)
 {
   timer_print_stats ();
+  intr_print_stats ();
   thread_print_stats ();
+  workqueue_print_stats ();
+  palloc_print_stats ();
+  kmem_cache_print_stats ();
 #ifdef FILESYS
   block_print_stats ();
 #endif
+  lockstat_print_stats ();
+  profile_print_stats ();
   console_print_stats ();
   kbd_print_stats ();
 #ifdef USERPROG
@@ -2,6 +2,7 @@
 #include "devices/pit.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/synch.h"
 #include "devices/timer.h"
 
 /* Speaker port enable I/O register. */
@@ -10,6 +11,10 @@
 /* Speaker port enable bits. */
 #define SPEAKER_GATE_ENABLE	0x03
 
+/* Serializes updates to SPEAKER_PORT_GATE among CPUs.  Taken
+   with interrupts off. */
+static struct spinlock speaker_lock;
+
 /* Sets the PC speaker to emit a tone at the given FREQUENCY, in
    Hz. */
 void
@@ -21,8 +26,10 @@ speaker_on (int frequency)
          output a square wave at the given FREQUENCY, then
          connect the timer channel output to the speaker. */
       enum intr_level old_level = intr_disable ();
+      spinlock_acquire (&speaker_lock);
       pit_configure_channel (2, 3, frequency);
       outb (SPEAKER_PORT_GATE, inb (SPEAKER_PORT_GATE) | SPEAKER_GATE_ENABLE);
+      spinlock_release (&speaker_lock);
       intr_set_level (old_level);
     }
   else
@@ -39,7 +46,9 @@ void
 speaker_off (void)
 {
   enum intr_level old_level = intr_disable ();
+  spinlock_acquire (&speaker_lock);
   outb (SPEAKER_PORT_GATE, inb (SPEAKER_PORT_GATE) & ~SPEAKER_GATE_ENABLE);
+  spinlock_release (&speaker_lock);
   intr_set_level (old_level);
 }
 
@@ -3,8 +3,12 @@
 #include <inttypes.h>
 #include <round.h>
 #include <stdio.h>
+#include "devices/lapic.h"
 #include "devices/pit.h"
+#include "devices/timerwheel.h"
+#include "threads/cpu.h"
 #include "threads/interrupt.h"
+#include "threads/profile.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
 
@@ -17,18 +21,59 @@
 #error TIMER_FREQ <= 1000 recommended
 #endif
 
-/* Number of timer ticks since OS booted. */
-static int64_t ticks;
+/* Number of timer ticks since OS booted.  Only the bootstrap
+   processor's timer interrupt advances it. */
+static volatile int64_t ticks;
+
+/* If true, stop the periodic tick while idle.
+   Controlled by kernel command-line option "-tickless". */
+bool timer_tickless;
+
+/* PIT cycles per timer tick, as programmed by timer_init(). */
+#define TICK_CYCLES ((PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ)
+
+/* Tickless idle.  While the idle thread runs, the PIT may be put
+   in one-shot mode, counting down ONESHOT_TICKS ticks' worth of
+   cycles to the next tick at which a kernel timer is due.  The
+   countdown is still aligned to tick boundaries, so the tick
+   count loses nothing when it is caught up. */
+static bool oneshot_active;     /* PIT in one-shot mode? */
+static int64_t oneshot_ticks;   /* Ticks elapsed when it fires. */
+static int64_t skipped_ticks;   /* # of timer interrupts avoided. */
 
 /* Number of loops per timer tick.
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
 
+/* Time stamp counter (TSC).  See [IA32-v3b] 18.9 "Time-Stamp
+   Counter".  The TSC counts at a fixed rate, measured against
+   the PIT by timer_calibrate(), which makes it a monotonic clock
+   with resolution far finer than a timer tick.  The TSCs of all
+   CPUs are assumed to be in step, as they are under the
+   emulators we run on.
+
+   TSC_HZ is 0 until calibration, and stays 0 if the CPU has no
+   TSC, in which case the clock falls back to the tick count. */
+static uint64_t tsc_hz;         /* TSC cycles per second. */
+static uint64_t tsc_base;       /* TSC when calibration ended. */
+
+/* CPUID leaf 1, EDX: the CPU has a TSC. */
+#define CPUID_TSC (1 << 4)
+
+/* Number of timer ticks over which the TSC is calibrated. */
+#define TSC_CALIBRATE_TICKS 5
+
+#define NS_PER_SEC 1000000000
+
 static intr_handler_func timer_interrupt;
+static intr_handler_func local_timer_interrupt;
 static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
 static void real_time_delay (int64_t num, int32_t denom);
+static void advance_ticks (int64_t n);
+static void tsc_calibrate (void);
+static inline uint64_t rdtsc (void);
 
 /* Sets up the timer to interrupt TIMER_FREQ times per second,
    and registers the corresponding interrupt. */
@@ -36,9 +81,22 @@ void
 timer_init (void)
 {
   pit_configure_channel (0, 2, TIMER_FREQ);
+  timerwheel_init ();
   intr_register_ext (0x20, timer_interrupt, "8254 Timer");
 }
 
+/* Registers the interrupt of the local APIC timers, which tick
+   TIMER_FREQ times per second on each application processor.
+   Only the bootstrap processor's PIT tick advances the tick
+   count and runs kernel timers; the local ticks just drive
+   scheduling on the other CPUs. */
+void
+timer_init_smp (void)
+{
+  intr_register_ext (LAPIC_VEC_TIMER, local_timer_interrupt,
+                     "Local APIC Timer");
+}
+
 /* Calibrates loops_per_tick, used to implement brief delays. */
 void
 timer_calibrate (void)
@@ -64,15 +122,23 @@ timer_calibrate (void)
       loops_per_tick |= test_bit;
 
   printf ("%'"PRIu64" loops/s.\n", (uint64_t) loops_per_tick * TIMER_FREQ);
+
+  tsc_calibrate ();
 }
 
-/* Returns the number of timer ticks since the OS booted. */
+/* Returns the number of timer ticks since the OS booted.
+
+   The tick count may be advanced by another CPU at any time, and
+   a 64-bit read is two loads, so a read that straddled an update
+   is retried. */
 int64_t
 timer_ticks (void)
 {
-  enum intr_level old_level = intr_disable ();
-  int64_t t = ticks;
-  intr_set_level (old_level);
+  int64_t t;
+
+  do
+    t = ticks;
+  while (t != ticks);
   return t;
 }
 
@@ -84,6 +150,41 @@ timer_elapsed (int64_t then)
   return timer_ticks () - then;
 }
 
+/* Returns the number of TSC cycles since the timer was
+   calibrated, or 0 if there is no TSC.  Cheap enough to
+   timestamp individual events; use timer_cycles_to_ns() to turn
+   a difference between two readings into time. */
+uint64_t
+timer_cycles (void)
+{
+  return tsc_hz != 0 ? rdtsc () - tsc_base : 0;
+}
+
+/* Converts CYCLES TSC cycles into nanoseconds.  Returns 0 if
+   there is no TSC. */
+int64_t
+timer_cycles_to_ns (uint64_t cycles)
+{
+  if (tsc_hz == 0)
+    return 0;
+
+  /* Split off whole seconds so that the multiplication cannot
+     overflow. */
+  return (cycles / tsc_hz * NS_PER_SEC
+          + cycles % tsc_hz * NS_PER_SEC / tsc_hz);
+}
+
+/* Returns the number of nanoseconds since the timer was
+   calibrated.  Without a TSC, this is only as precise as the
+   tick count. */
+int64_t
+timer_ns (void)
+{
+  if (tsc_hz == 0)
+    return timer_ticks () * (NS_PER_SEC / TIMER_FREQ);
+  return timer_cycles_to_ns (timer_cycles ());
+}
+
 /* Sleeps for approximately TICKS timer ticks.  Interrupts must
    be turned on. */
 void
@@ -95,11 +196,7 @@ timer_sleep (int64_t ticks)
 
   // 🧵 project1/task1
   if (timer_elapsed (start) < ticks)
-    {
-      // Needs to be created in thread.c since it access static variable
-      // sleep_list
-      thread_sleep (start + ticks);
-    }
+    thread_sleep (start + ticks);
 }
 
 
@@ -173,27 +270,145 @@ timer_print_stats (void)
   printf ("Timer: %"PRId64" ticks\n", timer_ticks ());
 }
 
+/* Stops the periodic tick until the next tick at which a kernel
+   timer is due, if that is at least two ticks away, by putting
+   the PIT in one-shot mode.  Called by the idle thread, with
+   interrupts off, right before it halts.  Does nothing unless
+   tickless mode is enabled. */
+void
+timer_tickless_enter (void)
+{
+  int64_t max_ticks = UINT16_MAX / TICK_CYCLES;
+  uint16_t left;
+  bool output;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!timer_tickless || oneshot_active)
+    return;
+
+  oneshot_ticks = timerwheel_next_event (ticks + max_ticks + 1) - ticks;
+  if (oneshot_ticks < 2)
+    return;
+  if (oneshot_ticks > max_ticks)
+    oneshot_ticks = max_ticks;
+
+  /* Finish the current tick's period first, so that the one-shot
+     ends exactly on a tick boundary. */
+  left = pit_read_back (0, &output);
+  pit_start_oneshot (0, left + (oneshot_ticks - 1) * TICK_CYCLES);
+  oneshot_active = true;
+}
+
+/* Brings the tick count up to date after an interrupt ended a
+   tickless idle period early, and re-arms the PIT for the next
+   tick boundary, after which periodic ticks resume.  Called at
+   the start of every external interrupt; does nothing unless the
+   PIT is in one-shot mode. */
+void
+timer_tickless_exit (void)
+{
+  int64_t ticks_left;
+  uint16_t left;
+  bool output;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!oneshot_active)
+    return;
+
+  /* If the countdown already ran out, timer_interrupt() is about
+     to run (or is running) and will do the catching up. */
+  left = pit_read_back (0, &output);
+  if (output || left == 0)
+    return;
+
+  /* The one-shot ends ONESHOT_TICKS tick boundaries after it was
+     started and the last of them is LEFT cycles away, so the ones
+     still ahead are ceil(LEFT / TICK_CYCLES). */
+  ticks_left = DIV_ROUND_UP (left, TICK_CYCLES);
+  pit_start_oneshot (0, left - (ticks_left - 1) * TICK_CYCLES);
+  skipped_ticks += oneshot_ticks - ticks_left;
+  advance_ticks (oneshot_ticks - ticks_left);
+  oneshot_ticks = 1;
+}
+
+/* Returns the number of timer ticks that passed without a timer
+   interrupt because of tickless idle. */
+int64_t
+timer_skipped_ticks (void)
+{
+  return skipped_ticks;
+}
+
 /* Timer interrupt handler. */
 static void
-timer_interrupt (struct intr_frame *args UNUSED)
+timer_interrupt (struct intr_frame *args)
 {
-  ticks++;
+  if (profile_enabled)
+    profile_sample (args);
+
+  if (oneshot_active)
+    {
+      /* End of a tickless idle period: account for all the ticks
+         it covered and go back to periodic mode. */
+      oneshot_active = false;
+      pit_configure_channel (0, 2, TIMER_FREQ);
+      skipped_ticks += oneshot_ticks - 1;
+      advance_ticks (oneshot_ticks);
+    }
+  else
+    advance_ticks (1);
+}
+
+/* Local APIC timer interrupt handler, on an application
+   processor.  Does the scheduling part of a tick's work for the
+   thread running there. */
+static void
+local_timer_interrupt (struct intr_frame *args)
+{
+  struct cpu *c = cpu_current ();
+
+  if (profile_enabled)
+    profile_sample (args);
+
+  c->local_ticks++;
   thread_tick ();
-  // 🧵 project1/task3
   if (thread_mlfqs)
-  {
-    inc_recent_cpu ();
-    if (ticks % TIMER_FREQ == 0)
     {
-      mlfqs_update_load_avg ();
-      mlfqs_update_recent_cpu ();
+      inc_recent_cpu ();
+      if (c->local_ticks % 4 == 0)
+        mlfqs_update_priority ();
+    }
+}
+
+/* Advances the tick count by N ticks, doing each tick's work.
+   Must be called from the timer interrupt handler or, at least,
+   in external interrupt context. */
+static void
+advance_ticks (int64_t n)
+{
+  for (; n > 0; n--)
+    {
+      ticks++;
+      thread_tick ();
+      // 🧵 project1/task3
+      if (thread_mlfqs)
+      {
+        inc_recent_cpu ();
+        if (ticks % TIMER_FREQ == 0)
+        {
+          mlfqs_update_load_avg ();
+          mlfqs_update_recent_cpu ();
+        }
+        if (ticks % 4 == 0) // every 4th tick the priority is recalculated
+          mlfqs_update_priority ();
+      }
     }
-    if (ticks % 4 == 0) // every 4th tick the priority is recalculated
-      mlfqs_update_priority ();
-  }
 
-  // 🧵 project1/task1 wake up routine
-  thread_awake (ticks);
+  // 🧵 project1/task1 wake up routine: run the expired kernel timers,
+  // which include the sleeping threads' wakeups
+  timerwheel_advance (ticks);
 }
 
 /* Returns true if LOOPS iterations waits for more than one timer
@@ -264,5 +479,61 @@ real_time_delay (int64_t num, int32_t denom)
   /* Scale the numerator and denominator down by 1000 to avoid
      the possibility of overflow. */
   ASSERT (denom % 1000 == 0);
-  busy_wait (loops_per_tick * num / 1000 * TIMER_FREQ / (denom / 1000));
+
+  if (tsc_hz != 0)
+    {
+      /* Watch the TSC, which is not thrown off by interrupts
+         taken during the wait. */
+      uint64_t start = rdtsc ();
+      uint64_t cycles = tsc_hz / 1000 * num / (denom / 1000);
+
+      while (rdtsc () - start < cycles)
+        asm volatile ("pause");
+    }
+  else
+    busy_wait (loops_per_tick * num / 1000 * TIMER_FREQ / (denom / 1000));
+}
+
+/* Measures the TSC rate against the timer tick.  Interrupts must
+   be on. */
+static void
+tsc_calibrate (void)
+{
+  uint32_t eax, ebx, ecx, edx;
+  uint64_t start_tsc;
+  int64_t start;
+
+  ASSERT (intr_get_level () == INTR_ON);
+
+  /* See [IA32-v2a] "CPUID". */
+  asm ("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "a" (1));
+  if (!(edx & CPUID_TSC))
+    {
+      printf ("No TSC, using timer ticks as clock.\n");
+      return;
+    }
+
+  /* Count TSC cycles over TSC_CALIBRATE_TICKS ticks, starting on
+     a tick boundary. */
+  start = ticks;
+  while (ticks == start)
+    barrier ();
+  start_tsc = rdtsc ();
+  start = ticks;
+  while (ticks - start < TSC_CALIBRATE_TICKS)
+    barrier ();
+  tsc_base = rdtsc ();
+  tsc_hz = (tsc_base - start_tsc) * TIMER_FREQ / TSC_CALIBRATE_TICKS;
+
+  printf ("TSC runs at %'"PRIu64" Hz.\n", tsc_hz);
+}
+
+/* Returns the running CPU's time stamp counter.  See [IA32-v2b]
+   "RDTSC". */
+static inline uint64_t
+rdtsc (void)
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
 }
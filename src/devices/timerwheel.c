@@ -0,0 +1,250 @@
+#include "devices/timerwheel.h"
+#include <debug.h>
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+
+/* Hierarchical timing wheel.
+
+   Pending timers live in WHEEL_LEVELS levels of WHEEL_SLOTS
+   slots each.  Level 0 has one slot per tick; each slot of level
+   L spans WHEEL_SLOTS times as many ticks as a slot of level
+   L - 1.  A timer due in fewer than WHEEL_SLOTS ticks goes
+   straight into the level-0 slot of its expiry tick; a timer
+   further away goes into the coarsest slot that will be reached
+   before it expires.
+
+   Every tick runs the timers in one level-0 slot.  When level 0
+   wraps around, the next slot of level 1 is "cascaded": its
+   timers are re-inserted relative to the current time, which
+   moves them down to finer levels, and so on upward.  So arming
+   and cancelling are O(1), and each timer is moved at most
+   WHEEL_LEVELS - 1 times before it fires.
+
+   Timers due more than WHEEL_RANGE ticks ahead are parked in the
+   farthest top-level slot and re-inserted when it cascades.
+
+   The wheel and every pending timer's `elem', `expires' and
+   `pending' members are protected by wheel_lock, which is taken
+   with interrupts off.  It is not held while a timer's function
+   runs, so the function may re-arm its timer or wake a thread. */
+
+#define WHEEL_BITS 6                            /* log2 (WHEEL_SLOTS). */
+#define WHEEL_SLOTS (1 << WHEEL_BITS)           /* Slots per level. */
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS 4                          /* Number of levels. */
+#define WHEEL_RANGE ((int64_t) 1 << (WHEEL_BITS * WHEEL_LEVELS))
+
+static struct list wheel[WHEEL_LEVELS][WHEEL_SLOTS];
+
+/* Last tick processed by timerwheel_advance(). */
+static int64_t wheel_now;
+
+static struct spinlock wheel_lock;
+
+static void insert (struct ktimer *);
+static void cascade (int level);
+static int slot_index (int64_t tick, int level);
+
+/* Initializes the timing wheel. */
+void
+timerwheel_init (void)
+{
+  int level, slot;
+
+  for (level = 0; level < WHEEL_LEVELS; level++)
+    for (slot = 0; slot < WHEEL_SLOTS; slot++)
+      list_init (&wheel[level][slot]);
+  wheel_now = 0;
+  spinlock_init (&wheel_lock);
+}
+
+/* Runs every timer that expires at or before tick NOW, which
+   must not be less than the last value passed in.  Called by
+   the timer interrupt handler. */
+void
+timerwheel_advance (int64_t now)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  spinlock_acquire (&wheel_lock);
+  while (wheel_now < now)
+    {
+      struct list *slot;
+      int level;
+
+      wheel_now++;
+
+      /* Pull down the timers of every level that just wrapped. */
+      for (level = 1; level < WHEEL_LEVELS; level++)
+        {
+          if (slot_index (wheel_now, level - 1) != 0)
+            break;
+          cascade (level);
+        }
+
+      slot = &wheel[0][slot_index (wheel_now, 0)];
+      while (!list_empty (slot))
+        {
+          struct ktimer *t = list_entry (list_pop_front (slot),
+                                         struct ktimer, elem);
+          t->pending = false;
+          spinlock_release (&wheel_lock);
+          t->func (t->aux);
+          spinlock_acquire (&wheel_lock);
+        }
+    }
+  spinlock_release (&wheel_lock);
+}
+
+/* Returns the earliest tick, before LIMIT, at which
+   timerwheel_advance() will have work to do: timers to run or a
+   non-empty slot to cascade.  Returns LIMIT if there is no such
+   tick.  The answer may be early, since a cascaded timer need not
+   fire right away, but it is never late.  Interrupts must be
+   off.
+
+   Scans at most WHEEL_SLOTS ticks ahead; a LIMIT farther than
+   that is pulled in. */
+int64_t
+timerwheel_next_event (int64_t limit)
+{
+  int64_t tick;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  spinlock_acquire (&wheel_lock);
+  if (limit > wheel_now + WHEEL_SLOTS)
+    limit = wheel_now + WHEEL_SLOTS;
+
+  for (tick = wheel_now + 1; tick < limit; tick++)
+    {
+      int level;
+
+      if (!list_empty (&wheel[0][slot_index (tick, 0)]))
+        {
+          limit = tick;
+          break;
+        }
+      for (level = 1; level < WHEEL_LEVELS; level++)
+        {
+          if (slot_index (tick, level - 1) != 0)
+            break;
+          if (!list_empty (&wheel[level][slot_index (tick, level)]))
+            {
+              limit = tick;
+              break;
+            }
+        }
+    }
+  spinlock_release (&wheel_lock);
+  return limit;
+}
+
+/* Initializes timer T to call FUNC with AUX when it expires.
+   T is not armed. */
+void
+ktimer_init (struct ktimer *t, ktimer_func *func, void *aux)
+{
+  ASSERT (t != NULL);
+  ASSERT (func != NULL);
+
+  t->expires = 0;
+  t->func = func;
+  t->aux = aux;
+  t->pending = false;
+}
+
+/* Arms T to expire at tick EXPIRES, first cancelling it if it
+   is already pending.  A timer whose EXPIRES has already passed
+   expires on the next tick. */
+void
+ktimer_arm (struct ktimer *t, int64_t expires)
+{
+  enum intr_level old_level;
+
+  ASSERT (t != NULL);
+
+  old_level = intr_disable ();
+  spinlock_acquire (&wheel_lock);
+  if (t->pending)
+    list_remove (&t->elem);
+  t->expires = expires > wheel_now ? expires : wheel_now + 1;
+  t->pending = true;
+  insert (t);
+  spinlock_release (&wheel_lock);
+  intr_set_level (old_level);
+}
+
+/* Cancels T.  Returns true if T was pending, false if it had
+   already expired or was never armed. */
+bool
+ktimer_cancel (struct ktimer *t)
+{
+  enum intr_level old_level;
+  bool was_pending;
+
+  ASSERT (t != NULL);
+
+  old_level = intr_disable ();
+  spinlock_acquire (&wheel_lock);
+  was_pending = t->pending;
+  if (was_pending)
+    {
+      list_remove (&t->elem);
+      t->pending = false;
+    }
+  spinlock_release (&wheel_lock);
+  intr_set_level (old_level);
+
+  return was_pending;
+}
+
+/* Returns true if T is armed and has not expired yet. */
+bool
+ktimer_pending (const struct ktimer *t)
+{
+  return t->pending;
+}
+
+/* Puts pending timer T into the slot matching its expiry,
+   relative to wheel_now.  wheel_lock must be held. */
+static void
+insert (struct ktimer *t)
+{
+  int64_t expires = t->expires;
+  int64_t delta = expires - wheel_now;
+  int level;
+
+  if (delta >= WHEEL_RANGE)
+    expires = wheel_now + WHEEL_RANGE - 1;
+
+  for (level = 0; level < WHEEL_LEVELS - 1; level++)
+    if (delta < (int64_t) WHEEL_SLOTS << (WHEEL_BITS * level))
+      break;
+
+  list_push_back (&wheel[level][slot_index (expires, level)], &t->elem);
+}
+
+/* Re-inserts the timers of the current slot of LEVEL, which
+   moves them to finer levels.  wheel_lock must be held. */
+static void
+cascade (int level)
+{
+  struct list *slot = &wheel[level][slot_index (wheel_now, level)];
+  struct list timers;
+
+  /* Detach the slot first: a parked timer may land back in it. */
+  list_init (&timers);
+  while (!list_empty (slot))
+    list_push_back (&timers, list_pop_front (slot));
+
+  while (!list_empty (&timers))
+    insert (list_entry (list_pop_front (&timers), struct ktimer, elem));
+}
+
+/* Returns the index of the slot of LEVEL that covers TICK. */
+static int
+slot_index (int64_t tick, int level)
+{
+  return (tick >> (WHEEL_BITS * level)) & WHEEL_MASK;
+}
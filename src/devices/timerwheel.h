@@ -0,0 +1,43 @@
+#ifndef DEVICES_TIMERWHEEL_H
+#define DEVICES_TIMERWHEEL_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Kernel timers driven by the timer interrupt.
+
+   A ktimer calls a function once the timer tick count reaches a
+   given value.  Arming and cancelling a timer take constant time:
+   pending timers are kept in a hierarchical timing wheel (see
+   timerwheel.c) instead of a sorted list.
+
+   Timer functions run in an external interrupt context, so they
+   must not sleep; typically they unblock a thread or queue work
+   for one.  ktimer functions may be called with interrupts on or
+   off, and from interrupt handlers, including from a timer's own
+   function to re-arm it. */
+
+/* Function called when a timer expires, given the timer's AUX. */
+typedef void ktimer_func (void *aux);
+
+/* A kernel timer. */
+struct ktimer
+  {
+    int64_t expires;            /* Tick at which to call FUNC. */
+    ktimer_func *func;          /* Function to call. */
+    void *aux;                  /* Auxiliary data for FUNC. */
+    bool pending;               /* Armed and not yet expired? */
+    struct list_elem elem;      /* Element in a wheel slot. */
+  };
+
+void timerwheel_init (void);
+void timerwheel_advance (int64_t now);
+int64_t timerwheel_next_event (int64_t limit);
+
+void ktimer_init (struct ktimer *, ktimer_func *, void *aux);
+void ktimer_arm (struct ktimer *, int64_t expires);
+bool ktimer_cancel (struct ktimer *);
+bool ktimer_pending (const struct ktimer *);
+
+#endif /* devices/timerwheel.h */
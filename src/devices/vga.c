@@ -6,6 +6,7 @@
 #include "devices/speaker.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/synch.h"
 #include "threads/vaddr.h"
 
 /* VGA text screen support.  See [FREEVGA] for more information. */
@@ -26,6 +27,11 @@ static size_t cx, cy;
    The attribute at (x,y) is fb[y][x][1]. */
 static uint8_t (*fb)[COL_CNT][2];
 
+/* Protects the cursor position, the framebuffer and the CRTC
+   registers from other CPUs.  Taken with interrupts off, which
+   locks out interrupt handlers on this CPU. */
+static struct spinlock vga_lock;
+
 static void clear_row (size_t y);
 static void cls (void);
 static void newline (void);
@@ -55,6 +61,7 @@ vga_putc (int c)
      that might write to the console. */
   enum intr_level old_level = intr_disable ();
 
+  spinlock_acquire (&vga_lock);
   init ();
 
   switch (c)
@@ -83,9 +90,11 @@ vga_putc (int c)
       break;
 
     case '\a':
+      spinlock_release (&vga_lock);
       intr_set_level (old_level);
       speaker_beep ();
       intr_disable ();
+      spinlock_acquire (&vga_lock);
       break;
 
     default:
@@ -99,6 +108,7 @@ vga_putc (int c)
   /* Update cursor position. */
   move_cursor ();
 
+  spinlock_release (&vga_lock);
   intr_set_level (old_level);
 }
 
@@ -7,6 +7,7 @@
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
+static size_t free_map_hint;         /* Where to look for free sectors. */
 
 /* Initializes the free map. */
 void
@@ -27,7 +28,9 @@ free_map_init (void)
 bool
 free_map_allocate (size_t cnt, block_sector_t *sectorp)
 {
-  block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
+  block_sector_t sector = bitmap_scan_and_flip_next (free_map,
+                                                     &free_map_hint,
+                                                     cnt, false);
   if (sector != BITMAP_ERROR
       && free_map_file != NULL
       && !bitmap_write (free_map, free_map_file))
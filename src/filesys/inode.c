@@ -5,7 +5,10 @@
 #include <string.h>
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
@@ -54,14 +57,31 @@ byte_to_sector (const struct inode *inode, off_t pos)
 }
 
 /* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
+   returns the same `struct inode'.  Looking an inode up only
+   reads the list, so lookups take open_inodes_lock shared and
+   proceed in parallel; adding and removing inodes take it
+   exclusive. */
 static struct list open_inodes;
+static struct rwlock open_inodes_lock;
+
+/* Protects every open inode's `open_cnt', which lookups and
+   closers change while holding open_inodes_lock shared, or not
+   at all. */
+static struct spinlock open_cnt_lock;
+
+/* Cache that open inodes are allocated from. */
+static struct kmem_cache *inode_cache;
+
+static struct inode *find_open_inode (block_sector_t);
 
 /* Initializes the inode module. */
 void
 inode_init (void)
 {
   list_init (&open_inodes);
+  rwlock_init (&open_inodes_lock);
+  spinlock_init (&open_cnt_lock);
+  inode_cache = kmem_cache_create ("inode", sizeof (struct inode), NULL);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
@@ -111,42 +131,73 @@ inode_create (block_sector_t sector, off_t length)
 struct inode *
 inode_open (block_sector_t sector)
 {
-  struct list_elem *e;
-  struct inode *inode;
+  struct inode *inode, *open;
+  struct rwlock_hold hold;
 
   /* Check whether this inode is already open. */
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e))
-    {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector)
-        {
-          inode_reopen (inode);
-          return inode;
-        }
-    }
+  rwlock_acquire_read (&open_inodes_lock, &hold);
+  inode = inode_reopen (find_open_inode (sector));
+  rwlock_release_read (&open_inodes_lock, &hold);
+  if (inode != NULL)
+    return inode;
 
   /* Allocate memory. */
-  inode = malloc (sizeof *inode);
+  inode = kmem_cache_alloc (inode_cache);
   if (inode == NULL)
     return NULL;
 
   /* Initialize. */
-  list_push_front (&open_inodes, &inode->elem);
   inode->sector = sector;
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
   block_read (fs_device, inode->sector, &inode->data);
+
+  /* Another thread may have opened the inode while we were
+     reading it. */
+  rwlock_acquire_write (&open_inodes_lock, &hold);
+  open = inode_reopen (find_open_inode (sector));
+  if (open == NULL)
+    list_push_front (&open_inodes, &inode->elem);
+  rwlock_release_write (&open_inodes_lock, &hold);
+  if (open != NULL)
+    {
+      kmem_cache_free (inode_cache, inode);
+      return open;
+    }
   return inode;
 }
 
+/* Returns the open inode for SECTOR, or a null pointer if there
+   is none.  open_inodes_lock must be held. */
+static struct inode *
+find_open_inode (block_sector_t sector)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
+       e = list_next (e))
+    {
+      struct inode *inode = list_entry (e, struct inode, elem);
+      if (inode->sector == sector)
+        return inode;
+    }
+  return NULL;
+}
+
 /* Reopens and returns INODE. */
 struct inode *
 inode_reopen (struct inode *inode)
 {
   if (inode != NULL)
-    inode->open_cnt++;
+    {
+      /* Any number of lookups may be reopening INODE at once. */
+      enum intr_level old_level = intr_disable ();
+      spinlock_acquire (&open_cnt_lock);
+      inode->open_cnt++;
+      spinlock_release (&open_cnt_lock);
+      intr_set_level (old_level);
+    }
   return inode;
 }
 
@@ -163,16 +214,41 @@ inode_get_inumber (const struct inode *inode)
 void
 inode_close (struct inode *inode)
 {
+  struct rwlock_hold hold;
+  enum intr_level old_level;
+  bool last;
+
   /* Ignore null pointer. */
   if (inode == NULL)
     return;
 
-  /* Release resources if this was the last opener. */
-  if (--inode->open_cnt == 0)
-    {
-      /* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
+  /* If other openers remain, just drop our reference. */
+  old_level = intr_disable ();
+  spinlock_acquire (&open_cnt_lock);
+  last = inode->open_cnt == 1;
+  if (!last)
+    inode->open_cnt--;
+  spinlock_release (&open_cnt_lock);
+  intr_set_level (old_level);
+  if (!last)
+    return;
 
+  /* We may be the last opener.  Only a closer holding
+     open_inodes_lock exclusive drops the count to zero, and
+     holding it keeps lookups from reopening INODE, but a lookup
+     may have reopened INODE before we got it, so check again. */
+  rwlock_acquire_write (&open_inodes_lock, &hold);
+  old_level = intr_disable ();
+  spinlock_acquire (&open_cnt_lock);
+  last = --inode->open_cnt == 0;
+  spinlock_release (&open_cnt_lock);
+  intr_set_level (old_level);
+  if (last)
+    list_remove (&inode->elem);
+  rwlock_release_write (&open_inodes_lock, &hold);
+
+  if (last)
+    {
       /* Deallocate blocks if removed. */
       if (inode->removed)
         {
@@ -181,7 +257,7 @@ inode_close (struct inode *inode)
                             bytes_to_sectors (inode->data.length));
         }
 
-      free (inode);
+      kmem_cache_free (inode_cache, inode);
     }
 }
 
@@ -60,6 +60,43 @@ byte_cnt (size_t bit_cnt)
   return sizeof (elem_type) * elem_cnt (bit_cnt);
 }
 
+/* Returns the bit index just past the element that contains the
+   bit numbered BIT_IDX, or END if that is smaller.  Functions
+   that work on a range of bits a whole element at a time step
+   through it with this. */
+static inline size_t
+elem_end (size_t bit_idx, size_t end)
+{
+  size_t next = (elem_idx (bit_idx) + 1) * ELEM_BITS;
+  return next < end ? next : end;
+}
+
+/* Returns an elem_type where the bits corresponding to START up
+   to but not including END are turned on.  END must not be past
+   the end of START's element; see elem_end(). */
+static inline elem_type
+range_mask (size_t start, size_t end)
+{
+  size_t cnt = end - start;
+  elem_type mask;
+
+  if (cnt < ELEM_BITS)
+    mask = ((elem_type) 1 << cnt) - 1;
+  else
+    mask = (elem_type) -1;
+  return mask << (start % ELEM_BITS);
+}
+
+/* Returns the bits of the element of B that contains BIT_IDX,
+   inverted if VALUE is false, so that the bits set to VALUE are
+   1s. */
+static inline elem_type
+elem_bits (const struct bitmap *b, size_t bit_idx, bool value)
+{
+  elem_type bits = b->bits[elem_idx (bit_idx)];
+  return value ? bits : ~bits;
+}
+
 /* Returns a bit mask in which the bits actually used in the last
    element of B's bits are set to 1 and the rest are set to 0. */
 static inline elem_type
@@ -213,18 +250,33 @@ bitmap_set_all (struct bitmap *b, bool value)
   bitmap_set_multiple (b, 0, bitmap_size (b), value);
 }
 
-/* Sets the CNT bits starting at START in B to VALUE. */
+/* Sets the CNT bits starting at START in B to VALUE.
+   Each element's bits are set atomically, a whole element at a
+   time. */
 void
 bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value)
 {
-  size_t i;
+  size_t end = start + cnt;
+  size_t i, next;
 
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    bitmap_set (b, start + i, value);
+  for (i = start; i < end; i = next)
+    {
+      elem_type *elem = &b->bits[elem_idx (i)];
+      elem_type mask;
+
+      next = elem_end (i, end);
+      mask = range_mask (i, next);
+
+      /* Like bitmap_mark() and bitmap_reset(). */
+      if (value)
+        asm ("orl %1, %0" : "+m" (*elem) : "r" (mask) : "cc");
+      else
+        asm ("andl %1, %0" : "+m" (*elem) : "r" (~mask) : "cc");
+    }
 }
 
 /* Returns the number of bits in B between START and START + CNT,
@@ -232,34 +284,52 @@ bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value)
 size_t
 bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value)
 {
-  size_t i, value_cnt;
+  size_t end = start + cnt;
+  size_t i, next, value_cnt;
 
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
   value_cnt = 0;
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      value_cnt++;
+  for (i = start; i < end; i = next)
+    {
+      next = elem_end (i, end);
+      value_cnt += __builtin_popcountl (elem_bits (b, i, value)
+                                        & range_mask (i, next));
+    }
   return value_cnt;
 }
 
+/* Returns the index of the first bit in B between START and END,
+   exclusive, that is set to VALUE, or END if there is none. */
+static size_t
+find_first (const struct bitmap *b, size_t start, size_t end, bool value)
+{
+  size_t i, next;
+
+  for (i = start; i < end; i = next)
+    {
+      elem_type bits;
+
+      next = elem_end (i, end);
+      bits = elem_bits (b, i, value) & range_mask (i, next);
+      if (bits != 0)
+        return elem_idx (i) * ELEM_BITS + __builtin_ctzl (bits);
+    }
+  return end;
+}
+
 /* Returns true if any bits in B between START and START + CNT,
    exclusive, are set to VALUE, and false otherwise. */
 bool
 bitmap_contains (const struct bitmap *b, size_t start, size_t cnt, bool value)
 {
-  size_t i;
-
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      return true;
-  return false;
+  return find_first (b, start, start + cnt, value) < start + cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -288,6 +358,39 @@ bitmap_all (const struct bitmap *b, size_t start, size_t cnt)
 
 /* Finding set or unset bits. */
 
+/* Finds and returns the starting index of the first group of CNT
+   consecutive bits in B that are all set to VALUE and lie between
+   START and END, exclusive.
+   If there is no such group, returns BITMAP_ERROR. */
+static size_t
+scan (const struct bitmap *b, size_t start, size_t end, size_t cnt,
+      bool value)
+{
+  size_t i = start;
+
+  if (cnt == 0)
+    return start;
+  if (cnt > end - start)
+    return BITMAP_ERROR;
+
+  while (i <= end - cnt)
+    {
+      size_t j;
+
+      /* Skip to the next bit set to VALUE.  If the CNT bits from
+         there on are all VALUE, we're done, otherwise no group
+         can start before the first one that isn't. */
+      i = find_first (b, i, end - cnt + 1, value);
+      if (i > end - cnt)
+        break;
+      j = find_first (b, i, i + cnt, !value);
+      if (j == i + cnt)
+        return i;
+      i = j + 1;
+    }
+  return BITMAP_ERROR;
+}
+
 /* Finds and returns the starting index of the first group of CNT
    consecutive bits in B at or after START that are all set to
    VALUE.
@@ -298,15 +401,34 @@ bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value)
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
 
-  if (cnt <= b->bit_cnt)
+  return scan (b, start, b->bit_cnt, cnt, value);
+}
+
+/* Finds and returns the starting index of the first group of CNT
+   consecutive bits in B at or after HINT that are all set to
+   VALUE, or if there is none, the first such group before HINT.
+   If there is no such group at all, returns BITMAP_ERROR.
+   Starting where the last search left off ("next fit") saves
+   searching the front of B over and over once it fills up. */
+size_t
+bitmap_scan_next (const struct bitmap *b, size_t hint, size_t cnt,
+                  bool value)
+{
+  size_t idx;
+
+  ASSERT (b != NULL);
+
+  if (hint >= b->bit_cnt)
+    hint = 0;
+  idx = scan (b, hint, b->bit_cnt, cnt, value);
+  if (idx == BITMAP_ERROR && hint > 0)
     {
-      size_t last = b->bit_cnt - cnt;
-      size_t i;
-      for (i = start; i <= last; i++)
-        if (!bitmap_contains (b, i, cnt, !value))
-          return i;
+      /* Wrap around.  A group that starts before HINT may extend
+         past it. */
+      size_t end = hint + cnt - 1;
+      idx = scan (b, 0, end < b->bit_cnt ? end : b->bit_cnt, cnt, value);
     }
-  return BITMAP_ERROR;
+  return idx;
 }
 
 /* Finds the first group of CNT consecutive bits in B at or after
@@ -324,6 +446,24 @@ bitmap_scan_and_flip (struct bitmap *b, size_t start, size_t cnt, bool value)
     bitmap_set_multiple (b, idx, cnt, !value);
   return idx;
 }
+
+/* Like bitmap_scan_and_flip(), but searches as bitmap_scan_next()
+   starting at *HINT, and if successful, sets *HINT to the index
+   just past the group, so that the next search starts there.
+   Bits are set atomically, but testing bits is not atomic with
+   setting them. */
+size_t
+bitmap_scan_and_flip_next (struct bitmap *b, size_t *hint, size_t cnt,
+                           bool value)
+{
+  size_t idx = bitmap_scan_next (b, *hint, cnt, value);
+  if (idx != BITMAP_ERROR)
+    {
+      bitmap_set_multiple (b, idx, cnt, !value);
+      *hint = idx + cnt;
+    }
+  return idx;
+}
 
 /* File input and output. */
 
@@ -0,0 +1,209 @@
+#include "heap.h"
+#include "../debug.h"
+
+static struct heap_elem *meld (struct heap *,
+                               struct heap_elem *, struct heap_elem *);
+static struct heap_elem *merge_pairs (struct heap *, struct heap_elem *);
+
+/* Initializes heap H as an empty heap ordered by LESS, which is
+   passed auxiliary data AUX. */
+void
+heap_init (struct heap *h, heap_less_func *less, void *aux)
+{
+  ASSERT (h != NULL);
+  ASSERT (less != NULL);
+
+  h->root = NULL;
+  h->size = 0;
+  h->less = less;
+  h->aux = aux;
+}
+
+/* Inserts E into H. */
+void
+heap_push (struct heap *h, struct heap_elem *e)
+{
+  ASSERT (h != NULL);
+  ASSERT (e != NULL);
+
+  e->child = e->next = e->prev = NULL;
+  h->root = meld (h, h->root, e);
+  h->size++;
+}
+
+/* Returns the greatest element in H, which must not be empty. */
+struct heap_elem *
+heap_top (struct heap *h)
+{
+  ASSERT (!heap_empty (h));
+
+  return h->root;
+}
+
+/* Removes and returns the greatest element in H, which must not
+   be empty. */
+struct heap_elem *
+heap_pop (struct heap *h)
+{
+  struct heap_elem *top = heap_top (h);
+
+  h->root = merge_pairs (h, top->child);
+  h->size--;
+  return top;
+}
+
+/* Removes E, which must be in H, from H. */
+void
+heap_remove (struct heap *h, struct heap_elem *e)
+{
+  ASSERT (h != NULL);
+  ASSERT (e != NULL);
+
+  if (e == h->root)
+    {
+      heap_pop (h);
+      return;
+    }
+
+  /* Unlink E and its subtree from its parent or previous
+     sibling, then meld its children back in. */
+  ASSERT (e->prev != NULL);
+  if (e->prev->child == e)
+    e->prev->child = e->next;
+  else
+    e->prev->next = e->next;
+  if (e->next != NULL)
+    e->next->prev = e->prev;
+
+  h->root = meld (h, h->root, merge_pairs (h, e->child));
+  h->size--;
+}
+
+/* Moves E, which must be in H, to its proper place after its
+   value changed. */
+void
+heap_update (struct heap *h, struct heap_elem *e)
+{
+  heap_remove (h, e);
+  heap_push (h, e);
+}
+
+/* Removes every element from H, in no particular order, and
+   calls ACTION on each one, passing AUX along.  H is empty
+   before the first call, and ACTION may free or reuse the
+   element it is passed.  Takes linear time. */
+void
+heap_drain (struct heap *h, heap_action_func *action, void *aux)
+{
+  struct heap_elem *e;
+
+  ASSERT (h != NULL);
+  ASSERT (action != NULL);
+
+  e = h->root;
+  h->root = NULL;
+  h->size = 0;
+
+  /* Walk the tree as one chain of siblings, splicing each
+     element's children in right after it. */
+  while (e != NULL)
+    {
+      struct heap_elem *next = e->next;
+
+      if (e->child != NULL)
+        {
+          struct heap_elem *last = e->child;
+          while (last->next != NULL)
+            last = last->next;
+          last->next = next;
+          next = e->child;
+        }
+      action (e, aux);
+      e = next;
+    }
+}
+
+/* Returns the number of elements in H. */
+size_t
+heap_size (const struct heap *h)
+{
+  ASSERT (h != NULL);
+
+  return h->size;
+}
+
+/* Returns true if H is empty, false otherwise. */
+bool
+heap_empty (const struct heap *h)
+{
+  ASSERT (h != NULL);
+
+  return h->root == NULL;
+}
+
+/* Melds the heaps rooted at A and B, either of which may be
+   null, and returns the root of the result, whose `next' and
+   `prev' are left alone. */
+static struct heap_elem *
+meld (struct heap *h, struct heap_elem *a, struct heap_elem *b)
+{
+  if (a == NULL)
+    return b;
+  if (b == NULL)
+    return a;
+
+  /* Make the lesser root the leftmost child of the greater.
+     On a tie, A stays on top. */
+  if (h->less (a, b, h->aux))
+    {
+      struct heap_elem *t = a;
+      a = b;
+      b = t;
+    }
+  b->prev = a;
+  b->next = a->child;
+  if (a->child != NULL)
+    a->child->prev = b;
+  a->child = b;
+  return a;
+}
+
+/* Melds the siblings FIRST, FIRST->next, ... into one heap and
+   returns its root, with null `next' and `prev'.  This is the
+   "two-pass" combining of [Fredman86]: meld the siblings in
+   pairs from left to right, then meld the pairs together from
+   right to left. */
+static struct heap_elem *
+merge_pairs (struct heap *h, struct heap_elem *first)
+{
+  struct heap_elem *pairs = NULL;
+  struct heap_elem *root = NULL;
+
+  /* First pass.  PAIRS is a stack, linked through `next', of
+     the melded pairs, most recent on top. */
+  while (first != NULL)
+    {
+      struct heap_elem *a = first;
+      struct heap_elem *b = a->next;
+
+      first = b != NULL ? b->next : NULL;
+      a->next = a->prev = NULL;
+      if (b != NULL)
+        {
+          b->next = b->prev = NULL;
+          a = meld (h, a, b);
+        }
+      a->next = pairs;
+      pairs = a;
+    }
+
+  /* Second pass. */
+  while (pairs != NULL)
+    {
+      struct heap_elem *next = pairs->next;
+      pairs->next = NULL;
+      root = meld (h, root, pairs);
+      pairs = next;
+    }
+  return root;
+}
@@ -0,0 +1,73 @@
+#ifndef __LIB_KERNEL_HEAP_H
+#define __LIB_KERNEL_HEAP_H
+
+/* Priority queue.
+
+   This is a pairing heap.  Like the other kernel containers, it
+   does not allocate memory: each structure that can be in a heap
+   embeds a struct heap_elem, and the heap_entry macro converts a
+   struct heap_elem back to the structure that contains it.
+   Refer to lib/kernel/list.h for a detailed explanation of the
+   technique.
+
+   The element at the top of the heap is the greatest according
+   to the heap's less-than function.  Insertion takes constant
+   time; removing the top or any other element takes O(lg n)
+   amortized time.  If the key of an element in the heap changes,
+   call heap_update() to move the element to its new place.  See
+   [Fredman86] for details. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Heap element. */
+struct heap_elem
+  {
+    struct heap_elem *child;    /* Leftmost child. */
+    struct heap_elem *next;     /* Next sibling. */
+    struct heap_elem *prev;     /* Previous sibling, or parent if
+                                   leftmost child, or null if root. */
+  };
+
+/* Converts pointer to heap element HEAP_ELEM into a pointer to
+   the structure that HEAP_ELEM is embedded inside.  Supply the
+   name of the outer structure STRUCT and the member name MEMBER
+   of the heap element. */
+#define heap_entry(HEAP_ELEM, STRUCT, MEMBER)                   \
+        ((STRUCT *) ((uint8_t *) &(HEAP_ELEM)->child            \
+                     - offsetof (STRUCT, MEMBER.child)))
+
+/* Compares the value of two heap elements A and B, given
+   auxiliary data AUX.  Returns true if A is less than B, or
+   false if A is greater than or equal to B. */
+typedef bool heap_less_func (const struct heap_elem *a,
+                             const struct heap_elem *b,
+                             void *aux);
+
+/* Performs some operation on heap element E, given auxiliary
+   data AUX. */
+typedef void heap_action_func (struct heap_elem *e, void *aux);
+
+/* Heap. */
+struct heap
+  {
+    struct heap_elem *root;     /* Greatest element, or null. */
+    size_t size;                /* Number of elements. */
+    heap_less_func *less;       /* Comparison function. */
+    void *aux;                  /* Auxiliary data for `less'. */
+  };
+
+void heap_init (struct heap *, heap_less_func *, void *aux);
+
+void heap_push (struct heap *, struct heap_elem *);
+struct heap_elem *heap_top (struct heap *);
+struct heap_elem *heap_pop (struct heap *);
+void heap_remove (struct heap *, struct heap_elem *);
+void heap_update (struct heap *, struct heap_elem *);
+void heap_drain (struct heap *, heap_action_func *, void *aux);
+
+size_t heap_size (const struct heap *);
+bool heap_empty (const struct heap *);
+
+#endif /* lib/kernel/heap.h */
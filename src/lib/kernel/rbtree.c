@@ -0,0 +1,389 @@
+#include "rbtree.h"
+#include "../debug.h"
+
+static bool is_red (const struct rbtree_elem *);
+static void rotate_left (struct rbtree *, struct rbtree_elem *);
+static void rotate_right (struct rbtree *, struct rbtree_elem *);
+static void transplant (struct rbtree *, struct rbtree_elem *,
+                        struct rbtree_elem *);
+static void insert_fixup (struct rbtree *, struct rbtree_elem *);
+static void remove_fixup (struct rbtree *, struct rbtree_elem *,
+                          struct rbtree_elem *parent);
+static struct rbtree_elem *minimum (struct rbtree_elem *);
+static struct rbtree_elem *maximum (struct rbtree_elem *);
+
+/* Initializes T as an empty tree ordered by LESS, which is
+   passed auxiliary data AUX. */
+void
+rbtree_init (struct rbtree *t, rbtree_less_func *less, void *aux)
+{
+  ASSERT (t != NULL);
+  ASSERT (less != NULL);
+
+  t->root = t->first = NULL;
+  t->size = 0;
+  t->less = less;
+  t->aux = aux;
+}
+
+/* Inserts E into T, after any elements equal to it. */
+void
+rbtree_insert (struct rbtree *t, struct rbtree_elem *e)
+{
+  struct rbtree_elem *parent = NULL;
+  struct rbtree_elem **link = &t->root;
+  bool leftmost = true;
+
+  ASSERT (t != NULL);
+  ASSERT (e != NULL);
+
+  while (*link != NULL)
+    {
+      parent = *link;
+      if (t->less (e, parent, t->aux))
+        link = &parent->left;
+      else
+        {
+          link = &parent->right;
+          leftmost = false;
+        }
+    }
+
+  e->parent = parent;
+  e->left = e->right = NULL;
+  e->red = true;
+  *link = e;
+  if (leftmost)
+    t->first = e;
+  t->size++;
+
+  insert_fixup (t, e);
+}
+
+/* Removes E, which must be in T, from T. */
+void
+rbtree_remove (struct rbtree *t, struct rbtree_elem *e)
+{
+  struct rbtree_elem *x, *x_parent;
+  bool removed_red = e->red;
+
+  ASSERT (t != NULL);
+  ASSERT (e != NULL);
+  ASSERT (t->size > 0);
+
+  if (t->first == e)
+    t->first = rbtree_next (e);
+
+  if (e->left == NULL)
+    {
+      x = e->right;
+      x_parent = e->parent;
+      transplant (t, e, e->right);
+    }
+  else if (e->right == NULL)
+    {
+      x = e->left;
+      x_parent = e->parent;
+      transplant (t, e, e->left);
+    }
+  else
+    {
+      /* Replace E by its successor Y, which has no left child. */
+      struct rbtree_elem *y = minimum (e->right);
+
+      removed_red = y->red;
+      x = y->right;
+      if (y->parent == e)
+        x_parent = y;
+      else
+        {
+          x_parent = y->parent;
+          transplant (t, y, y->right);
+          y->right = e->right;
+          y->right->parent = y;
+        }
+      transplant (t, e, y);
+      y->left = e->left;
+      y->left->parent = y;
+      y->red = e->red;
+    }
+  t->size--;
+
+  if (!removed_red)
+    remove_fixup (t, x, x_parent);
+}
+
+/* Returns the least element in T, or a null pointer if T is
+   empty. */
+struct rbtree_elem *
+rbtree_first (const struct rbtree *t)
+{
+  ASSERT (t != NULL);
+
+  return t->first;
+}
+
+/* Returns the greatest element in T, or a null pointer if T is
+   empty. */
+struct rbtree_elem *
+rbtree_last (const struct rbtree *t)
+{
+  ASSERT (t != NULL);
+
+  return t->root != NULL ? maximum (t->root) : NULL;
+}
+
+/* Returns the element after E in its tree, or a null pointer if
+   E is the greatest element. */
+struct rbtree_elem *
+rbtree_next (const struct rbtree_elem *e)
+{
+  ASSERT (e != NULL);
+
+  if (e->right != NULL)
+    return minimum (e->right);
+  while (e->parent != NULL && e == e->parent->right)
+    e = e->parent;
+  return e->parent;
+}
+
+/* Returns the element before E in its tree, or a null pointer if
+   E is the least element. */
+struct rbtree_elem *
+rbtree_prev (const struct rbtree_elem *e)
+{
+  ASSERT (e != NULL);
+
+  if (e->left != NULL)
+    return maximum (e->left);
+  while (e->parent != NULL && e == e->parent->left)
+    e = e->parent;
+  return e->parent;
+}
+
+/* Returns the number of elements in T. */
+size_t
+rbtree_size (const struct rbtree *t)
+{
+  ASSERT (t != NULL);
+
+  return t->size;
+}
+
+/* Returns true if T is empty, false otherwise. */
+bool
+rbtree_empty (const struct rbtree *t)
+{
+  return rbtree_size (t) == 0;
+}
+
+/* Returns true if E is red.  Null leaves are black. */
+static bool
+is_red (const struct rbtree_elem *e)
+{
+  return e != NULL && e->red;
+}
+
+/* Makes X's right child Y take X's place in T, with X as Y's left
+   child. */
+static void
+rotate_left (struct rbtree *t, struct rbtree_elem *x)
+{
+  struct rbtree_elem *y = x->right;
+
+  x->right = y->left;
+  if (y->left != NULL)
+    y->left->parent = x;
+  transplant (t, x, y);
+  y->left = x;
+  x->parent = y;
+}
+
+/* Makes X's left child Y take X's place in T, with X as Y's right
+   child. */
+static void
+rotate_right (struct rbtree *t, struct rbtree_elem *x)
+{
+  struct rbtree_elem *y = x->left;
+
+  x->left = y->right;
+  if (y->right != NULL)
+    y->right->parent = x;
+  transplant (t, x, y);
+  y->right = x;
+  x->parent = y;
+}
+
+/* Puts V, which may be null, in U's place under U's parent in T.
+   U's own children are left alone. */
+static void
+transplant (struct rbtree *t, struct rbtree_elem *u, struct rbtree_elem *v)
+{
+  if (u->parent == NULL)
+    t->root = v;
+  else if (u == u->parent->left)
+    u->parent->left = v;
+  else
+    u->parent->right = v;
+  if (v != NULL)
+    v->parent = u->parent;
+}
+
+/* Restores the red-black properties of T after inserting E. */
+static void
+insert_fixup (struct rbtree *t, struct rbtree_elem *e)
+{
+  struct rbtree_elem *parent;
+
+  while (is_red (parent = e->parent))
+    {
+      /* A red parent is not the root, so E has a grandparent. */
+      struct rbtree_elem *grandparent = parent->parent;
+
+      if (parent == grandparent->left)
+        {
+          struct rbtree_elem *uncle = grandparent->right;
+
+          if (is_red (uncle))
+            {
+              parent->red = uncle->red = false;
+              grandparent->red = true;
+              e = grandparent;
+            }
+          else
+            {
+              if (e == parent->right)
+                {
+                  e = parent;
+                  rotate_left (t, e);
+                  parent = e->parent;
+                }
+              parent->red = false;
+              grandparent->red = true;
+              rotate_right (t, grandparent);
+            }
+        }
+      else
+        {
+          struct rbtree_elem *uncle = grandparent->left;
+
+          if (is_red (uncle))
+            {
+              parent->red = uncle->red = false;
+              grandparent->red = true;
+              e = grandparent;
+            }
+          else
+            {
+              if (e == parent->left)
+                {
+                  e = parent;
+                  rotate_right (t, e);
+                  parent = e->parent;
+                }
+              parent->red = false;
+              grandparent->red = true;
+              rotate_left (t, grandparent);
+            }
+        }
+    }
+  t->root->red = false;
+}
+
+/* Restores the red-black properties of T after removing a black
+   element, whose place was taken by X, which may be null, under
+   PARENT. */
+static void
+remove_fixup (struct rbtree *t, struct rbtree_elem *x,
+              struct rbtree_elem *parent)
+{
+  while (x != t->root && !is_red (x))
+    {
+      if (x == parent->left)
+        {
+          struct rbtree_elem *sibling = parent->right;
+
+          if (is_red (sibling))
+            {
+              sibling->red = false;
+              parent->red = true;
+              rotate_left (t, parent);
+              sibling = parent->right;
+            }
+          if (!is_red (sibling->left) && !is_red (sibling->right))
+            {
+              sibling->red = true;
+              x = parent;
+              parent = x->parent;
+            }
+          else
+            {
+              if (!is_red (sibling->right))
+                {
+                  sibling->left->red = false;
+                  sibling->red = true;
+                  rotate_right (t, sibling);
+                  sibling = parent->right;
+                }
+              sibling->red = parent->red;
+              parent->red = false;
+              sibling->right->red = false;
+              rotate_left (t, parent);
+              x = t->root;
+            }
+        }
+      else
+        {
+          struct rbtree_elem *sibling = parent->left;
+
+          if (is_red (sibling))
+            {
+              sibling->red = false;
+              parent->red = true;
+              rotate_right (t, parent);
+              sibling = parent->left;
+            }
+          if (!is_red (sibling->left) && !is_red (sibling->right))
+            {
+              sibling->red = true;
+              x = parent;
+              parent = x->parent;
+            }
+          else
+            {
+              if (!is_red (sibling->left))
+                {
+                  sibling->right->red = false;
+                  sibling->red = true;
+                  rotate_left (t, sibling);
+                  sibling = parent->left;
+                }
+              sibling->red = parent->red;
+              parent->red = false;
+              sibling->left->red = false;
+              rotate_right (t, parent);
+              x = t->root;
+            }
+        }
+    }
+  if (x != NULL)
+    x->red = false;
+}
+
+/* Returns the least element in the subtree rooted at E. */
+static struct rbtree_elem *
+minimum (struct rbtree_elem *e)
+{
+  while (e->left != NULL)
+    e = e->left;
+  return e;
+}
+
+/* Returns the greatest element in the subtree rooted at E. */
+static struct rbtree_elem *
+maximum (struct rbtree_elem *e)
+{
+  while (e->right != NULL)
+    e = e->right;
+  return e;
+}
@@ -0,0 +1,72 @@
+#ifndef __LIB_KERNEL_RBTREE_H
+#define __LIB_KERNEL_RBTREE_H
+
+/* Balanced binary search tree.
+
+   This is a red-black tree.  Like the other kernel containers, it
+   does not allocate memory: each structure that can be in a tree
+   embeds a struct rbtree_elem, and the rbtree_entry macro
+   converts a struct rbtree_elem back to the structure that
+   contains it.  Refer to lib/kernel/list.h for a detailed
+   explanation of the technique.
+
+   Elements are kept in order of the tree's less-than function.
+   Elements that compare equal are kept in the order they were
+   inserted.  Insertion and removal take O(lg n) time; the least
+   element is cached, so finding it takes constant time.  The key
+   of an element must not change while it is in a tree: remove
+   it, change the key, and insert it again.  See [CLRS] chapter
+   13 "Red-Black Trees" for details. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Tree element. */
+struct rbtree_elem
+  {
+    struct rbtree_elem *parent; /* Parent, or null if root. */
+    struct rbtree_elem *left;   /* Left child, or null. */
+    struct rbtree_elem *right;  /* Right child, or null. */
+    bool red;                   /* Red or black? */
+  };
+
+/* Converts pointer to tree element RBTREE_ELEM into a pointer to
+   the structure that RBTREE_ELEM is embedded inside.  Supply the
+   name of the outer structure STRUCT and the member name MEMBER
+   of the tree element. */
+#define rbtree_entry(RBTREE_ELEM, STRUCT, MEMBER)               \
+        ((STRUCT *) ((uint8_t *) &(RBTREE_ELEM)->parent         \
+                     - offsetof (STRUCT, MEMBER.parent)))
+
+/* Compares the value of two tree elements A and B, given
+   auxiliary data AUX.  Returns true if A is less than B, or
+   false if A is greater than or equal to B. */
+typedef bool rbtree_less_func (const struct rbtree_elem *a,
+                               const struct rbtree_elem *b,
+                               void *aux);
+
+/* Red-black tree. */
+struct rbtree
+  {
+    struct rbtree_elem *root;   /* Root, or null if empty. */
+    struct rbtree_elem *first;  /* Least element, or null if empty. */
+    size_t size;                /* Number of elements. */
+    rbtree_less_func *less;     /* Comparison function. */
+    void *aux;                  /* Auxiliary data for `less'. */
+  };
+
+void rbtree_init (struct rbtree *, rbtree_less_func *, void *aux);
+
+void rbtree_insert (struct rbtree *, struct rbtree_elem *);
+void rbtree_remove (struct rbtree *, struct rbtree_elem *);
+
+struct rbtree_elem *rbtree_first (const struct rbtree *);
+struct rbtree_elem *rbtree_last (const struct rbtree *);
+struct rbtree_elem *rbtree_next (const struct rbtree_elem *);
+struct rbtree_elem *rbtree_prev (const struct rbtree_elem *);
+
+size_t rbtree_size (const struct rbtree *);
+bool rbtree_empty (const struct rbtree *);
+
+#endif /* lib/kernel/rbtree.h */
@@ -0,0 +1,36 @@
+#ifndef __LIB_SCHEDSTAT_H
+#define __LIB_SCHEDSTAT_H
+
+#include <stdint.h>
+
+/* Scheduler latency statistics, kept by the kernel (see
+   threads/thread.c) and copied out to user programs by the
+   schedstat system call.
+
+   Each histogram is indexed by the base-2 logarithm of a time in
+   nanoseconds: bucket I counts times of at least 2**I ns but
+   less than 2**(I+1) ns.  Bucket 0 also counts times under 1 ns
+   and the last bucket counts everything too long for the
+   others. */
+
+/* Number of buckets per histogram.  The last one starts at
+   2**31 ns, a little over 2 seconds. */
+#define SCHEDSTAT_BUCKETS 32
+
+/* Number of priority bands.  Band B holds priorities
+   B * 16 through B * 16 + 15. */
+#define SCHEDSTAT_BANDS 4
+
+struct schedstat
+  {
+    /* Time from becoming ready, in thread_unblock() or
+       thread_yield(), until being given a CPU, by the priority
+       band of the thread when it was given the CPU. */
+    uint32_t dispatch[SCHEDSTAT_BANDS][SCHEDSTAT_BUCKETS];
+
+    /* Length of the stretches during which a thread ran above
+       its base priority because of priority donation. */
+    uint32_t donation[SCHEDSTAT_BUCKETS];
+  };
+
+#endif /* lib/schedstat.h */
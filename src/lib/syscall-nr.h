@@ -28,7 +28,11 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+
+    /* Extensions. */
+    SYS_CLOCK_NS,               /* Nanoseconds since boot. */
+    SYS_SCHEDSTAT               /* Reads scheduler latency statistics. */
   };
 
 #endif /* lib/syscall-nr.h */
@@ -14,6 +14,20 @@
           retval;                                               \
         })
 
+/* Invokes syscall NUMBER, passing no arguments, and returns the
+   return value, which the kernel passes in EDX:EAX, as an
+   `int64_t'. */
+#define syscall0_64(NUMBER)                                     \
+        ({                                                      \
+          int64_t retval;                                       \
+          asm volatile                                          \
+            ("pushl %[number]; int $0x30; addl $4, %%esp"       \
+               : "=A" (retval)                                  \
+               : [number] "i" (NUMBER)                          \
+               : "memory");                                     \
+          retval;                                               \
+        })
+
 /* Invokes syscall NUMBER, passing argument ARG0, and returns the
    return value as an `int'. */
 #define syscall1(NUMBER, ARG0)                                           \
@@ -182,3 +196,15 @@ inumber (int fd)
 {
   return syscall1 (SYS_INUMBER, fd);
 }
+
+int64_t
+clock_ns (void)
+{
+  return syscall0_64 (SYS_CLOCK_NS);
+}
+
+void
+schedstat (struct schedstat *stats)
+{
+  syscall1 (SYS_SCHEDSTAT, stats);
+}
@@ -2,6 +2,7 @@
 #define __LIB_USER_SYSCALL_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <debug.h>
 
 /* Process identifier. */
@@ -12,6 +13,8 @@ typedef int pid_t;
 typedef int mapid_t;
 #define MAP_FAILED ((mapid_t) -1)
 
+struct schedstat;
+
 /* Maximum characters in a filename written by readdir(). */
 #define READDIR_MAX_LEN 14
 
@@ -45,4 +48,8 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 
+/* Extensions. */
+int64_t clock_ns (void);
+void schedstat (struct schedstat *);
+
 #endif /* lib/user/syscall.h */
@@ -0,0 +1,155 @@
+/* Test program and benchmark for lib/kernel/bitmap.c.
+
+   Checks bitmap_scan(), bitmap_scan_next(), bitmap_count() and
+   bitmap_contains() against simple bit-by-bit versions on random
+   bitmaps, then measures how many scans complete per timer tick
+   on a mostly full bitmap, searching from the start each time and
+   next fit.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <bitmap.h>
+#include <debug.h>
+#include <random.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/test.h"
+
+/* Number of bits in the benchmark's bitmap, about the number of
+   pages in a user pool with 8 MB of RAM. */
+#define BIT_CNT 1024
+
+/* Number of timer ticks to run each benchmark for. */
+#define TEST_TICKS 100
+
+static void check (size_t bit_cnt, int density);
+static size_t slow_scan (const struct bitmap *, size_t start, size_t cnt,
+                         bool value);
+static void benchmark (size_t cnt, bool next_fit);
+
+/* Test and benchmark the bitmap implementation. */
+void
+test (void)
+{
+  size_t bit_cnt;
+  int density;
+
+  printf ("testing bitmap sizes:");
+  for (bit_cnt = 0; bit_cnt < 200; bit_cnt += 13)
+    {
+      printf (" %zu", bit_cnt);
+      for (density = 0; density <= 100; density += 10)
+        check (bit_cnt, density);
+    }
+  printf (" done\n");
+
+  benchmark (1, false);
+  benchmark (1, true);
+  benchmark (8, false);
+  benchmark (8, true);
+}
+
+/* Checks the searching and counting functions on a bitmap of
+   BIT_CNT bits, each set to true with DENSITY percent chance. */
+static void
+check (size_t bit_cnt, int density)
+{
+  struct bitmap *b = bitmap_create (bit_cnt);
+  size_t i, start, cnt;
+
+  ASSERT (b != NULL);
+  for (i = 0; i < bit_cnt; i++)
+    bitmap_set (b, i, random_ulong () % 100 < (unsigned) density);
+
+  for (start = 0; start <= bit_cnt; start++)
+    for (cnt = 0; cnt <= 10; cnt++)
+      {
+        bool value = (start + cnt) % 2;
+        size_t expected = slow_scan (b, start, cnt, value);
+
+        ASSERT (bitmap_scan (b, start, cnt, value) == expected);
+
+        /* bitmap_scan_next() wraps around to the start. */
+        if (start == bit_cnt)
+          expected = slow_scan (b, 0, cnt, value);
+        if (expected == BITMAP_ERROR)
+          expected = slow_scan (b, 0, cnt, value);
+        ASSERT (bitmap_scan_next (b, start, cnt, value) == expected);
+
+        if (start + cnt <= bit_cnt)
+          {
+            size_t value_cnt = 0;
+
+            for (i = start; i < start + cnt; i++)
+              if (bitmap_test (b, i) == value)
+                value_cnt++;
+            ASSERT (bitmap_count (b, start, cnt, value) == value_cnt);
+            ASSERT (bitmap_contains (b, start, cnt, value)
+                    == (value_cnt > 0));
+          }
+      }
+
+  bitmap_destroy (b);
+}
+
+/* Returns the first group of CNT bits in B at or after START that
+   are all set to VALUE, testing one bit at a time. */
+static size_t
+slow_scan (const struct bitmap *b, size_t start, size_t cnt, bool value)
+{
+  size_t i, j;
+
+  for (i = start; i + cnt <= bitmap_size (b); i++)
+    {
+      for (j = 0; j < cnt; j++)
+        if (bitmap_test (b, i + j) != value)
+          break;
+      if (j == cnt)
+        return i;
+    }
+  return BITMAP_ERROR;
+}
+
+/* Repeatedly allocates and frees groups of CNT bits in a bitmap
+   that is 90% full, with the free bits toward the end, for
+   TEST_TICKS timer ticks and prints the rate.  If NEXT_FIT is
+   true, each search starts where the last one left off. */
+static void
+benchmark (size_t cnt, bool next_fit)
+{
+  struct bitmap *b = bitmap_create (BIT_CNT);
+  unsigned long long scan_cnt = 0;
+  size_t hint = 0;
+  int64_t start, elapsed;
+
+  ASSERT (b != NULL);
+  bitmap_set_multiple (b, 0, BIT_CNT * 9 / 10, true);
+
+  /* Start on a tick boundary. */
+  start = timer_ticks ();
+  while (timer_ticks () == start)
+    continue;
+  start = timer_ticks ();
+
+  do
+    {
+      size_t idx;
+
+      if (next_fit)
+        idx = bitmap_scan_and_flip_next (b, &hint, cnt, false);
+      else
+        idx = bitmap_scan_and_flip (b, 0, cnt, false);
+      ASSERT (idx != BITMAP_ERROR);
+      bitmap_set_multiple (b, idx, cnt, false);
+      scan_cnt++;
+      elapsed = timer_elapsed (start);
+    }
+  while (elapsed < TEST_TICKS);
+
+  printf ("bitmap: %zu-bit groups, %s: %llu scans per tick\n",
+          cnt, next_fit ? "next fit" : "first fit", scan_cnt / elapsed);
+  bitmap_destroy (b);
+}
@@ -0,0 +1,78 @@
+/* Benchmark for threads/malloc.c.
+
+   Measures how many malloc() and free() pairs complete per timer
+   tick for a few request sizes, allocating and then freeing a
+   batch of blocks at a time, and checks that each block is
+   writable and does not overlap the others.  Run it before and
+   after a change to the allocator to compare.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/malloc.h"
+#include "threads/test.h"
+
+/* Number of blocks allocated before any is freed. */
+#define BATCH_CNT 32
+
+/* Number of timer ticks to run each size for. */
+#define TEST_TICKS 100
+
+static void benchmark (size_t size);
+
+/* Benchmark malloc() and free(). */
+void
+test (void)
+{
+  static const size_t sizes[] = {16, 40, 100, 200, 520, 1100};
+  size_t i;
+
+  for (i = 0; i < sizeof sizes / sizeof *sizes; i++)
+    benchmark (sizes[i]);
+}
+
+/* Allocates and frees batches of SIZE-byte blocks for TEST_TICKS
+   timer ticks and prints the rate. */
+static void
+benchmark (size_t size)
+{
+  uint8_t *blocks[BATCH_CNT];
+  unsigned long long alloc_cnt = 0;
+  int64_t start, elapsed;
+
+  /* Start on a tick boundary. */
+  start = timer_ticks ();
+  while (timer_ticks () == start)
+    continue;
+  start = timer_ticks ();
+
+  do
+    {
+      size_t i;
+
+      for (i = 0; i < BATCH_CNT; i++)
+        {
+          blocks[i] = malloc (size);
+          ASSERT (blocks[i] != NULL);
+          memset (blocks[i], i, size);
+        }
+      for (i = 0; i < BATCH_CNT; i++)
+        {
+          ASSERT (blocks[i][0] == i && blocks[i][size - 1] == i);
+          free (blocks[i]);
+        }
+      alloc_cnt += BATCH_CNT;
+      elapsed = timer_elapsed (start);
+    }
+  while (elapsed < TEST_TICKS);
+
+  printf ("malloc: %4zu bytes: %llu allocations per tick\n",
+          size, alloc_cnt / elapsed);
+}
@@ -0,0 +1,8 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::threads::mlfqs;
+use tests::threads::cfs;
+
+check_cfs_fair ([0...9], 25);
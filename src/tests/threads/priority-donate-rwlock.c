@@ -0,0 +1,67 @@
+/* The main thread acquires a readers-writer lock shared.  Then
+   it creates a higher-priority writer, which blocks, and a reader
+   of higher priority still, which must block behind the waiting
+   writer.  Both donate their priorities to the main thread.
+
+   When the main thread releases the lock, the writer must get it
+   first, despite its lower priority, and run with the waiting
+   reader's priority donated to it.  The reader follows. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+static thread_func writer_thread_func;
+static thread_func reader_thread_func;
+
+void
+test_priority_donate_rwlock (void)
+{
+  struct rwlock rwlock;
+  struct rwlock_hold hold;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  /* Make sure our priority is the default. */
+  ASSERT (thread_get_priority () == PRI_DEFAULT);
+
+  rwlock_init (&rwlock);
+  rwlock_acquire_read (&rwlock, &hold);
+  thread_create ("writer", PRI_DEFAULT + 5, writer_thread_func, &rwlock);
+  msg ("This thread should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT + 5, thread_get_priority ());
+  thread_create ("reader", PRI_DEFAULT + 10, reader_thread_func, &rwlock);
+  msg ("This thread should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT + 10, thread_get_priority ());
+  rwlock_release_read (&rwlock, &hold);
+  msg ("writer, reader must already have finished.");
+  msg ("This thread should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT, thread_get_priority ());
+}
+
+static void
+writer_thread_func (void *rwlock_)
+{
+  struct rwlock *rwlock = rwlock_;
+  struct rwlock_hold hold;
+
+  rwlock_acquire_write (rwlock, &hold);
+  msg ("writer: got the lock with priority %d", thread_get_priority ());
+  rwlock_release_write (rwlock, &hold);
+  msg ("writer: done with priority %d", thread_get_priority ());
+}
+
+static void
+reader_thread_func (void *rwlock_)
+{
+  struct rwlock *rwlock = rwlock_;
+  struct rwlock_hold hold;
+
+  rwlock_acquire_read (rwlock, &hold);
+  msg ("reader: got the lock");
+  rwlock_release_read (rwlock, &hold);
+  msg ("reader: done");
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(priority-donate-rwlock) begin
+(priority-donate-rwlock) This thread should have priority 36.  Actual priority: 36.
+(priority-donate-rwlock) This thread should have priority 41.  Actual priority: 41.
+(priority-donate-rwlock) writer: got the lock with priority 41
+(priority-donate-rwlock) reader: got the lock
+(priority-donate-rwlock) reader: done
+(priority-donate-rwlock) writer: done with priority 36
+(priority-donate-rwlock) writer, reader must already have finished.
+(priority-donate-rwlock) This thread should have priority 31.  Actual priority: 31.
+(priority-donate-rwlock) end
+EOF
+pass;
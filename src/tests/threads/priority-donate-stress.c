@@ -0,0 +1,163 @@
+/* Stresses nested priority donation with a deep chain of locks
+   and a crowd of waiters at the end of it.
+
+   Thread 0, at priority PRI_DEFAULT + 1, acquires lock 0 and
+   then waits on a semaphore.  Threads 1 through 7, one priority
+   level apart above it, each acquire their own lock and then wait
+   for the lock of the thread before them, so that every donation
+   to thread 7 has to travel down 8 locks to reach thread 0.
+
+   The main thread then creates WAITER_CNT threads that all wait
+   for lock 7, cycling through the priorities above thread 7, and
+   checks that thread 0 ends up with the highest of them.
+
+   Finally the main thread lets thread 0 go.  The chain unwinds,
+   and the waiters must get lock 7 in order of decreasing
+   priority, and in the order they started waiting among threads
+   of equal priority.  Every thread must be back to its own
+   priority once it has released its locks. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define NESTING_DEPTH 8
+#define WAITER_CNT 200
+
+/* Lowest priority of a waiter. */
+#define WAITER_PRI_MIN (PRI_DEFAULT + 1 + NESTING_DEPTH)
+
+struct chain_link
+  {
+    int id;                     /* Position in the chain. */
+    struct lock *mine;          /* Lock held while waiting. */
+    struct lock *next;          /* Lock waited for, or null. */
+  };
+
+struct waiter
+  {
+    int id;                     /* Creation order. */
+    int priority;               /* Priority created with. */
+  };
+
+static struct lock locks[NESTING_DEPTH];
+static struct chain_link links[NESTING_DEPTH];
+static struct waiter waiters[WAITER_CNT];
+static struct semaphore go;
+
+/* Waiters in the order they got lock 7. */
+static struct waiter *order[WAITER_CNT];
+static int order_cnt;
+
+/* Thread 0, at the bottom of the chain. */
+static struct thread *bottom;
+
+static thread_func chain_thread;
+static thread_func waiter_thread;
+
+void
+test_priority_donate_stress (void)
+{
+  bool in_order;
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  for (i = 0; i < NESTING_DEPTH; i++)
+    lock_init (&locks[i]);
+  sema_init (&go, 0);
+
+  for (i = 0; i < NESTING_DEPTH; i++)
+    {
+      char name[16];
+
+      snprintf (name, sizeof name, "chain %d", i);
+      links[i].id = i;
+      links[i].mine = &locks[i];
+      links[i].next = i > 0 ? &locks[i - 1] : NULL;
+      thread_create (name, PRI_DEFAULT + 1 + i, chain_thread, &links[i]);
+      msg ("thread 0 should have priority %d.  Actual priority: %d.",
+           PRI_DEFAULT + 1 + i, bottom->priority);
+    }
+
+  for (i = 0; i < WAITER_CNT; i++)
+    {
+      char name[16];
+
+      snprintf (name, sizeof name, "waiter %d", i);
+      waiters[i].id = i;
+      waiters[i].priority = (WAITER_PRI_MIN
+                             + i % (PRI_MAX - WAITER_PRI_MIN + 1));
+      thread_create (name, waiters[i].priority, waiter_thread, &waiters[i]);
+    }
+  msg ("%d threads waiting for lock %d.", WAITER_CNT, NESTING_DEPTH - 1);
+  msg ("thread 0 should have priority %d.  Actual priority: %d.",
+       PRI_MAX, bottom->priority);
+
+  /* Everything else runs to completion before we get to run
+     again. */
+  sema_up (&go);
+
+  in_order = order_cnt == WAITER_CNT;
+  for (i = 1; in_order && i < order_cnt; i++)
+    {
+      struct waiter *a = order[i - 1];
+      struct waiter *b = order[i];
+
+      if (a->priority < b->priority
+          || (a->priority == b->priority && a->id > b->id))
+        {
+          msg ("waiter %d (priority %d) got the lock "
+               "before waiter %d (priority %d).",
+               a->id, a->priority, b->id, b->priority);
+          in_order = false;
+        }
+    }
+  if (in_order)
+    msg ("%d waiters got the lock in priority order.", order_cnt);
+  else
+    fail ("%d of %d waiters got the lock, not in priority order.",
+          order_cnt, WAITER_CNT);
+}
+
+/* Holds one lock of the chain while waiting for the next one
+   down, or, at the bottom, for the main thread's go. */
+static void
+chain_thread (void *link_)
+{
+  struct chain_link *link = link_;
+  int base = thread_get_priority ();
+
+  if (link->id == 0)
+    bottom = thread_current ();
+
+  lock_acquire (link->mine);
+  if (link->next != NULL)
+    {
+      lock_acquire (link->next);
+      lock_release (link->next);
+    }
+  else
+    sema_down (&go);
+  lock_release (link->mine);
+
+  if (thread_get_priority () != base)
+    fail ("thread %d finished with priority %d instead of %d.",
+          link->id, thread_get_priority (), base);
+  msg ("thread %d finished with priority %d.", link->id, base);
+}
+
+/* Waits for the last lock of the chain and records when it got
+   it. */
+static void
+waiter_thread (void *waiter_)
+{
+  struct waiter *w = waiter_;
+
+  lock_acquire (&locks[NESTING_DEPTH - 1]);
+  order[order_cnt++] = w;
+  lock_release (&locks[NESTING_DEPTH - 1]);
+}
@@ -0,0 +1,28 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(priority-donate-stress) begin
+(priority-donate-stress) thread 0 should have priority 32.  Actual priority: 32.
+(priority-donate-stress) thread 0 should have priority 33.  Actual priority: 33.
+(priority-donate-stress) thread 0 should have priority 34.  Actual priority: 34.
+(priority-donate-stress) thread 0 should have priority 35.  Actual priority: 35.
+(priority-donate-stress) thread 0 should have priority 36.  Actual priority: 36.
+(priority-donate-stress) thread 0 should have priority 37.  Actual priority: 37.
+(priority-donate-stress) thread 0 should have priority 38.  Actual priority: 38.
+(priority-donate-stress) thread 0 should have priority 39.  Actual priority: 39.
+(priority-donate-stress) 200 threads waiting for lock 7.
+(priority-donate-stress) thread 0 should have priority 63.  Actual priority: 63.
+(priority-donate-stress) thread 7 finished with priority 39.
+(priority-donate-stress) thread 6 finished with priority 38.
+(priority-donate-stress) thread 5 finished with priority 37.
+(priority-donate-stress) thread 4 finished with priority 36.
+(priority-donate-stress) thread 3 finished with priority 35.
+(priority-donate-stress) thread 2 finished with priority 34.
+(priority-donate-stress) thread 1 finished with priority 33.
+(priority-donate-stress) thread 0 finished with priority 32.
+(priority-donate-stress) 200 waiters got the lock in priority order.
+(priority-donate-stress) end
+EOF
+pass;
@@ -25,6 +25,8 @@ static const struct test tests[] =
     {"priority-donate-sema", test_priority_donate_sema},
     {"priority-donate-lower", test_priority_donate_lower},
     {"priority-donate-chain", test_priority_donate_chain},
+    {"priority-donate-stress", test_priority_donate_stress},
+    {"priority-donate-rwlock", test_priority_donate_rwlock},
     {"priority-fifo", test_priority_fifo},
     {"priority-preempt", test_priority_preempt},
     {"priority-sema", test_priority_sema},
@@ -38,6 +40,11 @@ static const struct test tests[] =
     {"mlfqs-nice-2", test_mlfqs_nice_2},
     {"mlfqs-nice-10", test_mlfqs_nice_10},
     {"mlfqs-block", test_mlfqs_block},
+    {"cfs-fair-2", test_cfs_fair_2},
+    {"cfs-fair-20", test_cfs_fair_20},
+    {"cfs-nice-2", test_cfs_nice_2},
+    {"cfs-nice-10", test_cfs_nice_10},
+    {"thread-create-bench", test_thread_create_bench},
   };
 
 static const char *test_name;
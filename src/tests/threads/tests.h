@@ -19,6 +19,8 @@ extern test_func test_priority_donate_sema;
 extern test_func test_priority_donate_nest;
 extern test_func test_priority_donate_lower;
 extern test_func test_priority_donate_chain;
+extern test_func test_priority_donate_stress;
+extern test_func test_priority_donate_rwlock;
 extern test_func test_priority_fifo;
 extern test_func test_priority_preempt;
 extern test_func test_priority_sema;
@@ -32,6 +34,11 @@ extern test_func test_mlfqs_fair_20;
 extern test_func test_mlfqs_nice_2;
 extern test_func test_mlfqs_nice_10;
 extern test_func test_mlfqs_block;
+extern test_func test_cfs_fair_2;
+extern test_func test_cfs_fair_20;
+extern test_func test_cfs_nice_2;
+extern test_func test_cfs_nice_10;
+extern test_func test_thread_create_bench;
 
 void msg (const char *, ...);
 void fail (const char *, ...);
@@ -0,0 +1,60 @@
+/* Measures how fast threads can be created and run to
+   completion, one after another, as a thread that forks short
+   workers would.  Each thread is created only after the previous
+   one has died, so every creation after the first can reuse the
+   previous thread's page from the thread page cache.
+
+   This is a benchmark: it passes as long as all the threads run
+   and at least half of them get a cached page, and reports the
+   time taken. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+/* Nothing waits for these threads, so each one leaves behind its
+   process control block, a small object from pcb_cache. */
+#define THREAD_CNT 1024
+
+static thread_func worker_thread;
+
+void
+test_thread_create_bench (void)
+{
+  struct semaphore done;
+  int64_t start, elapsed;
+  long long hits;
+  int i;
+
+  sema_init (&done, 0);
+
+  hits = thread_cache_hit_cnt ();
+  start = timer_ns ();
+  for (i = 0; i < THREAD_CNT; i++)
+    {
+      if (thread_create ("worker", PRI_DEFAULT, worker_thread, &done)
+          == TID_ERROR)
+        fail ("thread_create() failed after %d threads", i);
+      sema_down (&done);
+
+      /* Let the worker finish dying. */
+      thread_yield ();
+    }
+  elapsed = timer_ns () - start;
+  hits = thread_cache_hit_cnt () - hits;
+
+  msg ("%d threads created and run.", THREAD_CNT);
+  if (hits < THREAD_CNT / 2)
+    fail ("only %lld of %d threads got a cached page", hits, THREAD_CNT);
+  msg ("Average create+exit time: %lld ns.", elapsed / THREAD_CNT);
+}
+
+static void
+worker_thread (void *done_)
+{
+  struct semaphore *done = done_;
+
+  sema_up (done);
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+@output = get_core_output ("run", @output);
+
+fail "missing \"threads created\" message\n"
+  if !grep ($_ eq '(thread-create-bench) 1024 threads created and run.',
+	    @output);
+fail "missing timing result\n"
+  if !grep (/^\(thread-create-bench\) Average create\+exit time: \d+ ns\.$/,
+	    @output);
+pass;
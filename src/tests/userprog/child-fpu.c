@@ -0,0 +1,24 @@
+/* Child process run by fpu-switch test.
+   Verifies that it starts out with a clear SSE register, not
+   its parent's, then overwrites the register and terminates. */
+
+#include <stdint.h>
+#include "tests/lib.h"
+
+int
+main (void)
+{
+  static const uint32_t pattern[4] =
+    {0xdeadbeef, 0xdeadbeef, 0xdeadbeef, 0xdeadbeef};
+  uint32_t xmm0[4];
+
+  test_name = "child-fpu";
+
+  asm volatile ("movups %%xmm0, %0" : "=m" (xmm0));
+  if (xmm0[0] | xmm0[1] | xmm0[2] | xmm0[3])
+    fail ("xmm0 not clear at start");
+  asm volatile ("movups %0, %%xmm0" : : "m" (pattern));
+
+  msg ("run");
+  return 81;
+}
@@ -0,0 +1,27 @@
+/* Reads the nanosecond clock many times in a row and verifies
+   that it never goes backward and that it advances. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define READ_CNT 10000
+
+void
+test_main (void)
+{
+  int64_t first, prev;
+  int i;
+
+  first = prev = clock_ns ();
+  for (i = 0; i < READ_CNT; i++)
+    {
+      int64_t now = clock_ns ();
+      if (now < prev)
+        fail ("clock went back from %lld ns to %lld ns", prev, now);
+      prev = now;
+    }
+  if (prev == first)
+    fail ("clock did not advance over %d reads", READ_CNT);
+  msg ("clock advanced");
+}
@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(clock-ns) begin
+(clock-ns) clock advanced
+(clock-ns) end
+clock-ns: exit(0)
+EOF
+pass;
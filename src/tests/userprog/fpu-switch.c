@@ -0,0 +1,26 @@
+/* Loads a pattern into an SSE register, then runs a child
+   process that uses the same register, and verifies that the
+   pattern survives the switches to the child and back. */
+
+#include <stdint.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  static const uint32_t pattern[4] =
+    {0x01234567, 0x89abcdef, 0xfedcba98, 0x76543210};
+  uint32_t xmm0[4];
+
+  asm volatile ("movups %0, %%xmm0" : : "m" (pattern));
+  msg ("wait(exec()) = %d", wait (exec ("child-fpu")));
+  asm volatile ("movups %%xmm0, %0" : "=m" (xmm0));
+
+  if (memcmp (xmm0, pattern, sizeof pattern))
+    fail ("xmm0 changed: %08x %08x %08x %08x",
+          xmm0[0], xmm0[1], xmm0[2], xmm0[3]);
+  msg ("xmm0 preserved");
+}
@@ -0,0 +1,24 @@
+/* Reads the scheduler latency statistics and verifies that at
+   least one dispatch, that of this process's own thread, was
+   recorded. */
+
+#include <schedstat.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  struct schedstat stats;
+  uint32_t dispatches = 0;
+  int band, bucket;
+
+  schedstat (&stats);
+  for (band = 0; band < SCHEDSTAT_BANDS; band++)
+    for (bucket = 0; bucket < SCHEDSTAT_BUCKETS; bucket++)
+      dispatches += stats.dispatch[band][bucket];
+  if (dispatches == 0)
+    fail ("no dispatches recorded");
+  msg ("dispatches recorded");
+}
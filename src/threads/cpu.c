@@ -0,0 +1,525 @@
+#include "threads/cpu.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/lapic.h"
+#include "devices/timer.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/loader.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#ifdef USERPROG
+#include "userprog/fpu.h"
+#include "userprog/gdt.h"
+#endif
+
+/* Symmetric multiprocessing.
+
+   Application processors wake up in real mode, at the start of a
+   page below 1 MB given by the bootstrap processor.  The page is
+   a copy of ap_trampoline (start.S), which switches to protected
+   mode with paging on, using the kernel page directory, and then
+   calls cpu_ap_main() on a fresh page that becomes the AP's idle
+   thread.
+
+   Device interrupts keep going to the bootstrap processor; the
+   others only take their local APIC timer, the reschedule IPIs
+   of cpu_kick(), and the TLB shootdown IPIs of cpu_flush_tlb().
+
+   The CPUs present are those listed by the firmware, in the
+   ACPI "APIC" table (MADT) or, failing that, in the Intel
+   MultiProcessor Specification configuration table.  Their local
+   APIC IDs need not be contiguous. */
+
+/* Physical address of the AP start-up page. */
+#define AP_TRAMPOLINE 0x1000
+
+/* How long to wait for an AP to come up, in milliseconds. */
+#define AP_START_TIMEOUT 100
+
+struct cpu cpus[CPU_MAX];
+int cpu_cnt = 1;
+
+/* Set once the first AP is being started.  Until then, only
+   cpus[0] exists and cpu_current() need not look at the running
+   thread, which may not be initialized yet. */
+static bool smp_started;
+
+/* The AP being started and the top of its stack.  Read by
+   start.S and cpu_ap_main(). */
+struct cpu *ap_cpu;
+void *ap_stack;
+
+/* Local APIC IDs of the enabled CPUs listed by the firmware,
+   including the bootstrap processor, as found by cpu_init(). */
+static uint8_t fw_apic_ids[256];
+static int fw_cpu_cnt;
+
+/* TLB shootdown in progress, if any.  tlb_lock serializes
+   cpu_flush_tlb() callers; tlb_pd is the page directory whose
+   translations must go, and tlb_pending counts the CPUs that
+   have yet to flush them. */
+static struct spinlock tlb_lock;
+static uint32_t *volatile tlb_pd;
+static volatile int tlb_pending;
+
+/* Start-up code in start.S, copied to AP_TRAMPOLINE. */
+extern char ap_trampoline[], ap_trampoline_cr3[], ap_trampoline_end[];
+
+void cpu_ap_main (void) NO_RETURN;
+static bool start_ap (struct cpu *, uint8_t apic_id);
+static bool find_cpus_acpi (void);
+static bool find_cpus_mp (void);
+static intr_handler_func reschedule_interrupt;
+static intr_handler_func tlb_interrupt;
+
+/* Returns the CPU that is running the caller.  The answer may be
+   stale by the time it is used unless interrupts are off. */
+struct cpu *
+cpu_current (void)
+{
+  uint32_t *esp;
+
+  if (!smp_started)
+    return &cpus[0];
+
+  /* The running thread's `cpu' is kept up to date by the
+     scheduler.  See thread.c:running_thread(). */
+  asm ("mov %%esp, %0" : "=g" (esp));
+  return ((struct thread *) pg_round_down (esp))->cpu;
+}
+
+/* Finds the CPUs listed by the firmware.  Called by
+   init.c:main() before palloc_init(), which would otherwise be
+   free to hand out the memory that the ACPI tables are in. */
+void
+cpu_init (void)
+{
+  if (!find_cpus_acpi ())
+    find_cpus_mp ();
+}
+
+/* Starts application processors until CNT CPUs are running, or
+   as many as the firmware lists and respond if fewer.  Called once, by init.c:main(),
+   after the timer is calibrated and with interrupts on. */
+void
+cpu_start_aps (int cnt)
+{
+  uint8_t *trampoline = ptov (AP_TRAMPOLINE);
+  int i;
+
+  ASSERT (intr_get_level () == INTR_ON);
+  ASSERT (cpu_cnt == 1);
+
+  if (cnt > CPU_MAX)
+    {
+      printf ("smp: only %d CPUs supported\n", CPU_MAX);
+      cnt = CPU_MAX;
+    }
+  if (cnt <= 1)
+    return;
+  if (fw_cpu_cnt == 0)
+    {
+      printf ("smp: no ACPI or MP tables, using 1 CPU\n");
+      return;
+    }
+  if (!lapic_init ())
+    {
+      printf ("smp: no local APIC, using 1 CPU\n");
+      return;
+    }
+  cpus[0].apic_id = lapic_id ();
+
+  /* The PIT tick keeps time for every CPU, so it cannot stop just
+     because the bootstrap processor is idle. */
+  if (timer_tickless)
+    {
+      printf ("smp: tickless idle disabled\n");
+      timer_tickless = false;
+    }
+
+  lapic_timer_calibrate ();
+  timer_init_smp ();
+  intr_register_ext (LAPIC_VEC_RESCHED, reschedule_interrupt,
+                     "Reschedule IPI");
+  spinlock_init (&tlb_lock);
+  intr_register_ext (LAPIC_VEC_TLB, tlb_interrupt, "TLB shootdown IPI");
+
+  /* Install the start-up code, pointing it at the kernel page
+     directory.  It runs at its physical address right after
+     turning paging on, so identity-map the first 4 MB while the
+     APs start. */
+  memcpy (trampoline, ap_trampoline, ap_trampoline_end - ap_trampoline);
+  *(uint32_t *) (trampoline + (ap_trampoline_cr3 - ap_trampoline))
+    = vtop (init_page_dir);
+  init_page_dir[0] = init_page_dir[pd_no (PHYS_BASE)];
+
+  smp_started = true;
+
+  for (i = 0; i < fw_cpu_cnt && cpu_cnt < cnt; i++)
+    if (fw_apic_ids[i] != cpus[0].apic_id
+        && !start_ap (&cpus[cpu_cnt], fw_apic_ids[i]))
+      printf ("smp: CPU with APIC ID %d did not start\n", fw_apic_ids[i]);
+
+  init_page_dir[0] = 0;
+  asm volatile ("movl %0, %%cr3" : : "r" (vtop (init_page_dir)) : "memory");
+
+  printf ("smp: %d CPUs running\n", cpu_cnt);
+}
+
+/* Starts the AP with local APIC ID APIC_ID as CPU C and waits
+   for it to enter its idle loop.  Returns true if successful,
+   false if it did not come up in time. */
+static bool
+start_ap (struct cpu *c, uint8_t apic_id)
+{
+  uint8_t *stack;
+  int ms;
+
+  stack = palloc_get_page (PAL_ZERO);
+  if (stack == NULL)
+    return false;
+
+  c->id = c - cpus;
+  c->apic_id = apic_id;
+  ap_cpu = c;
+  ap_stack = stack + PGSIZE;
+  lapic_start_ap (apic_id, AP_TRAMPOLINE);
+
+  for (ms = 0; !c->started; ms++)
+    {
+      /* The AP may still come up after we give up, so its stack
+         page cannot be freed. */
+      if (ms >= AP_START_TIMEOUT)
+        return false;
+      timer_mdelay (1);
+    }
+
+  cpu_cnt++;
+  return true;
+}
+
+/* Returns the SIZE bytes at physical address PADDR, or a null
+   pointer if they are not all mapped into kernel memory. */
+static void *
+phys_to_kernel (uint32_t paddr, size_t size)
+{
+  uint32_t ram_size = init_ram_pages * PGSIZE;
+
+  if (paddr >= ram_size || size > ram_size - paddr)
+    return NULL;
+  return ptov (paddr);
+}
+
+/* Returns true if the SIZE bytes at P sum to zero, modulo 256,
+   which is how both ACPI and MP tables are checksummed. */
+static bool
+checksum_ok (const void *p, size_t size)
+{
+  const uint8_t *q = p;
+  uint8_t sum = 0;
+
+  while (size-- > 0)
+    sum += *q++;
+  return sum == 0;
+}
+
+/* Searches the SIZE bytes of physical memory at PADDR, which
+   must be mapped, for a structure of LENGTH bytes that starts on
+   a 16-byte boundary with signature SIG and has a good checksum.
+   Returns the structure if found, otherwise a null pointer. */
+static void *
+scan_phys (uint32_t paddr, size_t size, const char *sig, size_t length)
+{
+  uint8_t *p = ptov (paddr);
+  uint8_t *end = p + size;
+
+  for (; p + length <= end; p += 16)
+    if (!memcmp (p, sig, strlen (sig)) && checksum_ok (p, length))
+      return p;
+  return NULL;
+}
+
+/* Searches the places that the ACPI and MP specifications allow
+   their root structures to be, for one of LENGTH bytes with
+   signature SIG: the first kB of the extended BIOS data area (or
+   the last kB of base memory, if there is none) and the BIOS ROM
+   from PADDR up to 1 MB. */
+static void *
+scan_bios (const char *sig, size_t length, uint32_t rom_start)
+{
+  uint32_t ebda = *(uint16_t *) ptov (0x40e) << 4;
+  uint32_t base_kb = *(uint16_t *) ptov (0x413);
+  void *p = NULL;
+
+  if (ebda != 0)
+    p = scan_phys (ebda, 1024, sig, length);
+  else if (base_kb >= 1)
+    p = scan_phys ((base_kb - 1) * 1024, 1024, sig, length);
+  if (p == NULL)
+    p = scan_phys (rom_start, 0x100000 - rom_start, sig, length);
+  return p;
+}
+
+/* Adds APIC_ID to the CPUs listed by the firmware. */
+static void
+add_fw_cpu (uint8_t apic_id)
+{
+  if (fw_cpu_cnt < (int) (sizeof fw_apic_ids / sizeof *fw_apic_ids))
+    fw_apic_ids[fw_cpu_cnt++] = apic_id;
+}
+
+/* ACPI table header. */
+struct acpi_sdt
+  {
+    char signature[4];
+    uint32_t length;                    /* Including this header. */
+    uint8_t revision;
+    uint8_t checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+  }
+  __attribute__ ((packed));
+
+/* Returns the ACPI table at physical address PADDR, if it is
+   mapped and its checksum is good, otherwise a null pointer. */
+static struct acpi_sdt *
+acpi_table (uint32_t paddr)
+{
+  struct acpi_sdt *sdt = phys_to_kernel (paddr, sizeof *sdt);
+
+  if (sdt == NULL || sdt->length < sizeof *sdt
+      || phys_to_kernel (paddr, sdt->length) == NULL
+      || !checksum_ok (sdt, sdt->length))
+    return NULL;
+  return sdt;
+}
+
+/* Finds the CPUs listed in the ACPI multiple APIC description
+   table (MADT).  Returns true if successful, false if there is
+   no usable MADT. */
+static bool
+find_cpus_acpi (void)
+{
+  /* ACPI 1.0 root system description pointer. */
+  struct rsdp
+    {
+      char signature[8];                /* "RSD PTR ". */
+      uint8_t checksum;
+      char oem_id[6];
+      uint8_t revision;
+      uint32_t rsdt_paddr;
+    }
+  __attribute__ ((packed));
+  struct rsdp *rsdp;
+  struct acpi_sdt *rsdt, *madt = NULL;
+  uint32_t *entries;
+  uint8_t *p, *end;
+  size_t i;
+
+  rsdp = scan_bios ("RSD PTR ", sizeof *rsdp, 0xe0000);
+  if (rsdp == NULL)
+    return false;
+  rsdt = acpi_table (rsdp->rsdt_paddr);
+  if (rsdt == NULL || memcmp (rsdt->signature, "RSDT", 4))
+    return false;
+
+  entries = (uint32_t *) (rsdt + 1);
+  for (i = 0; i < (rsdt->length - sizeof *rsdt) / 4; i++)
+    {
+      struct acpi_sdt *sdt = acpi_table (entries[i]);
+      if (sdt != NULL && !memcmp (sdt->signature, "APIC", 4))
+        {
+          madt = sdt;
+          break;
+        }
+    }
+  if (madt == NULL)
+    return false;
+
+  /* The MADT header is followed by the local APIC address and
+     flags, then by variable-length entries.  A type 0 entry is a
+     processor's local APIC: ACPI processor ID, APIC ID, and flags
+     whose bit 0 says it is enabled. */
+  p = (uint8_t *) (madt + 1) + 8;
+  end = (uint8_t *) madt + madt->length;
+  fw_cpu_cnt = 0;
+  for (; p + 2 <= end && p[1] >= 2 && p + p[1] <= end; p += p[1])
+    if (p[0] == 0 && p[1] >= 8 && (*(uint32_t *) (p + 4) & 1))
+      add_fw_cpu (p[3]);
+  return fw_cpu_cnt > 0;
+}
+
+/* Finds the CPUs listed in the MultiProcessor Specification
+   configuration table.  Returns true if successful, false if
+   there is no usable table. */
+static bool
+find_cpus_mp (void)
+{
+  /* MP floating pointer structure. */
+  struct mp_fps
+    {
+      char signature[4];                /* "_MP_". */
+      uint32_t config_paddr;            /* Configuration table. */
+      uint8_t length;                   /* In 16-byte units. */
+      uint8_t spec_rev;
+      uint8_t checksum;
+      uint8_t features[5];              /* features[0] != 0 selects
+                                           a default configuration. */
+    }
+  __attribute__ ((packed));
+
+  /* MP configuration table header. */
+  struct mp_config
+    {
+      char signature[4];                /* "PCMP". */
+      uint16_t length;                  /* Header and base entries. */
+      uint8_t spec_rev;
+      uint8_t checksum;
+      char oem_id[8];
+      char product_id[12];
+      uint32_t oem_table_paddr;
+      uint16_t oem_table_size;
+      uint16_t entry_cnt;
+      uint32_t lapic_paddr;
+      uint16_t ext_length;
+      uint8_t ext_checksum;
+      uint8_t reserved;
+    }
+  __attribute__ ((packed));
+  struct mp_fps *fps;
+  struct mp_config *config;
+  uint8_t *p, *end;
+  int i;
+
+  fps = scan_bios ("_MP_", sizeof *fps, 0xf0000);
+  if (fps == NULL)
+    return false;
+
+  /* The default configurations all have two CPUs, with local
+     APIC IDs 0 and 1. */
+  fw_cpu_cnt = 0;
+  if (fps->features[0] != 0)
+    {
+      add_fw_cpu (0);
+      add_fw_cpu (1);
+      return true;
+    }
+
+  config = phys_to_kernel (fps->config_paddr, sizeof *config);
+  if (config == NULL || memcmp (config->signature, "PCMP", 4)
+      || phys_to_kernel (fps->config_paddr, config->length) == NULL
+      || !checksum_ok (config, config->length))
+    return false;
+
+  /* Processor entries (type 0) are 20 bytes long and give the
+     local APIC ID, then flags whose bit 0 says it is enabled.  The
+     other base entry types are 8 bytes long. */
+  p = (uint8_t *) (config + 1);
+  end = (uint8_t *) config + config->length;
+  for (i = 0; i < config->entry_cnt && p < end; i++)
+    if (p[0] == 0)
+      {
+        if (p + 20 > end)
+          break;
+        if (p[3] & 1)
+          add_fw_cpu (p[1]);
+        p += 20;
+      }
+    else
+      p += 8;
+  return fw_cpu_cnt > 0;
+}
+
+/* Main program of an application processor, called by start.S
+   with interrupts off on the stack allocated by start_ap(). */
+void
+cpu_ap_main (void)
+{
+  struct cpu *c = ap_cpu;
+
+#ifdef USERPROG
+  gdt_init_ap (c->id);
+  fpu_init_ap ();
+#endif
+  intr_init_ap ();
+  lapic_init_ap ();
+  lapic_timer_start ();
+  thread_start_ap (c);
+}
+
+/* Makes CPU C reschedule as soon as it can, for example because
+   a thread of higher priority than the running one joined its
+   run queue. */
+void
+cpu_kick (struct cpu *c)
+{
+  if (c != cpu_current ())
+    lapic_send_ipi (c->apic_id, LAPIC_VEC_RESCHED);
+}
+
+/* Reschedule IPI handler. */
+static void
+reschedule_interrupt (struct intr_frame *args UNUSED)
+{
+  intr_yield_on_return ();
+}
+
+/* Makes every other CPU drop its TLB entries for page directory
+   PD, and waits until they have.  Call after clearing or
+   changing a present page table entry in PD that another CPU
+   may have cached, before reusing the page it mapped.
+
+   Must be called with interrupts on, since the other CPUs may
+   themselves be waiting here for us to answer their IPI. */
+void
+cpu_flush_tlb (uint32_t *pd)
+{
+  enum intr_level old_level;
+  int i;
+
+  ASSERT (!intr_context ());
+  ASSERT (intr_get_level () == INTR_ON);
+
+  if (cpu_cnt == 1)
+    return;
+
+  for (;;)
+    {
+      old_level = intr_disable ();
+      if (spinlock_try_acquire (&tlb_lock))
+        break;
+      intr_set_level (old_level);
+      asm volatile ("pause");
+    }
+
+  tlb_pd = pd;
+  tlb_pending = cpu_cnt - 1;
+  for (i = 0; i < cpu_cnt; i++)
+    if (&cpus[i] != cpu_current ())
+      lapic_send_ipi (cpus[i].apic_id, LAPIC_VEC_TLB);
+  while (tlb_pending > 0)
+    asm volatile ("pause");
+
+  spinlock_release (&tlb_lock);
+  intr_set_level (old_level);
+}
+
+/* TLB shootdown IPI handler.  Reloading CR3 flushes every
+   non-global TLB entry. */
+static void
+tlb_interrupt (struct intr_frame *args UNUSED)
+{
+  uint32_t cr3;
+
+  asm volatile ("movl %%cr3, %0" : "=r" (cr3));
+  if (cr3 == vtop (tlb_pd))
+    asm volatile ("movl %0, %%cr3" : : "r" (cr3) : "memory");
+  asm volatile ("lock decl %0" : "+m" (tlb_pending) : : "memory");
+}
@@ -0,0 +1,104 @@
+#ifndef THREADS_CPU_H
+#define THREADS_CPU_H
+
+#include <list.h>
+#include <rbtree.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Maximum number of CPUs. */
+#define CPU_MAX 8
+
+/* Run queue of threads in THREAD_READY state, that is, threads
+   that are ready to run on a CPU but not actually running.
+
+   There is one FIFO list per priority level, and bit P of
+   `bitmap' is set exactly when queues[P] is non-empty, so
+   finding the highest-priority ready thread is a single
+   find-first-set instead of a walk over a sorted list.
+
+   Under the completely fair scheduler, ready threads are instead
+   kept in a red-black tree ordered by virtual runtime, and the
+   leftmost one runs next.
+
+   A run queue is protected by its `lock'.  Other CPUs read `cnt'
+   without it, as a hint for placing and stealing threads. */
+struct runqueue
+  {
+    struct spinlock lock;               /* Protects the members below,
+                                           and the owning CPU's
+                                           `current' and the status of
+                                           the threads queued here. */
+    struct list queues[PRI_MAX + 1];    /* One FIFO per priority. */
+    uint64_t bitmap;                    /* Non-empty queues. */
+    size_t cnt;                         /* # of threads queued. */
+
+    /* Completely fair scheduler (-cfs). */
+    struct rbtree cfs_tree;             /* Threads by vruntime. */
+    uint64_t min_vruntime;              /* Floor of vruntimes here,
+                                           never decreasing. */
+    unsigned cfs_load;                  /* Sum of queued threads'
+                                           weights. */
+  };
+
+/* A CPU.
+
+   cpus[0] is the bootstrap processor (BSP), the one that ran the
+   loader and init.c:main().  The others, if any, are application
+   processors (APs) started by cpu_start_aps().  Unless noted
+   otherwise, a CPU's members are only written by that CPU, with
+   interrupts turned off.  Other CPUs may read the statistics
+   without locking. */
+struct cpu
+  {
+    int id;                             /* Index in cpus[]. */
+    uint8_t apic_id;                    /* Local APIC ID. */
+    volatile bool started;              /* Running the scheduler? */
+
+    /* Owned by thread.c. */
+    struct thread *idle_thread;         /* Runs when `rq' is empty. */
+    struct thread *current;             /* Thread running here. */
+    struct runqueue rq;                 /* Threads waiting to run here. */
+    unsigned thread_ticks;              /* # of timer ticks since last yield. */
+    long long idle_ticks;               /* # of timer ticks spent idle. */
+    long long kernel_ticks;             /* # of timer ticks in kernel
+                                           threads. */
+    long long user_ticks;               /* # of timer ticks in user
+                                           programs. */
+    long long steal_cnt;                /* # of threads stolen from other
+                                           CPUs, under rq.lock. */
+    long long migration_cnt;            /* # of threads moved here from
+                                           another CPU, under rq.lock. */
+
+    /* Owned by interrupt.c. */
+    bool in_external_intr;              /* Processing an external interrupt? */
+    bool yield_on_return;               /* Yield on interrupt return? */
+    uint64_t intr_off_since;            /* When interrupts went off. */
+    void *intr_off_caller;              /* Who turned them off, or NULL
+                                           if not known (-irqsoff). */
+
+    /* Owned by devices/timer.c. */
+    int64_t local_ticks;                /* # of local APIC timer ticks. */
+
+    /* Owned by userprog/fpu.c. */
+    struct thread *fpu_owner;           /* Thread whose FPU state is loaded. */
+
+    /* Owned by threads/trace.c. */
+    struct trace_event *trace;          /* Event ring, if tracing. */
+    uint32_t trace_head;                /* # of events ever recorded. */
+  };
+
+/* CPUs that have started, in cpus[0] up to cpus[cpu_cnt - 1]. */
+extern struct cpu cpus[CPU_MAX];
+extern int cpu_cnt;
+
+struct cpu *cpu_current (void);
+void cpu_init (void);
+void cpu_start_aps (int cnt);
+void cpu_kick (struct cpu *);
+void cpu_flush_tlb (uint32_t *pd);
+
+#endif /* threads/cpu.h */
@@ -15,16 +15,21 @@
 #include "devices/timer.h"
 #include "devices/vga.h"
 #include "devices/rtc.h"
+#include "threads/cpu.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
 #include "threads/loader.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/profile.h"
 #include "threads/pte.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
+#include "threads/workqueue.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #include "userprog/exception.h"
+#include "userprog/fpu.h"
 #include "userprog/gdt.h"
 #include "userprog/syscall.h"
 #include "userprog/tss.h"
@@ -60,6 +65,9 @@ static const char *swap_bdev_name;
 /* -ul: Maximum number of pages to put into palloc's user pool. */
 static size_t user_page_limit = SIZE_MAX;
 
+/* -smp: Number of CPUs to run on. */
+static int smp_cpus = 1;
+
 static void bss_init (void);
 static void paging_init (void);
 
@@ -97,6 +105,9 @@ main (void)
   printf ("Pintos booting with %'"PRIu32" kB RAM...\n",
           init_ram_pages * PGSIZE / 1024);
 
+  /* Find the other CPUs while the firmware's tables are intact. */
+  cpu_init ();
+
   /* Initialize memory system. */
   palloc_init (user_page_limit);
   malloc_init ();
@@ -114,15 +125,23 @@ main (void)
   kbd_init ();
   input_init ();
 #ifdef USERPROG
+  fpu_init ();
   exception_init ();
   syscall_init ();
 #endif
 
   /* Start thread scheduler and enable interrupts. */
   thread_start ();
+  workqueue_init ();
   serial_init_queue ();
   timer_calibrate ();
 
+  /* Start the other CPUs, if asked to. */
+  if (smp_cpus > 1)
+    cpu_start_aps (smp_cpus);
+  trace_init ();
+  profile_init ();
+
 #ifdef FILESYS
   /* Initialize file system. */
   ide_init ();
@@ -133,6 +152,7 @@ main (void)
   // 🧠 project3/vm
   // Initialize the frame table and swap table
   init_swap_valid_table ();
+  page_init ();
   frame_init ();
 
   printf ("Boot complete.\n");
@@ -264,6 +284,20 @@ parse_options (char **argv)
         random_init (atoi (value));
       else if (!strcmp (name, "-mlfqs"))
         thread_mlfqs = true;
+      else if (!strcmp (name, "-cfs"))
+        thread_cfs = true;
+      else if (!strcmp (name, "-tickless"))
+        timer_tickless = true;
+      else if (!strcmp (name, "-lockstat"))
+        lockstat_enabled = true;
+      else if (!strcmp (name, "-trace"))
+        trace_enabled = true;
+      else if (!strcmp (name, "-irqsoff"))
+        irqsoff_enabled = true;
+      else if (!strcmp (name, "-profile"))
+        profile_enabled = true;
+      else if (!strcmp (name, "-smp"))
+        smp_cpus = atoi (value);
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
@@ -271,6 +305,8 @@ parse_options (char **argv)
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
     }
+  if (thread_mlfqs && thread_cfs)
+    PANIC ("-mlfqs and -cfs cannot be used together");
 
   /* Initialize the random number generator based on the system
      time.  This has no effect if an "-rs" option was specified.
@@ -387,6 +423,13 @@ usage (void)
 #endif
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+          "  -cfs               Use completely fair scheduler.\n"
+          "  -tickless          Stop the periodic timer tick while idle.\n"
+          "  -lockstat          Keep lock contention statistics.\n"
+          "  -trace             Trace scheduler and I/O events, dump at shutdown.\n"
+          "  -irqsoff           Track the longest interrupts-off windows.\n"
+          "  -profile           Sample call stacks on every timer tick.\n"
+          "  -smp=N             Run on N CPUs.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
 #endif
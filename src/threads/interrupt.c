@@ -3,11 +3,16 @@
 #include <inttypes.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "threads/flags.h"
+#include "threads/cpu.h"
 #include "threads/intr-stubs.h"
 #include "threads/io.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#include "devices/lapic.h"
 #include "devices/timer.h"
 
 /* Programmable Interrupt Controller (PIC) registers.
@@ -43,13 +48,52 @@ static unsigned int unexpected_cnt[INTR_CNT];
    pre-empted.  Handlers for external interrupts also may not
    sleep, although they may invoke intr_yield_on_return() to
    request that a new process be scheduled just before the
-   interrupt returns. */
-static bool in_external_intr;   /* Are we processing an external interrupt? */
-static bool yield_on_return;    /* Should we yield on interrupt return? */
+   interrupt returns.  Whether a CPU is processing an external
+   interrupt, and whether it should yield on return, are kept in
+   its struct cpu. */
+
+/* Turning interrupts off only excludes other code on the same
+   CPU.  Data shared between CPUs is protected by spinlocks (see
+   synch.h), each held with interrupts off, and turning
+   interrupts off alone is enough only for per-CPU data, such as
+   a CPU's struct cpu. */
+
+/* Interrupts-off latency tracking.
+
+   An interrupt that arrives while interrupts are off has to wait
+   until they are turned back on, so the longest such window
+   bounds how late a timer tick, and with it a timer_sleep()
+   wake-up, can be handled.  With -irqsoff, each CPU notes when
+   and from where its interrupts were turned off, and when they
+   go back on, charges the window to that caller in irqsoff_top,
+   which keeps the IRQSOFF_TOP callers with the longest windows.
+   A window includes any time spent waiting for spinlocks, since
+   the CPU cannot take interrupts then either.  irqsoff_top and
+   irqsoff_cnt are protected by irqsoff_lock. */
+bool irqsoff_enabled;
+
+#define IRQSOFF_TOP 10
+
+struct irqsoff_entry
+  {
+    void *caller;               /* Turned interrupts off. */
+    void *enabler;              /* Turned them back on, the longest time. */
+    uint64_t max;               /* Longest window, in timer_cycles(). */
+    unsigned cnt;               /* # of windows charged to CALLER. */
+  };
+static struct irqsoff_entry irqsoff_top[IRQSOFF_TOP];
+static long long irqsoff_cnt;   /* # of windows measured. */
+static struct spinlock irqsoff_lock;
+
+static enum intr_level enable (void *caller);
+static enum intr_level disable (void *caller);
+static void irqsoff_begin (void *caller);
+static void irqsoff_end (void *enabler);
 
 /* Programmable Interrupt Controller helpers. */
 static void pic_init (void);
 static void pic_end_of_interrupt (int irq);
+static bool is_external (uint8_t vec_no);
 
 /* Interrupt Descriptor Table helpers. */
 static uint64_t make_intr_gate (void (*) (void), int dpl);
@@ -80,16 +124,36 @@ intr_get_level (void)
 enum intr_level
 intr_set_level (enum intr_level level)
 {
-  return level == INTR_ON ? intr_enable () : intr_disable ();
+  void *caller = __builtin_return_address (0);
+
+  return level == INTR_ON ? enable (caller) : disable (caller);
 }
 
 /* Enables interrupts and returns the previous interrupt status. */
 enum intr_level
 intr_enable (void)
+{
+  return enable (__builtin_return_address (0));
+}
+
+/* Disables interrupts and returns the previous interrupt status. */
+enum intr_level
+intr_disable (void)
+{
+  return disable (__builtin_return_address (0));
+}
+
+/* Enables interrupts on behalf of CALLER and returns the
+   previous interrupt status. */
+static enum intr_level
+enable (void *caller)
 {
   enum intr_level old_level = intr_get_level ();
   ASSERT (!intr_context ());
 
+  if (old_level == INTR_OFF && irqsoff_enabled)
+    irqsoff_end (caller);
+
   /* Enable interrupts by setting the interrupt flag.
 
      See [IA32-v2b] "STI" and [IA32-v3a] 5.8.1 "Masking Maskable
@@ -99,9 +163,10 @@ intr_enable (void)
   return old_level;
 }
 
-/* Disables interrupts and returns the previous interrupt status. */
-enum intr_level
-intr_disable (void)
+/* Disables interrupts on behalf of CALLER and returns the
+   previous interrupt status. */
+static enum intr_level
+disable (void *caller)
 {
   enum intr_level old_level = intr_get_level ();
 
@@ -110,8 +175,32 @@ intr_disable (void)
      Hardware Interrupts". */
   asm volatile ("cli" : : : "memory");
 
+  if (old_level == INTR_ON && irqsoff_enabled)
+    irqsoff_begin (caller);
+
   return old_level;
 }
+
+/* Enables interrupts and waits for the next one to arrive.
+   Interrupts must be off; they are on when this returns.
+
+   The `sti' instruction disables interrupts until the completion
+   of the next instruction, so `sti; hlt' is executed atomically.
+   This atomicity is important; otherwise, an interrupt could be
+   handled between re-enabling interrupts and waiting for the next
+   one to occur, wasting as much as one clock tick worth of time.
+
+   See [IA32-v2a] "HLT", [IA32-v2b] "STI", and [IA32-v3a] 7.11.1
+   "HLT Instruction". */
+void
+intr_wait (void)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (irqsoff_enabled)
+    irqsoff_end (__builtin_return_address (0));
+  asm volatile ("sti; hlt" : : : "memory");
+}
 
 /* Initializes the interrupt system. */
 void
@@ -155,6 +244,21 @@ intr_init (void)
   intr_names[17] = "#AC Alignment Check Exception";
   intr_names[18] = "#MC Machine-Check Exception";
   intr_names[19] = "#XF SIMD Floating-Point Exception";
+
+  spinlock_init (&irqsoff_lock);
+}
+
+/* Initializes interrupt handling on an application processor,
+   which starts out with interrupts off. */
+void
+intr_init_ap (void)
+{
+  uint64_t idtr_operand;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  idtr_operand = make_idtr_operand (sizeof idt - 1, idt);
+  asm volatile ("lidt %0" : : "m" (idtr_operand));
 }
 
 /* Registers interrupt VEC_NO to invoke HANDLER with descriptor
@@ -176,12 +280,14 @@ register_handler (uint8_t vec_no, int dpl, enum intr_level level,
 
 /* Registers external interrupt VEC_NO to invoke HANDLER, which
    is named NAME for debugging purposes.  The handler will
-   execute with interrupts disabled. */
+   execute with interrupts disabled.  External interrupts come
+   from the PICs, at vectors 0x20...0x2f, or from the local APIC,
+   at vectors 0xf0...0xff. */
 void
 intr_register_ext (uint8_t vec_no, intr_handler_func *handler,
                    const char *name)
 {
-  ASSERT (vec_no >= 0x20 && vec_no <= 0x2f);
+  ASSERT (is_external (vec_no));
   register_handler (vec_no, 0, INTR_OFF, handler, name);
 }
 
@@ -202,7 +308,7 @@ void
 intr_register_int (uint8_t vec_no, int dpl, enum intr_level level,
                    intr_handler_func *handler, const char *name)
 {
-  ASSERT (vec_no < 0x20 || vec_no > 0x2f);
+  ASSERT (!is_external (vec_no));
   register_handler (vec_no, dpl, level, handler, name);
 }
 
@@ -211,7 +317,7 @@ intr_register_int (uint8_t vec_no, int dpl, enum intr_level level,
 bool
 intr_context (void)
 {
-  return in_external_intr;
+  return cpu_current ()->in_external_intr;
 }
 
 /* During processing of an external interrupt, directs the
@@ -222,7 +328,7 @@ void
 intr_yield_on_return (void)
 {
   ASSERT (intr_context ());
-  yield_on_return = true;
+  cpu_current ()->yield_on_return = true;
 }
 
 /* 8259A Programmable Interrupt Controller. */
@@ -274,6 +380,14 @@ pic_end_of_interrupt (int irq)
     outb (0xa0, 0x20);
 }
 
+/* Returns true if VEC_NO is the vector of an external interrupt,
+   false otherwise. */
+static bool
+is_external (uint8_t vec_no)
+{
+  return (vec_no >= 0x20 && vec_no <= 0x2f) || vec_no >= 0xf0;
+}
+
 /* Creates an gate that invokes FUNCTION.
 
    The gate has descriptor privilege level DPL, meaning that it
@@ -346,26 +460,42 @@ intr_handler (struct intr_frame *frame)
 {
   bool external;
   intr_handler_func *handler;
+  void *site;
+  struct cpu *c;
+
+  /* An interrupt gate turned interrupts off on the way in.  For
+     -irqsoff, the window is charged to the handler. */
+  handler = intr_handlers[frame->vec_no];
+  site = handler != NULL ? (void *) handler : (void *) frame->eip;
+  if (irqsoff_enabled && intr_get_level () == INTR_OFF
+      && (frame->eflags & FLAG_IF))
+    irqsoff_begin (site);
 
   /* External interrupts are special.
      We only handle one at a time (so interrupts must be off)
-     and they need to be acknowledged on the PIC (see below).
-     An external interrupt handler cannot sleep. */
-  external = frame->vec_no >= 0x20 && frame->vec_no < 0x30;
+     and they need to be acknowledged on the PIC or local APIC
+     (see below).  An external interrupt handler cannot sleep. */
+  external = is_external (frame->vec_no);
   if (external)
     {
       ASSERT (intr_get_level () == INTR_OFF);
       ASSERT (!intr_context ());
 
-      in_external_intr = true;
-      yield_on_return = false;
+      c = cpu_current ();
+      c->in_external_intr = true;
+      c->yield_on_return = false;
+
+      /* Catch up on the ticks that tickless idle skipped, so
+         that the handler and whoever it wakes see the right
+         time. */
+      timer_tickless_exit ();
     }
 
   /* Invoke the interrupt's handler. */
-  handler = intr_handlers[frame->vec_no];
   if (handler != NULL)
     handler (frame);
-  else if (frame->vec_no == 0x27 || frame->vec_no == 0x2f)
+  else if (frame->vec_no == 0x27 || frame->vec_no == 0x2f
+           || frame->vec_no == LAPIC_VEC_SPURIOUS)
     {
       /* There is no handler, but this interrupt can trigger
          spuriously due to a hardware fault or hardware race
@@ -380,12 +510,23 @@ intr_handler (struct intr_frame *frame)
       ASSERT (intr_get_level () == INTR_OFF);
       ASSERT (intr_context ());
 
-      in_external_intr = false;
-      pic_end_of_interrupt (frame->vec_no);
+      c = cpu_current ();
+      c->in_external_intr = false;
+      if (frame->vec_no < 0x30)
+        pic_end_of_interrupt (frame->vec_no);
+      else if (frame->vec_no != LAPIC_VEC_SPURIOUS)
+        lapic_eoi ();
 
-      if (yield_on_return)
+      if (c->yield_on_return)
         thread_yield ();
     }
+
+  /* Interrupts are about to be turned back on by the return from
+     the interrupt.  This CPU may be running a different thread by
+     now, which charges the window to the same handler. */
+  if (irqsoff_enabled && intr_get_level () == INTR_OFF
+      && (frame->eflags & FLAG_IF))
+    irqsoff_end (site);
 }
 
 /* Handles an unexpected interrupt with interrupt frame F.  An
@@ -436,3 +577,108 @@ intr_name (uint8_t vec)
 {
   return intr_names[vec];
 }
+
+/* Interrupts-off latency tracking. */
+
+/* Notes that interrupts just went off on this CPU, on behalf of
+   CALLER. */
+static void
+irqsoff_begin (void *caller)
+{
+  struct cpu *c = cpu_current ();
+
+  c->intr_off_since = timer_cycles ();
+  c->intr_off_caller = caller;
+}
+
+/* Charges the window that is ending on this CPU, now that
+   ENABLER is turning interrupts back on, to the caller that
+   began it.  Interrupts must still be off. */
+static void
+irqsoff_end (void *enabler)
+{
+  struct cpu *c = cpu_current ();
+  struct irqsoff_entry *e, *min;
+  uint64_t len;
+
+  /* Interrupts may have been off since before tracking began. */
+  if (c->intr_off_caller == NULL)
+    return;
+  len = timer_cycles () - c->intr_off_since;
+  spinlock_acquire (&irqsoff_lock);
+  irqsoff_cnt++;
+
+  /* Find CALLER's entry or, failing that, the one with the
+     shortest window, which CALLER takes over if it did worse. */
+  min = irqsoff_top;
+  for (e = irqsoff_top; e < irqsoff_top + IRQSOFF_TOP; e++)
+    {
+      if (e->caller == c->intr_off_caller)
+        {
+          min = e;
+          break;
+        }
+      if (e->max < min->max)
+        min = e;
+    }
+  if (min->caller != c->intr_off_caller)
+    {
+      if (len <= min->max)
+        goto done;
+      min->caller = c->intr_off_caller;
+      min->max = 0;
+      min->cnt = 0;
+    }
+  min->cnt++;
+  if (len > min->max)
+    {
+      min->max = len;
+      min->enabler = enabler;
+    }
+
+ done:
+  spinlock_release (&irqsoff_lock);
+  c->intr_off_caller = NULL;
+}
+
+/* Orders irqsoff_top entries by decreasing window length. */
+static int
+irqsoff_compare (const void *a_, const void *b_)
+{
+  const struct irqsoff_entry *a = a_;
+  const struct irqsoff_entry *b = b_;
+
+  return a->max < b->max ? 1 : a->max > b->max ? -1 : 0;
+}
+
+/* Prints the longest interrupts-off windows, if they are being
+   tracked. */
+void
+intr_print_stats (void)
+{
+  struct irqsoff_entry top[IRQSOFF_TOP];
+  enum intr_level old_level;
+  int i;
+
+  if (!irqsoff_enabled)
+    return;
+
+  old_level = intr_disable ();
+  spinlock_acquire (&irqsoff_lock);
+  memcpy (top, irqsoff_top, sizeof top);
+  spinlock_release (&irqsoff_lock);
+  intr_set_level (old_level);
+  qsort (top, IRQSOFF_TOP, sizeof *top, irqsoff_compare);
+
+  printf ("Interrupts off: %lld windows, longest by caller:\n", irqsoff_cnt);
+  for (i = 0; i < IRQSOFF_TOP && top[i].caller != NULL; i++)
+    printf ("  %8"PRId64" ns, %u times: off at %p, on at %p\n",
+            timer_cycles_to_ns (top[i].max), top[i].cnt,
+            top[i].caller, top[i].enabler);
+
+  /* In a form that utils/backtrace accepts as is. */
+  printf ("Call stack:");
+  for (i = 0; i < IRQSOFF_TOP && top[i].caller != NULL; i++)
+    printf (" %p %p", top[i].caller, top[i].enabler);
+  printf (".\n");
+}
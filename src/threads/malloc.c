@@ -5,17 +5,19 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/cpu.h"
+#include "threads/interrupt.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
 
 /* A simple implementation of malloc().
 
-   The size of each request, in bytes, is rounded up to a power
-   of 2 and assigned to the "descriptor" that manages blocks of
-   that size.  The descriptor keeps a list of free blocks.  If
-   the free list is nonempty, one of its blocks is used to
-   satisfy the request.
+   The size of each request, in bytes, is rounded up to the next
+   size class, a power of 2 or 1.5 times one, and assigned to the
+   "descriptor" that manages blocks of that size.  The descriptor
+   keeps a list of free blocks.  If the free list is nonempty,
+   one of its blocks is used to satisfy the request.
 
    Otherwise, a new page of memory, called an "arena", is
    obtained from the page allocator (if none is available,
@@ -32,7 +34,15 @@
    because they're too big to fit in a single page with a
    descriptor.  We handle those by allocating contiguous pages
    with the page allocator and sticking the allocation size at
-   the beginning of the allocated block's arena header. */
+   the beginning of the allocated block's arena header.
+
+   Taking a descriptor's lock on every call is slow, so each CPU
+   also keeps a "magazine" of free blocks for each descriptor,
+   which it uses with interrupts off instead of a lock.  An empty
+   magazine is refilled with MAG_BATCH blocks from the free list
+   at once, and a full one gives MAG_BATCH blocks back, so that
+   only about one call in MAG_BATCH takes the lock.  Blocks in a
+   magazine still count as in use in their arenas. */
 
 /* Descriptor. */
 struct desc
@@ -61,11 +71,29 @@ struct block
   };
 
 /* Our set of descriptors. */
-static struct desc descs[10];   /* Descriptors. */
+static struct desc descs[16];   /* Descriptors. */
 static size_t desc_cnt;         /* Number of descriptors. */
 
+/* Magazine sizes. */
+#define MAG_SIZE 16             /* Most blocks in a magazine. */
+#define MAG_BATCH 8             /* Blocks moved to or from the lock. */
+
+/* Magazine, a CPU's stack of free blocks for one descriptor. */
+struct magazine
+  {
+    size_t cnt;                 /* Number of blocks. */
+    struct block *blocks[MAG_SIZE]; /* Blocks. */
+  };
+
+/* Magazines, by CPU and by descriptor. */
+static struct magazine magazines[CPU_MAX][sizeof descs / sizeof *descs];
+
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
+static struct magazine *current_magazine (struct desc *);
+static size_t get_blocks (struct desc *, struct block *[], size_t cnt);
+static void put_blocks (struct desc *, struct block *[], size_t cnt);
+static void init_desc (size_t block_size);
 
 /* Initializes the malloc() descriptors. */
 void
@@ -75,15 +103,24 @@ malloc_init (void)
 
   for (block_size = 16; block_size < PGSIZE / 2; block_size *= 2)
     {
-      struct desc *d = &descs[desc_cnt++];
-      ASSERT (desc_cnt <= sizeof descs / sizeof *descs);
-      d->block_size = block_size;
-      d->blocks_per_arena = (PGSIZE - sizeof (struct arena)) / block_size;
-      list_init (&d->free_list);
-      lock_init (&d->lock);
+      init_desc (block_size);
+      if (block_size >= 32)
+        init_desc (block_size + block_size / 2);
     }
 }
 
+/* Adds a descriptor for blocks of BLOCK_SIZE bytes. */
+static void
+init_desc (size_t block_size)
+{
+  struct desc *d = &descs[desc_cnt++];
+  ASSERT (desc_cnt <= sizeof descs / sizeof *descs);
+  d->block_size = block_size;
+  d->blocks_per_arena = (PGSIZE - sizeof (struct arena)) / block_size;
+  list_init (&d->free_list);
+  lock_init (&d->lock);
+}
+
 /* Obtains and returns a new block of at least SIZE bytes.
    Returns a null pointer if memory is not available. */
 void *
@@ -92,6 +129,8 @@ malloc (size_t size)
   struct desc *d;
   struct block *b;
   struct arena *a;
+  struct magazine *m;
+  enum intr_level old_level;
 
   /* A null pointer satisfies a request for 0 bytes. */
   if (size == 0)
@@ -119,37 +158,36 @@ malloc (size_t size)
       return a + 1;
     }
 
-  lock_acquire (&d->lock);
-
-  /* If the free list is empty, create a new arena. */
-  if (list_empty (&d->free_list))
+  /* Take a block from this CPU's magazine, refilling it first
+     if it is empty. */
+  old_level = intr_disable ();
+  m = current_magazine (d);
+  if (m->cnt == 0)
     {
-      size_t i;
+      struct block *batch[MAG_BATCH];
+      size_t cnt, room;
 
-      /* Allocate a page. */
-      a = palloc_get_page (0);
-      if (a == NULL)
-        {
-          lock_release (&d->lock);
-          return NULL;
-        }
-
-      /* Initialize arena and add its blocks to the free list. */
-      a->magic = ARENA_MAGIC;
-      a->desc = d;
-      a->free_cnt = d->blocks_per_arena;
-      for (i = 0; i < d->blocks_per_arena; i++)
-        {
-          struct block *b = arena_to_block (a, i);
-          list_push_back (&d->free_list, &b->free_elem);
-        }
+      intr_set_level (old_level);
+      cnt = get_blocks (d, batch, MAG_BATCH);
+      if (cnt == 0)
+        return NULL;
+      b = batch[--cnt];
+
+      /* We may be on another CPU now, whose magazine need not be
+         empty.  Give back whatever does not fit. */
+      old_level = intr_disable ();
+      m = current_magazine (d);
+      room = MAG_SIZE - m->cnt;
+      if (room > cnt)
+        room = cnt;
+      memcpy (m->blocks + m->cnt, batch + cnt - room, room * sizeof *batch);
+      m->cnt += room;
+      intr_set_level (old_level);
+      put_blocks (d, batch, cnt - room);
+      return b;
     }
-
-  /* Get a block from free list and return it. */
-  b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
-  a = block_to_arena (b);
-  a->free_cnt--;
-  lock_release (&d->lock);
+  b = m->blocks[--m->cnt];
+  intr_set_level (old_level);
   return b;
 }
 
@@ -227,32 +265,30 @@ free (void *p)
       if (d != NULL)
         {
           /* It's a normal block.  We handle it here. */
+          struct magazine *m;
+          struct block *batch[MAG_BATCH];
+          enum intr_level old_level;
 
 #ifndef NDEBUG
           /* Clear the block to help detect use-after-free bugs. */
           memset (b, 0xcc, d->block_size);
 #endif
 
-          lock_acquire (&d->lock);
-
-          /* Add block to free list. */
-          list_push_front (&d->free_list, &b->free_elem);
-
-          /* If the arena is now entirely unused, free it. */
-          if (++a->free_cnt >= d->blocks_per_arena)
+          /* Put the block in this CPU's magazine, first moving
+             MAG_BATCH blocks out of it if it is full. */
+          old_level = intr_disable ();
+          m = current_magazine (d);
+          if (m->cnt < MAG_SIZE)
             {
-              size_t i;
-
-              ASSERT (a->free_cnt == d->blocks_per_arena);
-              for (i = 0; i < d->blocks_per_arena; i++)
-                {
-                  struct block *b = arena_to_block (a, i);
-                  list_remove (&b->free_elem);
-                }
-              palloc_free_page (a);
+              m->blocks[m->cnt++] = b;
+              intr_set_level (old_level);
+              return;
             }
-
-          lock_release (&d->lock);
+          m->cnt -= MAG_BATCH;
+          memcpy (batch, m->blocks + m->cnt, sizeof batch);
+          m->blocks[m->cnt++] = b;
+          intr_set_level (old_level);
+          put_blocks (d, batch, MAG_BATCH);
         }
       else
         {
@@ -292,3 +328,96 @@ arena_to_block (struct arena *a, size_t idx)
                            + sizeof *a
                            + idx * a->desc->block_size);
 }
+
+/* Returns the running CPU's magazine for descriptor D.
+   Interrupts must be off. */
+static struct magazine *
+current_magazine (struct desc *d)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  return &magazines[cpu_current ()->id][d - descs];
+}
+
+/* Takes up to CNT free blocks from descriptor D, creating a new
+   arena if its free list is empty, and stores them in BLOCKS.
+   Returns the number of blocks taken, which is 0 only if memory
+   is not available. */
+static size_t
+get_blocks (struct desc *d, struct block *blocks[], size_t cnt)
+{
+  size_t i;
+
+  lock_acquire (&d->lock);
+
+  /* If the free list is empty, create a new arena. */
+  if (list_empty (&d->free_list))
+    {
+      struct arena *a;
+
+      /* Allocate a page. */
+      a = palloc_get_page (0);
+      if (a == NULL)
+        {
+          lock_release (&d->lock);
+          return 0;
+        }
+
+      /* Initialize arena and add its blocks to the free list. */
+      a->magic = ARENA_MAGIC;
+      a->desc = d;
+      a->free_cnt = d->blocks_per_arena;
+      for (i = 0; i < d->blocks_per_arena; i++)
+        {
+          struct block *b = arena_to_block (a, i);
+          list_push_back (&d->free_list, &b->free_elem);
+        }
+    }
+
+  /* Get blocks from the free list. */
+  for (i = 0; i < cnt && !list_empty (&d->free_list); i++)
+    {
+      struct block *b = list_entry (list_pop_front (&d->free_list),
+                                    struct block, free_elem);
+      block_to_arena (b)->free_cnt--;
+      blocks[i] = b;
+    }
+
+  lock_release (&d->lock);
+  return i;
+}
+
+/* Returns the CNT blocks in BLOCKS to descriptor D's free list,
+   freeing any arena that is left with no blocks in use. */
+static void
+put_blocks (struct desc *d, struct block *blocks[], size_t cnt)
+{
+  size_t i;
+
+  if (cnt == 0)
+    return;
+
+  lock_acquire (&d->lock);
+  for (i = 0; i < cnt; i++)
+    {
+      struct block *b = blocks[i];
+      struct arena *a = block_to_arena (b);
+
+      /* Add block to free list. */
+      list_push_front (&d->free_list, &b->free_elem);
+
+      /* If the arena is now entirely unused, free it. */
+      if (++a->free_cnt >= d->blocks_per_arena)
+        {
+          size_t j;
+
+          ASSERT (a->free_cnt == d->blocks_per_arena);
+          for (j = 0; j < d->blocks_per_arena; j++)
+            {
+              struct block *b = arena_to_block (a, j);
+              list_remove (&b->free_elem);
+            }
+          palloc_free_page (a);
+        }
+    }
+  lock_release (&d->lock);
+}
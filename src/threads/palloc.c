@@ -2,14 +2,17 @@
 #include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/loader.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
+#include "threads/workqueue.h"
 
 /* Page allocator.  Hands out memory in page-size (or
    page-multiple) chunks.  See malloc.h for an allocator that
@@ -23,22 +26,125 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Neither pool has to live within its half, though.  A request
+   that its own pool cannot satisfy borrows pages from the other
+   pool, as long as the lender keeps more than its high watermark
+   of free pages.  Borrowed pages are still part of the lending
+   pool and go back to it when freed.  The kernel cannot wait for
+   that if its own free pages drop below the low watermark while
+   the user pool holds some of its pages, so it then asks the VM
+   system, through the function given to palloc_set_reclaim(), to
+   evict those pages until it is back above its high watermark.
+   The user pool does not borrow if its size was limited with
+   -ul.
+
+   Each pool is a binary buddy allocator.  Its free pages form
+   blocks of 2**ORDER pages, for ORDER up to MAX_ORDER, each
+   starting at a multiple of its own size (counting from the
+   pool's base), with one free list per order.  A request for
+   PAGE_CNT pages takes the smallest free block that fits,
+   splitting larger ones in halves as needed, and gives back the
+   pages it does not need.  Freed pages merge with their free
+   "buddy", the other half of the block they were split from,
+   into ever larger blocks.  Both take O(log n) time, unlike the
+   linear scan of a bitmap for a long enough run of free pages,
+   and merging keeps large runs available for as long as
+   possible.  Only a request larger than any free block, which a
+   run of smaller neighbouring blocks might still satisfy, falls
+   back to scanning.
+
+   A free block's list_elem lives in its first page, so the only
+   other memory needed is a byte per page recording the order of
+   the free block that starts there.  The bitmap of used pages
+   is kept only to check frees against allocations.
+
+   Both pools are protected by palloc_lock, a spinlock rather
+   than a lock, because the scheduler frees dead threads' pages
+   with interrupts off.  No operation inside takes long.
+
+   Zeroing a page for PAL_ZERO takes longer than allocating it, so
+   each pool also keeps a stack of up to ZEROED_MAX free pages
+   that are already zeroed, which PAL_ZERO requests for a single
+   page take first.  The idle thread refills it through
+   palloc_prezero() while it has nothing else to do, as long as
+   the pool has plenty of free pages.  Pre-zeroed pages count as
+   allocated, so an allocation that would otherwise fail gives
+   them all back first. */
+
+/* Largest block order.  A block of this order is 256 MB. */
+#define MAX_ORDER 16
+
+/* In a pool's `orders', marks a page that does not start a free
+   block. */
+#define NO_ORDER 0xff
+
+/* Most pre-zeroed pages in a pool. */
+#define ZEROED_MAX 64
+
+/* Pages that must be left free in a pool before pages are zeroed
+   in advance. */
+#define ZEROED_RESERVE 128
+
+/* A pool's low and high watermarks, as fractions of its size. */
+#define LOW_MARK_DIV 16
+#define HIGH_MARK_DIV 8
 
 /* A memory pool. */
 struct pool
   {
-    struct lock lock;                   /* Mutual exclusion. */
-    struct bitmap *used_map;            /* Bitmap of free pages. */
+    struct bitmap *used_map;            /* Bitmap of used pages. */
+    struct bitmap *lent_map;            /* Bitmap of lent pages. */
+    uint8_t *orders;                    /* Order of the free block
+                                           starting at each page. */
+    struct list free_lists[MAX_ORDER + 1]; /* Free blocks by order. */
+    size_t free_cnt;                    /* Number of free pages. */
     uint8_t *base;                      /* Base of pool. */
+    const char *name;                   /* For statistics. */
+
+    void *zeroed[ZEROED_MAX];           /* Pre-zeroed pages. */
+    size_t zeroed_cnt;                  /* Number of pre-zeroed pages. */
+    unsigned long long prezero_hits;    /* PAL_ZERO pages pre-zeroed. */
+    unsigned long long prezero_misses;  /* PAL_ZERO pages zeroed on the
+                                           caller's path. */
+
+    size_t low_mark, high_mark;         /* Free page watermarks. */
+    size_t lent_cnt;                    /* Pages lent to other pool. */
+    size_t used_max;                    /* Most pages ever in use. */
+    size_t lent_max;                    /* Most pages ever lent. */
   };
 
 /* Two pools: one for kernel data, one for user pages. */
 static struct pool kernel_pool, user_pool;
 
+/* May the user pool borrow from the kernel pool? */
+static bool user_may_borrow;
+
+/* Gives back pages that the kernel pool lent to the user pool. */
+static palloc_reclaim_func *reclaim_func;
+static struct work reclaim_work;
+static unsigned long long reclaim_cnt;
+
+/* Protects both pools and reclaim_cnt. */
+static struct spinlock palloc_lock;
+
 static void init_pool (struct pool *, void *base, size_t page_cnt,
                        const char *name);
 static bool page_from_pool (const struct pool *, void *page);
+static size_t pool_size (const struct pool *);
+static size_t alloc_pages (struct pool *, size_t page_cnt);
+static bool prezero (struct pool *);
+static void release_zeroed (struct pool *);
+static size_t borrow_pages (struct pool *, size_t page_cnt);
+static bool note_use (struct pool *);
+static void request_reclaim (void);
+static work_func reclaim;
+static size_t alloc_block (struct pool *, int order);
+static size_t alloc_run (struct pool *, size_t page_cnt);
+static void free_block (struct pool *, size_t page_idx, int order);
+static void free_range (struct pool *, size_t page_idx, size_t page_cnt);
+static void print_pool_stats (struct pool *);
 
 /* Initializes the page allocator.  At most USER_PAGE_LIMIT
    pages are put into the user pool. */
@@ -55,10 +161,14 @@ palloc_init (size_t user_page_limit)
     user_pages = user_page_limit;
   kernel_pages = free_pages - user_pages;
 
+  spinlock_init (&palloc_lock);
+
   /* Give half of memory to kernel, half to user. */
   init_pool (&kernel_pool, free_start, kernel_pages, "kernel pool");
   init_pool (&user_pool, free_start + kernel_pages * PGSIZE,
              user_pages, "user pool");
+  user_may_borrow = user_page_limit == SIZE_MAX;
+  work_init (&reclaim_work, reclaim, NULL);
 }
 
 /* Obtains and returns a group of PAGE_CNT contiguous free pages.
@@ -71,18 +181,55 @@ void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
 {
   struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+  struct pool *from = pool;
+  enum intr_level old_level;
+  bool reclaim_wanted = false;
   void *pages;
   size_t page_idx;
 
   if (page_cnt == 0)
     return NULL;
 
-  lock_acquire (&pool->lock);
-  page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-  lock_release (&pool->lock);
+  old_level = intr_disable ();
+  spinlock_acquire (&palloc_lock);
+  if ((flags & PAL_ZERO) && page_cnt == 1 && pool->zeroed_cnt > 0)
+    {
+      /* A page zeroed in advance will do. */
+      pool->prezero_hits++;
+      pages = pool->zeroed[--pool->zeroed_cnt];
+      reclaim_wanted = note_use (pool);
+      spinlock_release (&palloc_lock);
+      intr_set_level (old_level);
+      if (reclaim_wanted)
+        request_reclaim ();
+      return pages;
+    }
+  page_idx = alloc_pages (pool, page_cnt);
+  if (page_idx == BITMAP_ERROR && pool->zeroed_cnt > 0)
+    {
+      /* Memory is short, so the pre-zeroed pages are better spent
+         on this request. */
+      release_zeroed (pool);
+      page_idx = alloc_pages (pool, page_cnt);
+    }
+  if (page_idx == BITMAP_ERROR)
+    {
+      from = pool == &user_pool ? &kernel_pool : &user_pool;
+      page_idx = borrow_pages (pool, page_cnt);
+    }
+  if (page_idx != BITMAP_ERROR)
+    {
+      if (flags & PAL_ZERO)
+        pool->prezero_misses += page_cnt;
+      reclaim_wanted = note_use (from);
+    }
+  spinlock_release (&palloc_lock);
+  intr_set_level (old_level);
+  if (reclaim_wanted)
+    request_reclaim ();
 
   if (page_idx != BITMAP_ERROR)
-    pages = pool->base + PGSIZE * page_idx;
+    pages = from->base + PGSIZE * page_idx;
   else
     pages = NULL;
 
@@ -118,6 +265,7 @@ void
 palloc_free_multiple (void *pages, size_t page_cnt)
 {
   struct pool *pool;
+  enum intr_level old_level;
   size_t page_idx;
 
   ASSERT (pg_ofs (pages) == 0);
@@ -137,8 +285,21 @@ palloc_free_multiple (void *pages, size_t page_cnt)
   memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
 
+  old_level = intr_disable ();
+  spinlock_acquire (&palloc_lock);
   ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
   bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+  free_range (pool, page_idx, page_cnt);
+  pool->free_cnt += page_cnt;
+  if (pool->lent_cnt > 0)
+    {
+      size_t lent_cnt = bitmap_count (pool->lent_map, page_idx, page_cnt,
+                                      true);
+      bitmap_set_multiple (pool->lent_map, page_idx, page_cnt, false);
+      pool->lent_cnt -= lent_cnt;
+    }
+  spinlock_release (&palloc_lock);
+  intr_set_level (old_level);
 }
 
 /* Frees the page at PAGE. */
@@ -148,25 +309,110 @@ palloc_free_page (void *page)
   palloc_free_multiple (page, 1);
 }
 
+/* Zeroes a free page in advance for a later PAL_ZERO request, if
+   a pool needs one and can spare it.  Returns true if it zeroed a
+   page, false if there was nothing to do.  Called by the idle
+   thread with interrupts on. */
+bool
+palloc_prezero (void)
+{
+  return prezero (&kernel_pool) || prezero (&user_pool);
+}
+
+/* Sets FUNC as the function that gives back pages the kernel
+   pool lent to the user pool.  It runs in system_wq when the
+   kernel pool runs low and should free pages for which
+   palloc_is_lent() returns true until palloc_reclaim_wanted()
+   returns false. */
+void
+palloc_set_reclaim (palloc_reclaim_func *func)
+{
+  reclaim_func = func;
+}
+
+/* Returns true if the kernel pool wants its pages back from the
+   user pool. */
+bool
+palloc_reclaim_wanted (void)
+{
+  enum intr_level old_level = intr_disable ();
+  bool wanted;
+
+  spinlock_acquire (&palloc_lock);
+  wanted = (kernel_pool.lent_cnt > 0
+            && kernel_pool.free_cnt < kernel_pool.high_mark);
+  spinlock_release (&palloc_lock);
+  intr_set_level (old_level);
+  return wanted;
+}
+
+/* Returns true if PAGE is a kernel pool page lent to the user
+   pool. */
+bool
+palloc_is_lent (void *page)
+{
+  size_t page_idx;
+  enum intr_level old_level;
+  bool lent;
+
+  if (!page_from_pool (&kernel_pool, page))
+    return false;
+  page_idx = pg_no (page) - pg_no (kernel_pool.base);
+
+  old_level = intr_disable ();
+  spinlock_acquire (&palloc_lock);
+  lent = bitmap_test (kernel_pool.lent_map, page_idx);
+  spinlock_release (&palloc_lock);
+  intr_set_level (old_level);
+  return lent;
+}
+
+/* Prints how fragmented each pool's free memory is. */
+void
+palloc_print_stats (void)
+{
+  print_pool_stats (&kernel_pool);
+  print_pool_stats (&user_pool);
+  if (reclaim_cnt > 0)
+    printf ("Palloc: kernel pool asked for lent pages back %llu times\n",
+            reclaim_cnt);
+}
+
 /* Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 static void
 init_pool (struct pool *p, void *base, size_t page_cnt, const char *name)
 {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
-     and subtract it from the pool's size. */
-  size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (page_cnt), PGSIZE);
+  /* We'll put the pool's used_map, lent_map and orders at its
+     base.  Calculate the space needed for them and subtract it
+     from the pool's size. */
+  size_t bm_size = bitmap_buf_size (page_cnt);
+  size_t bm_pages = DIV_ROUND_UP (2 * bm_size + page_cnt, PGSIZE);
+  int order;
+
   if (bm_pages > page_cnt)
     PANIC ("Not enough memory in %s for bitmap.", name);
   page_cnt -= bm_pages;
 
   printf ("%zu pages available in %s.\n", page_cnt, name);
 
-  /* Initialize the pool. */
-  lock_init (&p->lock);
-  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
+  /* Initialize the pool.  Every page is free. */
+  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_size);
+  p->lent_map = bitmap_create_in_buf (page_cnt, (uint8_t *) base + bm_size,
+                                      bm_size);
+  p->orders = (uint8_t *) base + 2 * bm_size;
+  memset (p->orders, NO_ORDER, page_cnt);
+  for (order = 0; order <= MAX_ORDER; order++)
+    list_init (&p->free_lists[order]);
   p->base = base + bm_pages * PGSIZE;
+  p->name = name;
+  p->zeroed_cnt = 0;
+  p->prezero_hits = p->prezero_misses = 0;
+  p->low_mark = page_cnt / LOW_MARK_DIV;
+  p->high_mark = page_cnt / HIGH_MARK_DIV;
+  p->lent_cnt = p->used_max = p->lent_max = 0;
+  free_range (p, 0, page_cnt);
+  p->free_cnt = page_cnt;
 }
 
 /* Returns true if PAGE was allocated from POOL,
@@ -176,7 +422,367 @@ page_from_pool (const struct pool *pool, void *page)
 {
   size_t page_no = pg_no (page);
   size_t start_page = pg_no (pool->base);
-  size_t end_page = start_page + bitmap_size (pool->used_map);
+  size_t end_page = start_page + pool_size (pool);
 
   return page_no >= start_page && page_no < end_page;
 }
+
+/* Returns the number of pages in POOL. */
+static size_t
+pool_size (const struct pool *pool)
+{
+  return bitmap_size (pool->used_map);
+}
+
+/* Takes PAGE_CNT contiguous free pages out of POOL, marks them
+   used, and returns the index of the first, or BITMAP_ERROR if
+   there are not enough.  palloc_lock must be held. */
+static size_t
+alloc_pages (struct pool *pool, size_t page_cnt)
+{
+  size_t page_idx = BITMAP_ERROR;
+  int order;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (order = 0; order <= MAX_ORDER; order++)
+    if (((size_t) 1 << order) >= page_cnt)
+      break;
+
+  if (order <= MAX_ORDER)
+    page_idx = alloc_block (pool, order);
+  if (page_idx != BITMAP_ERROR)
+    {
+      /* Give back the rest of the block. */
+      free_range (pool, page_idx + page_cnt,
+                  ((size_t) 1 << order) - page_cnt);
+    }
+  else
+    page_idx = alloc_run (pool, page_cnt);
+  if (page_idx != BITMAP_ERROR)
+    {
+      pool->free_cnt -= page_cnt;
+      ASSERT (bitmap_none (pool->used_map, page_idx, page_cnt));
+      bitmap_set_multiple (pool->used_map, page_idx, page_cnt, true);
+    }
+  return page_idx;
+}
+
+/* Zeroes a page for POOL's pre-zeroed pages, if it has room for
+   one and more than ZEROED_RESERVE free pages.  Returns true if
+   it zeroed a page.  Interrupts must be on, so that zeroing does
+   not hold up other CPUs or delay preempting the caller. */
+static bool
+prezero (struct pool *pool)
+{
+  enum intr_level old_level;
+  size_t page_idx = BITMAP_ERROR;
+  void *page;
+
+  ASSERT (intr_get_level () == INTR_ON);
+
+  old_level = intr_disable ();
+  spinlock_acquire (&palloc_lock);
+  if (pool->zeroed_cnt < ZEROED_MAX && pool->free_cnt > ZEROED_RESERVE)
+    page_idx = alloc_pages (pool, 1);
+  spinlock_release (&palloc_lock);
+  intr_set_level (old_level);
+  if (page_idx == BITMAP_ERROR)
+    return false;
+
+  page = pool->base + PGSIZE * page_idx;
+  memset (page, 0, PGSIZE);
+
+  old_level = intr_disable ();
+  spinlock_acquire (&palloc_lock);
+  if (pool->zeroed_cnt < ZEROED_MAX)
+    pool->zeroed[pool->zeroed_cnt++] = page;
+  else
+    {
+      /* Another CPU filled the stack while we were zeroing. */
+      bitmap_reset (pool->used_map, page_idx);
+      free_range (pool, page_idx, 1);
+      pool->free_cnt++;
+    }
+  spinlock_release (&palloc_lock);
+  intr_set_level (old_level);
+  return true;
+}
+
+/* Frees all of POOL's pre-zeroed pages.  palloc_lock must be
+   held. */
+static void
+release_zeroed (struct pool *pool)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  while (pool->zeroed_cnt > 0)
+    {
+      void *page = pool->zeroed[--pool->zeroed_cnt];
+      size_t page_idx = pg_no (page) - pg_no (pool->base);
+
+      bitmap_reset (pool->used_map, page_idx);
+      free_range (pool, page_idx, 1);
+      pool->free_cnt++;
+    }
+}
+
+/* Takes PAGE_CNT contiguous free pages for POOL out of the other
+   pool, if POOL may borrow and the other pool can spare them, and
+   returns their index in the other pool, or BITMAP_ERROR.
+   palloc_lock must be held. */
+static size_t
+borrow_pages (struct pool *pool, size_t page_cnt)
+{
+  struct pool *lender = pool == &user_pool ? &kernel_pool : &user_pool;
+  size_t page_idx;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if ((pool == &user_pool && !user_may_borrow)
+      || lender->free_cnt < lender->high_mark + page_cnt)
+    return BITMAP_ERROR;
+
+  page_idx = alloc_pages (lender, page_cnt);
+  if (page_idx != BITMAP_ERROR)
+    {
+      bitmap_set_multiple (lender->lent_map, page_idx, page_cnt, true);
+      lender->lent_cnt += page_cnt;
+      if (lender->lent_cnt > lender->lent_max)
+        lender->lent_max = lender->lent_cnt;
+    }
+  return page_idx;
+}
+
+/* Updates POOL's statistics after an allocation from it.
+   Returns true if it is the kernel pool and has fallen below its
+   low watermark while pages are lent, so that the caller should
+   ask for them back with request_reclaim().  palloc_lock must be
+   held. */
+static bool
+note_use (struct pool *pool)
+{
+  size_t used = pool_size (pool) - pool->free_cnt - pool->zeroed_cnt;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (used > pool->used_max)
+    pool->used_max = used;
+  return (pool == &kernel_pool && pool->lent_cnt > 0
+          && pool->free_cnt < pool->low_mark && reclaim_func != NULL);
+}
+
+/* Asks for the kernel pool's lent pages back.  Queuing the work
+   may switch threads, so palloc_lock must not be held. */
+static void
+request_reclaim (void)
+{
+  enum intr_level old_level;
+
+  if (!workqueue_queue (&system_wq, &reclaim_work))
+    return;
+  old_level = intr_disable ();
+  spinlock_acquire (&palloc_lock);
+  reclaim_cnt++;
+  spinlock_release (&palloc_lock);
+  intr_set_level (old_level);
+}
+
+/* Gives back pages that the kernel pool lent to the user pool.
+   Runs in system_wq. */
+static void
+reclaim (void *aux UNUSED)
+{
+  reclaim_func ();
+}
+
+/* Returns the list element of the free block that starts at
+   page PAGE_IDX in POOL. */
+static struct list_elem *
+block_elem (struct pool *pool, size_t page_idx)
+{
+  return (struct list_elem *) (pool->base + PGSIZE * page_idx);
+}
+
+/* Returns the index in POOL of the free block whose list element
+   is E. */
+static size_t
+block_idx (struct pool *pool, struct list_elem *e)
+{
+  return pg_no (e) - pg_no (pool->base);
+}
+
+/* Removes a free block of at least 2**ORDER pages from POOL,
+   splits it down to exactly that many, and returns the index of
+   its first page, or BITMAP_ERROR if there is none.  palloc_lock
+   must be held. */
+static size_t
+alloc_block (struct pool *pool, int order)
+{
+  size_t page_idx;
+  int o;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (o = order; o <= MAX_ORDER; o++)
+    if (!list_empty (&pool->free_lists[o]))
+      break;
+  if (o > MAX_ORDER)
+    return BITMAP_ERROR;
+
+  page_idx = block_idx (pool, list_pop_front (&pool->free_lists[o]));
+  pool->orders[page_idx] = NO_ORDER;
+
+  /* Free the upper half, until the lower half is small enough. */
+  while (o > order)
+    {
+      size_t buddy_idx;
+
+      o--;
+      buddy_idx = page_idx + ((size_t) 1 << o);
+      pool->orders[buddy_idx] = o;
+      list_push_front (&pool->free_lists[o], block_elem (pool, buddy_idx));
+    }
+  return page_idx;
+}
+
+/* Finds PAGE_CNT contiguous free pages in POOL, which may span
+   several free blocks, takes them out of those blocks, and
+   returns the index of the first, or BITMAP_ERROR if there is no
+   such run.  Takes time linear in the size of POOL.  palloc_lock
+   must be held. */
+static size_t
+alloc_run (struct pool *pool, size_t page_cnt)
+{
+  size_t page_idx, end, i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  page_idx = bitmap_scan (pool->used_map, 0, page_cnt, false);
+  if (page_idx == BITMAP_ERROR)
+    return BITMAP_ERROR;
+
+  end = page_idx + page_cnt;
+  for (i = page_idx; i < end; )
+    {
+      size_t head, block_end;
+      int order;
+
+      /* Find the free block that contains page I. */
+      for (order = 0; ; order++)
+        {
+          ASSERT (order <= MAX_ORDER);
+          head = i & ~(((size_t) 1 << order) - 1);
+          if (pool->orders[head] == order)
+            break;
+        }
+      list_remove (block_elem (pool, head));
+      pool->orders[head] = NO_ORDER;
+
+      /* Give back whatever part of it lies outside the run. */
+      block_end = head + ((size_t) 1 << order);
+      if (head < i)
+        free_range (pool, head, i - head);
+      if (block_end > end)
+        free_range (pool, end, block_end - end);
+      i = block_end;
+    }
+  return page_idx;
+}
+
+/* Adds the block of 2**ORDER pages at PAGE_IDX in POOL to the
+   free lists, first merging it with its buddy for as long as
+   that is free too.  palloc_lock must be held. */
+static void
+free_block (struct pool *pool, size_t page_idx, int order)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (page_idx % ((size_t) 1 << order) == 0);
+
+  while (order < MAX_ORDER)
+    {
+      size_t buddy_idx = page_idx ^ ((size_t) 1 << order);
+
+      if (buddy_idx >= pool_size (pool) || pool->orders[buddy_idx] != order)
+        break;
+      list_remove (block_elem (pool, buddy_idx));
+      pool->orders[buddy_idx] = NO_ORDER;
+      if (buddy_idx < page_idx)
+        page_idx = buddy_idx;
+      order++;
+    }
+
+  pool->orders[page_idx] = order;
+  list_push_front (&pool->free_lists[order], block_elem (pool, page_idx));
+}
+
+/* Frees the PAGE_CNT pages starting at PAGE_IDX in POOL, as the
+   fewest blocks that are aligned to their size.  palloc_lock
+   must be held. */
+static void
+free_range (struct pool *pool, size_t page_idx, size_t page_cnt)
+{
+  while (page_cnt > 0)
+    {
+      int order = 0;
+
+      while (order < MAX_ORDER
+             && page_idx % ((size_t) 2 << order) == 0
+             && ((size_t) 2 << order) <= page_cnt)
+        order++;
+      free_block (pool, page_idx, order);
+      page_idx += (size_t) 1 << order;
+      page_cnt -= (size_t) 1 << order;
+    }
+}
+
+/* Prints POOL's free pages and how many free blocks of each
+   order it has.  The more free memory is in small blocks, the
+   more fragmented the pool. */
+static void
+print_pool_stats (struct pool *pool)
+{
+  size_t block_cnt[MAX_ORDER + 1];
+  size_t free_cnt, zeroed_cnt, lent_cnt, used_max, lent_max;
+  size_t total_cnt = 0;
+  unsigned long long hits, misses;
+  int largest = -1;
+  int order;
+
+  enum intr_level old_level = intr_disable ();
+  spinlock_acquire (&palloc_lock);
+  free_cnt = pool->free_cnt;
+  zeroed_cnt = pool->zeroed_cnt;
+  hits = pool->prezero_hits;
+  misses = pool->prezero_misses;
+  lent_cnt = pool->lent_cnt;
+  used_max = pool->used_max;
+  lent_max = pool->lent_max;
+  for (order = 0; order <= MAX_ORDER; order++)
+    {
+      block_cnt[order] = list_size (&pool->free_lists[order]);
+      total_cnt += block_cnt[order];
+      if (block_cnt[order] > 0)
+        largest = order;
+    }
+  spinlock_release (&palloc_lock);
+  intr_set_level (old_level);
+
+  printf ("Palloc: %s: at most %zu pages in use, at most %zu lent, "
+          "%zu lent now\n", pool->name, used_max, lent_max, lent_cnt);
+  printf ("Palloc: %s: %llu of %llu zeroed pages were zeroed in advance, "
+          "%zu more ready\n", pool->name, hits, hits + misses, zeroed_cnt);
+  printf ("Palloc: %s: %zu of %zu pages free", pool->name, free_cnt,
+          pool_size (pool));
+  if (largest < 0)
+    {
+      printf ("\n");
+      return;
+    }
+  printf (" in %zu blocks, largest %zu pages\n",
+          total_cnt, (size_t) 1 << largest);
+  printf ("Palloc: %s: free blocks by order:", pool->name);
+  for (order = 0; order <= largest; order++)
+    printf (" %zu", block_cnt[order]);
+  printf ("\n");
+}
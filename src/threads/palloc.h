@@ -1,6 +1,7 @@
 #ifndef THREADS_PALLOC_H
 #define THREADS_PALLOC_H
 
+#include <stdbool.h>
 #include <stddef.h>
 
 /* How to allocate pages. */
@@ -16,5 +17,13 @@ void *palloc_get_page (enum palloc_flags);
 void *palloc_get_multiple (enum palloc_flags, size_t page_cnt);
 void palloc_free_page (void *);
 void palloc_free_multiple (void *, size_t page_cnt);
+bool palloc_prezero (void);
+
+/* Gives back pages that the kernel pool lent to the user pool. */
+typedef void palloc_reclaim_func (void);
+void palloc_set_reclaim (palloc_reclaim_func *);
+bool palloc_reclaim_wanted (void);
+bool palloc_is_lent (void *);
+void palloc_print_stats (void);
 
 #endif /* threads/palloc.h */
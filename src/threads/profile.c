@@ -0,0 +1,208 @@
+#include "threads/profile.h"
+#include <debug.h>
+#include <hash.h>
+#include <inttypes.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#ifdef USERPROG
+#include "userprog/pagedir.h"
+#endif
+
+/* Sampling profiler.
+
+   With -profile, every timer interrupt, on every CPU, takes a
+   sample of what it interrupted: the thread, whether it was in
+   user or kernel mode, and its call stack, found by following
+   the chain of saved frame pointers from the interrupted EIP and
+   EBP.  Identical samples are counted together in a fixed-size
+   open-addressing hash table, since memory cannot be allocated
+   in an interrupt handler.
+
+   At shutdown, each distinct stack is printed as a "profile:"
+   line, which "backtrace --profile" symbolizes against kernel.o
+   and the user programs and turns into folded stacks for flame
+   graph tools. */
+
+/* Frames kept per sample, counting the interrupted EIP. */
+#define PROFILE_DEPTH 8
+
+/* Number of distinct stacks kept.  Must be a power of 2. */
+#define PROFILE_SLOTS 1024
+
+/* What a sample is counted by. */
+struct profile_key
+  {
+    char name[16];                      /* Thread name. */
+    bool user;                          /* Interrupted user code? */
+    uint8_t depth;                      /* Number of PCs. */
+    uintptr_t pc[PROFILE_DEPTH];        /* Innermost frame first. */
+  };
+
+struct profile_slot
+  {
+    struct profile_key key;
+    unsigned cnt;                       /* 0 if the slot is free. */
+  };
+
+bool profile_enabled;
+
+/* Protected by profile_lock, since every CPU takes samples in
+   its own timer interrupt.  Once profile_print_stats() has
+   stopped sampling under the lock, they are no longer written. */
+static struct spinlock profile_lock;
+static struct profile_slot *slots;      /* PROFILE_SLOTS slots. */
+static long long sample_cnt;            /* Samples taken. */
+static long long drop_cnt;              /* Samples that found no slot. */
+
+static void walk_kernel_stack (struct profile_key *, const uint32_t *ebp);
+#ifdef USERPROG
+static void walk_user_stack (struct profile_key *, const uint32_t *pd,
+                             const uint32_t *ebp);
+#endif
+
+/* Allocates the sample table, if profiling was asked for. */
+void
+profile_init (void)
+{
+  size_t page_cnt = DIV_ROUND_UP (PROFILE_SLOTS * sizeof *slots, PGSIZE);
+
+  if (!profile_enabled)
+    return;
+
+  slots = palloc_get_multiple (PAL_ZERO, page_cnt);
+  if (slots == NULL)
+    printf ("profile: out of memory, not profiling\n");
+}
+
+/* Takes a sample of the code interrupted by the timer interrupt
+   whose frame is F. */
+void
+profile_sample (const struct intr_frame *f)
+{
+  struct thread *t = thread_current ();
+  struct profile_key key;
+  unsigned i, probe;
+
+  ASSERT (intr_context ());
+
+  if (slots == NULL)
+    return;
+
+  memset (&key, 0, sizeof key);
+  strlcpy (key.name, t->name, sizeof key.name);
+  key.user = (f->cs & 3) != 0;
+  key.pc[key.depth++] = (uintptr_t) f->eip;
+  if (!key.user)
+    walk_kernel_stack (&key, (const uint32_t *) f->ebp);
+#ifdef USERPROG
+  else if (t->pagedir != NULL)
+    walk_user_stack (&key, t->pagedir, (const uint32_t *) f->ebp);
+#endif
+
+  i = hash_bytes (&key, sizeof key);
+  spinlock_acquire (&profile_lock);
+  if (!profile_enabled)
+    {
+      spinlock_release (&profile_lock);
+      return;
+    }
+  sample_cnt++;
+  for (probe = 0; probe < PROFILE_SLOTS; probe++, i++)
+    {
+      struct profile_slot *s = &slots[i % PROFILE_SLOTS];
+      if (s->cnt == 0)
+        s->key = key;
+      else if (memcmp (&s->key, &key, sizeof key))
+        continue;
+      s->cnt++;
+      spinlock_release (&profile_lock);
+      return;
+    }
+  drop_cnt++;
+  spinlock_release (&profile_lock);
+}
+
+/* Adds to KEY the return addresses of the kernel frames that
+   start at EBP, staying within the interrupted thread's stack
+   page. */
+static void
+walk_kernel_stack (struct profile_key *key, const uint32_t *ebp)
+{
+  const void *stack_page = pg_round_down (ebp);
+
+  while (key->depth < PROFILE_DEPTH
+         && is_kernel_vaddr (ebp)
+         && pg_round_down (ebp) == stack_page
+         && pg_ofs (ebp) <= PGSIZE - 2 * sizeof *ebp
+         && ebp[1] != 0)
+    {
+      key->pc[key->depth++] = ebp[1];
+      if ((const uint32_t *) ebp[0] <= ebp)
+        break;
+      ebp = (const uint32_t *) ebp[0];
+    }
+}
+
+#ifdef USERPROG
+/* Adds to KEY the return addresses of the user frames that start
+   at EBP, in page directory PD.  Frames are read through the
+   kernel's mapping of their pages, and the walk stops at the
+   first page that is not present, so it cannot fault. */
+static void
+walk_user_stack (struct profile_key *key, const uint32_t *pd,
+                 const uint32_t *ebp)
+{
+  while (key->depth < PROFILE_DEPTH
+         && is_user_vaddr (ebp)
+         && pg_ofs (ebp) <= PGSIZE - 2 * sizeof *ebp)
+    {
+      const uint32_t *frame = pagedir_get_page ((uint32_t *) pd, ebp);
+
+      if (frame == NULL || frame[1] == 0)
+        break;
+      key->pc[key->depth++] = frame[1];
+      if ((const uint32_t *) frame[0] <= ebp)
+        break;
+      ebp = (const uint32_t *) frame[0];
+    }
+}
+#endif
+
+/* Prints every distinct stack sampled, if profiling. */
+void
+profile_print_stats (void)
+{
+  enum intr_level old_level;
+  size_t i;
+  int j;
+
+  if (slots == NULL)
+    return;
+
+  /* Stop sampling. */
+  old_level = intr_disable ();
+  spinlock_acquire (&profile_lock);
+  profile_enabled = false;
+  spinlock_release (&profile_lock);
+  intr_set_level (old_level);
+
+  printf ("Profile: %lld samples, %lld dropped\n", sample_cnt, drop_cnt);
+  for (i = 0; i < PROFILE_SLOTS; i++)
+    {
+      const struct profile_slot *s = &slots[i];
+
+      if (s->cnt == 0)
+        continue;
+      printf ("profile: %u %s", s->cnt, s->key.user ? "user" : "kernel");
+      for (j = 0; j < s->key.depth; j++)
+        printf (" 0x%08"PRIxPTR, s->key.pc[j]);
+      printf (" -- %s\n", s->key.name);
+    }
+}
@@ -0,0 +1,252 @@
+#include "threads/slab.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Object caches.
+
+   malloc() rounds every request up to a power of 2, so a 40-byte
+   object takes a 64-byte block, and every block of a given size
+   shares one lock no matter what it holds.  A kernel object type
+   that is allocated and freed often gets a cache of its own
+   instead, created once with kmem_cache_create().
+
+   A cache hands out objects of exactly its size (rounded up only
+   to a multiple of a word) from "slabs", pages obtained from the
+   page allocator.  Each slab begins with a header and is then
+   carved into as many objects as fit.  A slab's free objects form
+   a list threaded through the objects themselves, and the cache
+   keeps a list of the slabs that have any free objects, so
+   allocating and freeing take constant time.  A slab whose
+   objects are all free goes back to the page allocator, except
+   that a cache holds on to one such slab so that a burst of
+   allocations and frees does not go to the page allocator every
+   time.
+
+   If a cache has a constructor, it is called on each object once,
+   when its slab is created, not on every allocation, so objects
+   must be freed in their constructed state.  Such objects are not
+   overwritten while free: their free list link goes in an extra
+   word after each one. */
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab0bec
+
+/* An object cache. */
+struct kmem_cache
+  {
+    const char *name;           /* For statistics. */
+    size_t obj_size;            /* Size of each object in bytes. */
+    size_t stride;              /* Distance between objects in bytes. */
+    size_t objs_per_slab;       /* Number of objects in a slab. */
+    void (*ctor) (void *);      /* Constructor, or a null pointer. */
+    struct list partial;        /* Slabs with free objects. */
+    struct lock lock;           /* Lock. */
+
+    /* Statistics. */
+    size_t slab_cnt;            /* Slabs allocated. */
+    size_t in_use;              /* Objects allocated. */
+    size_t peak;                /* Most objects allocated at once. */
+    unsigned long long alloc_cnt; /* Calls to kmem_cache_alloc(). */
+  };
+
+/* Slab, at the start of its page. */
+struct slab
+  {
+    unsigned magic;             /* Always set to SLAB_MAGIC. */
+    struct kmem_cache *cache;   /* Owning cache. */
+    struct list_elem elem;      /* In cache's `partial' if free_cnt > 0. */
+    size_t free_cnt;            /* Number of free objects. */
+    void *free;                 /* First free object. */
+  };
+
+/* Our set of caches. */
+static struct kmem_cache caches[16];
+static size_t cache_cnt;
+
+static struct slab *new_slab (struct kmem_cache *);
+static struct slab *obj_to_slab (void *);
+static void **obj_link (struct kmem_cache *, void *);
+
+/* Creates and returns a cache of SIZE-byte objects named NAME.
+   If CTOR is nonnull, it is called on every object before the
+   object is first allocated.  Caches cannot be destroyed. */
+struct kmem_cache *
+kmem_cache_create (const char *name, size_t size, void (*ctor) (void *))
+{
+  struct kmem_cache *c;
+
+  ASSERT (cache_cnt < sizeof caches / sizeof *caches);
+  c = &caches[cache_cnt++];
+
+  c->name = name;
+  c->obj_size = ROUND_UP (size > 0 ? size : 1, sizeof (void *));
+  c->stride = c->obj_size + (ctor != NULL ? sizeof (void *) : 0);
+  c->objs_per_slab = (PGSIZE - sizeof (struct slab)) / c->stride;
+  ASSERT (c->objs_per_slab > 0);
+  c->ctor = ctor;
+  list_init (&c->partial);
+  lock_init (&c->lock);
+  c->slab_cnt = c->in_use = c->peak = 0;
+  c->alloc_cnt = 0;
+  return c;
+}
+
+/* Obtains and returns a new object from cache C.
+   Returns a null pointer if memory is not available. */
+void *
+kmem_cache_alloc (struct kmem_cache *c)
+{
+  struct slab *s;
+  void *obj;
+
+  lock_acquire (&c->lock);
+
+  /* If no slab has a free object, create a new slab. */
+  if (list_empty (&c->partial))
+    {
+      s = new_slab (c);
+      if (s == NULL)
+        {
+          lock_release (&c->lock);
+          return NULL;
+        }
+      list_push_front (&c->partial, &s->elem);
+    }
+
+  /* Take the first free object of the first slab that has one. */
+  s = list_entry (list_front (&c->partial), struct slab, elem);
+  obj = s->free;
+  s->free = *obj_link (c, obj);
+  if (--s->free_cnt == 0)
+    list_remove (&s->elem);
+
+  c->alloc_cnt++;
+  if (++c->in_use > c->peak)
+    c->peak = c->in_use;
+  lock_release (&c->lock);
+  return obj;
+}
+
+/* Frees OBJ, which must have been allocated from cache C.
+   Does nothing if OBJ is null. */
+void
+kmem_cache_free (struct kmem_cache *c, void *obj)
+{
+  struct slab *s;
+
+  if (obj == NULL)
+    return;
+
+  s = obj_to_slab (obj);
+  ASSERT (s->cache == c);
+
+#ifndef NDEBUG
+  /* Clear the object to help detect use-after-free bugs. */
+  if (c->ctor == NULL)
+    memset (obj, 0xcc, c->obj_size);
+#endif
+
+  lock_acquire (&c->lock);
+
+  /* Put the object on its slab's free list. */
+  *obj_link (c, obj) = s->free;
+  s->free = obj;
+  if (s->free_cnt++ == 0)
+    list_push_front (&c->partial, &s->elem);
+  c->in_use--;
+
+  /* If the slab is now entirely unused and it is not the only slab
+     with free objects, free it. */
+  if (s->free_cnt == c->objs_per_slab
+      && (list_front (&c->partial) != &s->elem
+          || list_back (&c->partial) != &s->elem))
+    {
+      list_remove (&s->elem);
+      c->slab_cnt--;
+      palloc_free_page (s);
+    }
+
+  lock_release (&c->lock);
+}
+
+/* Prints statistics for every cache. */
+void
+kmem_cache_print_stats (void)
+{
+  size_t i;
+
+  for (i = 0; i < cache_cnt; i++)
+    {
+      struct kmem_cache *c = &caches[i];
+
+      lock_acquire (&c->lock);
+      printf ("Slab: %s: %zu of %zu %zu-byte objects in use (peak %zu), "
+              "%zu pages, %llu allocations\n",
+              c->name, c->in_use, c->slab_cnt * c->objs_per_slab,
+              c->obj_size, c->peak, c->slab_cnt, c->alloc_cnt);
+      lock_release (&c->lock);
+    }
+}
+
+/* Allocates a slab for cache C and puts all of its objects on its
+   free list, constructing them if C has a constructor.  Returns
+   the new slab, or a null pointer if memory is not available.
+   C's lock must be held. */
+static struct slab *
+new_slab (struct kmem_cache *c)
+{
+  struct slab *s;
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&c->lock));
+
+  s = palloc_get_page (0);
+  if (s == NULL)
+    return NULL;
+
+  s->magic = SLAB_MAGIC;
+  s->cache = c;
+  s->free_cnt = c->objs_per_slab;
+  s->free = NULL;
+  for (i = c->objs_per_slab; i-- > 0; )
+    {
+      void *obj = (uint8_t *) (s + 1) + i * c->stride;
+      if (c->ctor != NULL)
+        c->ctor (obj);
+      *obj_link (c, obj) = s->free;
+      s->free = obj;
+    }
+  c->slab_cnt++;
+  return s;
+}
+
+/* Returns the slab that object OBJ is inside. */
+static struct slab *
+obj_to_slab (void *obj)
+{
+  struct slab *s = pg_round_down (obj);
+
+  /* Check that the slab is valid. */
+  ASSERT (s != NULL);
+  ASSERT (s->magic == SLAB_MAGIC);
+
+  /* Check that the object is properly aligned for the slab. */
+  ASSERT ((pg_ofs (obj) - sizeof *s) % s->cache->stride == 0);
+
+  return s;
+}
+
+/* Returns the location of the free list link for object OBJ in
+   cache C. */
+static void **
+obj_link (struct kmem_cache *c, void *obj)
+{
+  return (void **) ((uint8_t *) obj + c->stride - sizeof (void *));
+}
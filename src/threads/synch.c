@@ -29,8 +29,46 @@
 #include "threads/synch.h"
 #include <stdio.h>
 #include <string.h>
+#include "devices/timer.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
+
+/* Threads waiting on a semaphore or condition variable are kept
+   in a heap ordered by priority, so that waking the
+   highest-priority waiter takes O(lg n) time.  Waiters of equal
+   priority are woken in the order they started waiting, which is
+   recorded as a sequence number.  Whenever a waiter's priority
+   changes, thread_change_priority() calls
+   synch_priority_changed() to move it to its new place.
+
+   The heaps are protected by synch_lock rather than by the
+   locks they belong to, because priority donation can change a
+   waiter's priority without holding the lock associated with a
+   condition variable.  A waiter goes to sleep with synch_lock
+   held, and thread_block() releases it only once the waiter is
+   marked blocked, so that a wakeup cannot be lost.  Nothing
+   that may switch threads runs with synch_lock held: the
+   functions here that wake a thread release it before checking
+   whether to yield to the woken thread. */
+struct spinlock synch_lock;
+static unsigned next_wait_seq;
+
+static heap_less_func waiter_less;
+static heap_less_func cond_waiter_less;
+static bool seq_before (unsigned a, unsigned b);
+static void sema_wait (struct semaphore *, struct lock *);
+static void sema_signal (struct semaphore *);
+static void lock_set_holder (struct lock *, struct thread *);
+static void lock_waiters_changed (struct lock *);
+static void lockstat_acquired (struct lockstat *, int64_t start);
+static void lockstat_released (struct lockstat *);
+static void rwlock_acquire (struct rwlock *, struct rwlock_hold *,
+                            bool write);
+static void rwlock_release (struct rwlock *, struct rwlock_hold *,
+                            bool write);
+static void rwlock_waiters_changed (struct rwlock *);
 
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
@@ -47,7 +85,7 @@ sema_init (struct semaphore *sema, unsigned value)
   ASSERT (sema != NULL);
 
   sema->value = value;
-  list_init (&sema->waiters);
+  heap_init (&sema->waiters, waiter_less, NULL);
 }
 
 /* Down or "P" operation on a semaphore.  Waits for SEMA's value
@@ -66,13 +104,33 @@ sema_down (struct semaphore *sema)
   ASSERT (!intr_context ());
 
   old_level = intr_disable ();
+  spinlock_acquire (&synch_lock);
+  sema_wait (sema, NULL);
+  spinlock_release (&synch_lock);
+  intr_set_level (old_level);
+}
+
+/* Waits for SEMA's value to become positive and then decrements
+   it.  If LOCK is non-null, SEMA is LOCK's semaphore, and LOCK's
+   holder is told each time a new waiter may raise the priority
+   it must be donated.  synch_lock must be held. */
+static void
+sema_wait (struct semaphore *sema, struct lock *lock)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
   while (sema->value == 0)
     {
-      list_push_back (&sema->waiters, &thread_current ()->elem);
+      struct thread *cur = thread_current ();
+
+      cur->wait_seq = next_wait_seq++;
+      cur->waiting_sema = sema;
+      heap_push (&sema->waiters, &cur->waitelem);
+      if (lock != NULL)
+        lock_waiters_changed (lock);
       thread_block ();
     }
   sema->value--;
-  intr_set_level (old_level);
 }
 
 /* Down or "P" operation on a semaphore, but only if the
@@ -89,6 +147,7 @@ sema_try_down (struct semaphore *sema)
   ASSERT (sema != NULL);
 
   old_level = intr_disable ();
+  spinlock_acquire (&synch_lock);
   if (sema->value > 0)
     {
       sema->value--;
@@ -96,6 +155,7 @@ sema_try_down (struct semaphore *sema)
     }
   else
     success = false;
+  spinlock_release (&synch_lock);
   intr_set_level (old_level);
 
   return success;
@@ -113,19 +173,9 @@ sema_up (struct semaphore *sema)
   ASSERT (sema != NULL);
 
   old_level = intr_disable ();
-
-  if (!list_empty (&sema->waiters))
-    {
-      // 🧵 project1/task2
-      // Because waiters priority can change at any time, we can't
-      // assume the first waiter is the highest, we must find it
-      struct list_elem *e = list_max (&sema->waiters, thread_priority_asc,
-                                      NULL);
-      list_remove (e);
-      thread_unblock (list_entry (e, struct thread, elem));
-    }
-
-  sema->value++;
+  spinlock_acquire (&synch_lock);
+  sema_signal (sema);
+  spinlock_release (&synch_lock);
 
   // 🧵 project1/task2
 
@@ -135,6 +185,27 @@ sema_up (struct semaphore *sema)
   intr_set_level (old_level);
 }
 
+/* Increments SEMA's value and wakes up its highest-priority
+   waiter, if any, without yielding to it.  synch_lock must be
+   held. */
+static void
+sema_signal (struct semaphore *sema)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!heap_empty (&sema->waiters))
+    {
+      // 🧵 project1/task2
+      // Wake up the highest-priority waiter
+      struct thread *t = heap_entry (heap_pop (&sema->waiters),
+                                     struct thread, waitelem);
+      t->waiting_sema = NULL;
+      thread_unblock (t);
+    }
+
+  sema->value++;
+}
+
 static void sema_test_helper (void *sema_);
 
 /* Self-test for semaphores that makes control "ping-pong"
@@ -193,7 +264,9 @@ lock_init (struct lock *lock)
   ASSERT (lock != NULL);
 
   lock->holder = NULL;
+  lock->priority = PRI_MIN - 1;
   sema_init (&lock->semaphore, 1);
+  lock->stat = NULL;
 }
 
 /* Acquires LOCK, sleeping until it becomes available if
@@ -207,67 +280,47 @@ lock_init (struct lock *lock)
 void
 lock_acquire (struct lock *lock)
 {
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  int64_t start = 0;
+  bool contended;
+
   ASSERT (lock != NULL);
   ASSERT (!intr_context ());
   ASSERT (!lock_held_by_current_thread (lock));
 
-  /* 🧵 project1/task3 */
-  if (thread_mlfqs)
-  {
-    // If MLFQS is enabled, we don't need to perform priority donation
-    sema_down (&lock->semaphore);
-    lock->holder = thread_current ();
-    return;
-  }
-
   /* 🧵 project1/task2 */
 
-  struct thread *cur = thread_current ();
-
-  if (lock->holder == NULL)
-    {
-      // No holder, we can acquire and forget
-      ASSERT (sema_try_down (&lock->semaphore));
-      cur->waiting_for = NULL;
-      lock->holder = cur;
-      return;
-    }
-
-  // There's a holder, so we may perform priority donation
-
-  // We recursively donate our priority to the holder and whoever
-  // thread is locking the holder's lock (nested donation)
-
-  struct lock *current_lock = lock;
-  bool donated = false;
+  // The holder and donation chain must not change under us, even
+  // while another CPU releases or acquires one of its locks
+  old_level = intr_disable ();
+  spinlock_acquire (&synch_lock);
 
-  do
+  contended = lock->semaphore.value == 0;
+  if (contended)
+    trace_record (TRACE_LOCK_WAIT, (uintptr_t) lock, 0);
+  if (lock->stat != NULL)
     {
-      struct thread *lock_holder = current_lock->holder;
-
-      if (lock_holder->priority >= thread_get_priority ())
-        break;
-
-      // If our priority is higher than the holder's, then
-      // we donate our priority, so he can finish his work faster!
-      lock_holder->priority = thread_get_priority ();
-      donated = true;
-
-      // And try to recursively check its lock
-      current_lock = lock_holder->waiting_for;
+      start = timer_ns ();
+      if (contended)
+        lock->stat->contended_cnt++;
     }
-  while (current_lock != NULL && current_lock->holder != NULL);
-
-  if (donated)
-    list_insert_ordered (&lock->holder->donors, &cur->donorelem,
-                          thread_priority_desc, NULL);
 
+  // While we wait, our priority is donated to the holder, and from
+  // it on down the chain of locks the holders are waiting for
+  // (nested donation).  See lock_waiters_changed().
   cur->waiting_for = lock;
-  sema_down (&lock->semaphore);
+  sema_wait (&lock->semaphore, lock);
 
   // If we reach here it means we've acquired the lock!
   cur->waiting_for = NULL;
-  lock->holder = cur;
+  lock_set_holder (lock, cur);
+  if (contended)
+    trace_record (TRACE_LOCK_ACQUIRED, (uintptr_t) lock, 0);
+  if (lock->stat != NULL)
+    lockstat_acquired (lock->stat, start);
+  spinlock_release (&synch_lock);
+  intr_set_level (old_level);
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -279,14 +332,24 @@ lock_acquire (struct lock *lock)
 bool
 lock_try_acquire (struct lock *lock)
 {
+  enum intr_level old_level;
   bool success;
 
   ASSERT (lock != NULL);
   ASSERT (!lock_held_by_current_thread (lock));
 
-  success = sema_try_down (&lock->semaphore);
+  old_level = intr_disable ();
+  spinlock_acquire (&synch_lock);
+  success = lock->semaphore.value > 0;
   if (success)
-    lock->holder = thread_current ();
+    {
+      lock->semaphore.value--;
+      lock_set_holder (lock, thread_current ());
+      if (lock->stat != NULL)
+        lockstat_acquired (lock->stat, timer_ns ());
+    }
+  spinlock_release (&synch_lock);
+  intr_set_level (old_level);
   return success;
 }
 
@@ -298,39 +361,88 @@ lock_try_acquire (struct lock *lock)
 void
 lock_release (struct lock *lock)
 {
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
   ASSERT (lock != NULL);
   ASSERT (lock_held_by_current_thread (lock));
 
-  lock->holder = NULL;
+  old_level = intr_disable ();
+  spinlock_acquire (&synch_lock);
+
+  if (lock->stat != NULL)
+    lockstat_released (lock->stat);
 
   /* 🧵 project1/task2 */
 
-  // We are releasing! But before we call sema_up and notify
-  // the waiters, we update our donors list
+  // We are releasing! But before we signal the semaphore and notify
+  // the waiters, we stop taking donations through this lock
+  heap_remove (&cur->held_locks, &lock->elem);
+  lock->holder = NULL;
   if (!thread_mlfqs) // 🧵 project1/task3: Only if MLFQS is not enabled...
-    {
-      struct thread *cur = thread_current ();
-      struct list_elem *e = list_begin (&cur->donors);
+    thread_recalculate_priority (cur);
 
-      while (e != list_end (&cur->donors))
-        {
-          struct thread *donor = list_entry (e, struct thread, donorelem);
-
-          // If a donor was waiting for this lock, remove it
-          if (donor->waiting_for == lock)
-            {
-              donor->waiting_for = NULL;
-              e = list_remove (e);
-            }
-          else
-            e = list_next (e);
-        }
+  sema_signal (&lock->semaphore);
+  spinlock_release (&synch_lock);
+  thread_sust ();
+  intr_set_level (old_level);
+}
+
+/* Makes T, which just acquired LOCK, its holder, and has T take
+   donations from LOCK's remaining waiters.  synch_lock must be
+   held. */
+static void
+lock_set_holder (struct lock *lock, struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  lock->holder = t;
+  lock->priority = PRI_MIN - 1;
+  heap_push (&t->held_locks, &lock->elem);
+  lock_waiters_changed (lock);
+}
 
-      // Our donor may've been released, so we need to recalculate
-      thread_recalculate_priority (cur);
+/* Updates LOCK's cached highest waiter priority after its waiters
+   or their priorities changed.  If it changed, LOCK is moved to
+   its place among its holder's locks and the holder's priority is
+   recalculated.  If that changes the holder's priority while it
+   waits for another lock, thread_change_priority() calls
+   synch_priority_changed(), which brings us back here for that
+   lock, so donation follows the chain only as far as it actually
+   changes anything.  synch_lock must be held. */
+static void
+lock_waiters_changed (struct lock *lock)
+{
+  struct heap *waiters = &lock->semaphore.waiters;
+  int priority = PRI_MIN - 1;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!heap_empty (waiters))
+    priority = heap_entry (heap_top (waiters), struct thread,
+                           waitelem)->priority;
+  if (priority == lock->priority)
+    return;
+
+  lock->priority = priority;
+  if (lock->holder != NULL)
+    {
+      heap_update (&lock->holder->held_locks, &lock->elem);
+      if (!thread_mlfqs)
+        thread_recalculate_priority (lock->holder);
     }
+}
 
-  sema_up (&lock->semaphore);
+/* Orders the locks a thread holds by the highest priority among
+   their waiters. */
+bool
+lock_priority_less (const struct heap_elem *a_, const struct heap_elem *b_,
+                    void *aux UNUSED)
+{
+  const struct lock *a = heap_entry (a_, struct lock, elem);
+  const struct lock *b = heap_entry (b_, struct lock, elem);
+
+  return a->priority < b->priority;
 }
 
 /* Returns true if the current thread holds LOCK, false
@@ -344,13 +456,146 @@ lock_held_by_current_thread (const struct lock *lock)
   return lock->holder == thread_current ();
 }
 
-/* One semaphore in a list. */
+/* Lock statistics are kept if true.  Set by the -lockstat
+   kernel option. */
+bool lockstat_enabled;
+
+/* All registered lockstats.  Added to under synch_lock. */
+static struct list lockstats = LIST_INITIALIZER (lockstats);
+
+/* Starts keeping statistics for LOCK, which must be initialized
+   and not held, under NAME, which must stay valid, if
+   lockstat_enabled is true.  Does nothing otherwise, or if memory
+   is short. */
+void
+lockstat_register (struct lock *lock, const char *name)
+{
+  struct lockstat *stat;
+  enum intr_level old_level;
+
+  ASSERT (lock != NULL);
+  ASSERT (lock->holder == NULL);
+
+  if (!lockstat_enabled)
+    return;
+  stat = calloc (1, sizeof *stat);
+  if (stat == NULL)
+    return;
+  stat->name = name;
+
+  old_level = intr_disable ();
+  spinlock_acquire (&synch_lock);
+  list_push_back (&lockstats, &stat->elem);
+  lock->stat = stat;
+  spinlock_release (&synch_lock);
+  intr_set_level (old_level);
+}
+
+/* Records an acquisition of STAT's lock by a thread that started
+   trying at time START.  synch_lock must be held. */
+static void
+lockstat_acquired (struct lockstat *stat, int64_t start)
+{
+  int64_t now = timer_ns ();
+  int64_t wait = now - start;
+
+  stat->acquire_cnt++;
+  stat->wait_time += wait;
+  if (wait > stat->wait_max)
+    stat->wait_max = wait;
+  stat->acquired_at = now;
+}
+
+/* Records the release of STAT's lock.  synch_lock must be
+   held. */
+static void
+lockstat_released (struct lockstat *stat)
+{
+  int64_t hold = timer_ns () - stat->acquired_at;
+
+  stat->hold_time += hold;
+  if (hold > stat->hold_max)
+    stat->hold_max = hold;
+}
+
+/* Prints lock statistics, if they are being kept. */
+void
+lockstat_print_stats (void)
+{
+  struct list_elem *e;
+
+  if (!lockstat_enabled)
+    return;
+  for (e = list_begin (&lockstats); e != list_end (&lockstats);
+       e = list_next (e))
+    {
+      struct lockstat *s = list_entry (e, struct lockstat, elem);
+
+      printf ("Lock %s: %llu acquisitions, %llu contended, "
+              "wait %lld ns (max %lld), hold %lld ns (max %lld)\n",
+              s->name, s->acquire_cnt, s->contended_cnt,
+              s->wait_time, s->wait_max, s->hold_time, s->hold_max);
+    }
+}
+
+/* Initializes spinlock LOCK, which starts out free. */
+void
+spinlock_init (struct spinlock *lock)
+{
+  ASSERT (lock != NULL);
+
+  lock->locked = 0;
+}
+
+/* Acquires LOCK, spinning until it is free. */
+void
+spinlock_acquire (struct spinlock *lock)
+{
+  ASSERT (lock != NULL);
+
+  while (!spinlock_try_acquire (lock))
+    while (lock->locked)
+      asm volatile ("pause");
+}
+
+/* Tries to acquire LOCK and returns true if successful or false
+   on failure.  Never spins. */
+bool
+spinlock_try_acquire (struct spinlock *lock)
+{
+  int old = 1;
+
+  ASSERT (lock != NULL);
+
+  /* XCHG with a memory operand is atomic and a full memory
+     barrier.  See [IA32-v2b] "XCHG". */
+  asm volatile ("xchgl %0, %1" : "+r" (old), "+m" (lock->locked)
+                : : "memory");
+  return old == 0;
+}
+
+/* Releases LOCK, which must be held by the caller. */
+void
+spinlock_release (struct spinlock *lock)
+{
+  ASSERT (lock != NULL);
+  ASSERT (lock->locked);
+
+  barrier ();
+  lock->locked = 0;
+}
+
+/* One semaphore in a condition variable's heap of waiters. */
 struct semaphore_elem
   {
-    struct list_elem elem;              /* List element. */
+    struct heap_elem elem;              /* Heap element. */
     struct semaphore semaphore;         /* This semaphore. */
+    struct thread *thread;              /* Thread waiting on it. */
+    unsigned seq;                       /* Sequence number. */
   };
 
+static heap_action_func cond_detach;
+
 /* Initializes condition variable COND.  A condition variable
    allows one piece of code to signal a condition and cooperating
    code to receive the signal and act upon it. */
@@ -359,7 +604,7 @@ cond_init (struct condition *cond)
 {
   ASSERT (cond != NULL);
 
-  list_init (&cond->waiters);
+  heap_init (&cond->waiters, cond_waiter_less, NULL);
 }
 
 /* Atomically releases LOCK and waits for COND to be signaled by
@@ -385,7 +630,9 @@ cond_init (struct condition *cond)
 void
 cond_wait (struct condition *cond, struct lock *lock)
 {
+  struct thread *cur = thread_current ();
   struct semaphore_elem waiter;
+  enum intr_level old_level;
 
   ASSERT (cond != NULL);
   ASSERT (lock != NULL);
@@ -393,7 +640,17 @@ cond_wait (struct condition *cond, struct lock *lock)
   ASSERT (lock_held_by_current_thread (lock));
 
   sema_init (&waiter.semaphore, 0);
-  list_push_back (&cond->waiters, &waiter.elem);
+  waiter.thread = cur;
+
+  old_level = intr_disable ();
+  spinlock_acquire (&synch_lock);
+  waiter.seq = next_wait_seq++;
+  cur->waiting_cond = cond;
+  cur->cond_elem = &waiter.elem;
+  heap_push (&cond->waiters, &waiter.elem);
+  spinlock_release (&synch_lock);
+  intr_set_level (old_level);
+
   lock_release (lock);
   sema_down (&waiter.semaphore);
   lock_acquire (lock);
@@ -409,20 +666,26 @@ cond_wait (struct condition *cond, struct lock *lock)
 void
 cond_signal (struct condition *cond, struct lock *lock UNUSED)
 {
+  enum intr_level old_level;
+
   ASSERT (cond != NULL);
   ASSERT (lock != NULL);
   ASSERT (!intr_context ());
   ASSERT (lock_held_by_current_thread (lock));
 
   // 🧵 project1/task2
-  // In order to wake up the highest priority thread, we must sort
-  // the waiters list before signaling
-
-  if (list_empty (&cond->waiters)) return;
-
-  list_sort (&cond->waiters, semaphore_priority_desc, NULL);
-  sema_up (&list_entry (list_pop_front (&cond->waiters),
-                        struct semaphore_elem, elem)->semaphore);
+  // Wake up the highest priority waiter
+  old_level = intr_disable ();
+  spinlock_acquire (&synch_lock);
+  if (!heap_empty (&cond->waiters))
+    {
+      struct heap_elem *e = heap_pop (&cond->waiters);
+      cond_detach (e, NULL);
+      sema_signal (&heap_entry (e, struct semaphore_elem, elem)->semaphore);
+    }
+  spinlock_release (&synch_lock);
+  thread_sust ();
+  intr_set_level (old_level);
 }
 
 /* Wakes up all threads, if any, waiting on COND (protected by
@@ -434,39 +697,361 @@ cond_signal (struct condition *cond, struct lock *lock UNUSED)
 void
 cond_broadcast (struct condition *cond, struct lock *lock)
 {
+  struct heap_elem *woken = NULL;
+  enum intr_level old_level;
+
   ASSERT (cond != NULL);
   ASSERT (lock != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (lock_held_by_current_thread (lock));
+
+  /* Every waiter goes to a run queue, which orders them by
+     priority anyway, so there is no need to pop them one by
+     one.  Yielding to a woken thread waits until all of them
+     are woken. */
+  old_level = intr_disable ();
+  spinlock_acquire (&synch_lock);
+  heap_drain (&cond->waiters, cond_detach, &woken);
+  while (woken != NULL)
+    {
+      struct heap_elem *next = woken->next;
+      sema_signal (&heap_entry (woken, struct semaphore_elem,
+                                elem)->semaphore);
+      woken = next;
+    }
+  spinlock_release (&synch_lock);
+  thread_sust ();
+  intr_set_level (old_level);
+}
+
+/* Notes that the waiter whose element E was just taken out of a
+   condition variable's heap is no longer in it.  If CHAIN_ is
+   non-null, it points to the head of a chain of such elements,
+   linked through their `next' members, and E is added to it. */
+static void
+cond_detach (struct heap_elem *e, void *chain_)
+{
+  struct semaphore_elem *waiter = heap_entry (e, struct semaphore_elem, elem);
+  struct heap_elem **chain = chain_;
+
+  waiter->thread->waiting_cond = NULL;
+  waiter->thread->cond_elem = NULL;
+  if (chain != NULL)
+    {
+      e->next = *chain;
+      *chain = e;
+    }
+}
+
+/* Initializes readers-writer lock RW, which is initially free. */
+void
+rwlock_init (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  list_init (&rw->holders);
+  rw->readers = 0;
+  rw->writer = NULL;
+  heap_init (&rw->read_waiters, waiter_less, NULL);
+  heap_init (&rw->write_waiters, waiter_less, NULL);
+  rw->priority = PRI_MIN - 1;
+}
+
+/* Acquires RW shared, sleeping until no thread holds it
+   exclusive or is waiting to.  RW must not already be held by
+   the current thread, in either mode: with a writer waiting, a
+   second read acquisition would deadlock.  HOLD records the
+   acquisition and must stay in place until the matching
+   rwlock_release_read().
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_acquire_read (struct rwlock *rw, struct rwlock_hold *hold)
+{
+  rwlock_acquire (rw, hold, false);
+}
+
+/* Releases RW, which the current thread must hold shared, as
+   recorded in HOLD. */
+void
+rwlock_release_read (struct rwlock *rw, struct rwlock_hold *hold)
+{
+  rwlock_release (rw, hold, false);
+}
+
+/* Acquires RW exclusive, sleeping until no thread holds it.  RW
+   must not already be held by the current thread.  HOLD records
+   the acquisition and must stay in place until the matching
+   rwlock_release_write().
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_acquire_write (struct rwlock *rw, struct rwlock_hold *hold)
+{
+  rwlock_acquire (rw, hold, true);
+}
 
-  while (!list_empty (&cond->waiters))
-    cond_signal (cond, lock);
+/* Releases RW, which the current thread must hold exclusive, as
+   recorded in HOLD. */
+void
+rwlock_release_write (struct rwlock *rw, struct rwlock_hold *hold)
+{
+  rwlock_release (rw, hold, true);
 }
 
-/* 🧵 project1/task2
-   Comparator function used by cond_wait to insert semaphores into
-   the waiters list */
+/* Returns true if the current thread holds RW, in either mode,
+   false otherwise. */
 bool
-semaphore_priority_desc (const struct list_elem *a, const struct list_elem *b,
-                        void *aux UNUSED)
+rwlock_held_by_current_thread (const struct rwlock *rw)
+{
+  struct thread *cur = thread_current ();
+  struct list_elem *e;
+
+  ASSERT (rw != NULL);
+
+  for (e = list_begin (&cur->rwlock_holds);
+       e != list_end (&cur->rwlock_holds); e = list_next (e))
+    {
+      struct rwlock_hold *hold = list_entry (e, struct rwlock_hold,
+                                             threadelem);
+      if (hold->rwlock == rw && hold->held)
+        return true;
+    }
+  return false;
+}
+
+/* Makes HOLD's thread a holder of HOLD's rwlock.  synch_lock
+   must be held. */
+static void
+rwlock_grant (struct rwlock_hold *hold)
+{
+  struct rwlock *rw = hold->rwlock;
+
+  hold->held = true;
+  list_push_back (&rw->holders, &hold->elem);
+  if (hold->write)
+    rw->writer = hold->thread;
+  else
+    rw->readers++;
+}
+
+/* Recalculates the priority of each of RW's holders, after RW's
+   highest waiter priority or its set of holders changed.
+   synch_lock must be held. */
+static void
+rwlock_donate (struct rwlock *rw)
+{
+  struct list_elem *e;
+
+  if (thread_mlfqs)
+    return;
+  for (e = list_begin (&rw->holders); e != list_end (&rw->holders);
+       e = list_next (e))
+    thread_recalculate_priority (list_entry (e, struct rwlock_hold,
+                                             elem)->thread);
+}
+
+/* Returns the highest priority among RW's waiters, or PRI_MIN -
+   1 if there are none. */
+static int
+rwlock_waiter_priority (struct rwlock *rw)
+{
+  int priority = PRI_MIN - 1;
+
+  if (!heap_empty (&rw->read_waiters))
+    priority = heap_entry (heap_top (&rw->read_waiters), struct thread,
+                           waitelem)->priority;
+  if (!heap_empty (&rw->write_waiters))
+    {
+      int p = heap_entry (heap_top (&rw->write_waiters), struct thread,
+                          waitelem)->priority;
+      if (p > priority)
+        priority = p;
+    }
+  return priority;
+}
+
+/* Updates RW's cached highest waiter priority after its waiters
+   or their priorities changed, donating it to every holder if it
+   changed.  synch_lock must be held. */
+static void
+rwlock_waiters_changed (struct rwlock *rw)
+{
+  int priority = rwlock_waiter_priority (rw);
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (priority == rw->priority)
+    return;
+  rw->priority = priority;
+  rwlock_donate (rw);
+}
+
+/* Acquires RW, exclusive if WRITE is true, shared otherwise,
+   recording the acquisition in HOLD.  The rwlock is handed over
+   by the releasing thread, so there is nothing to recheck on
+   wakeup. */
+static void
+rwlock_acquire (struct rwlock *rw, struct rwlock_hold *hold, bool write)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  bool available;
+
+  ASSERT (rw != NULL);
+  ASSERT (hold != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (!rwlock_held_by_current_thread (rw));
+
+  hold->rwlock = rw;
+  hold->thread = cur;
+  hold->write = write;
+  hold->held = false;
+
+  old_level = intr_disable ();
+  spinlock_acquire (&synch_lock);
+  list_push_back (&cur->rwlock_holds, &hold->threadelem);
+  if (write)
+    available = rw->writer == NULL && rw->readers == 0;
+  else
+    available = rw->writer == NULL && heap_empty (&rw->write_waiters);
+
+  /* If RW is free for us, nobody is waiting for it, so there is
+     no donation to take. */
+  if (available)
+    rwlock_grant (hold);
+  else
+    {
+      cur->wait_seq = next_wait_seq++;
+      cur->waiting_rwlock = hold;
+      heap_push (write ? &rw->write_waiters : &rw->read_waiters,
+                 &cur->waitelem);
+      rwlock_waiters_changed (rw);
+      thread_block ();
+      ASSERT (hold->held);
+    }
+  spinlock_release (&synch_lock);
+  intr_set_level (old_level);
+}
+
+/* Releases RW, which the current thread must hold exclusive if
+   WRITE is true, shared otherwise, as recorded in HOLD.  When the
+   last holder leaves, RW goes to the highest-priority waiting
+   writer, if any, and otherwise to all the waiting readers at
+   once. */
+static void
+rwlock_release (struct rwlock *rw, struct rwlock_hold *hold, bool write)
 {
-  struct semaphore *sa = &list_entry (a, struct semaphore_elem, elem)->semaphore;
-  struct semaphore *sb = &list_entry (b, struct semaphore_elem, elem)->semaphore;
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (rw != NULL);
+  ASSERT (hold != NULL && hold->rwlock == rw && hold->thread == cur);
+  ASSERT (hold->held && hold->write == write);
 
-  int sa_priority = PRI_MIN;
-  int sb_priority = PRI_MIN;
+  old_level = intr_disable ();
+  spinlock_acquire (&synch_lock);
+  list_remove (&hold->elem);
+  list_remove (&hold->threadelem);
+  hold->rwlock = NULL;
+  hold->held = false;
+  if (write)
+    rw->writer = NULL;
+  else
+    rw->readers--;
 
-  if (!list_empty (&sa->waiters))
+  if (rw->writer == NULL && rw->readers == 0)
     {
-      struct thread *ta = list_entry (list_front (&sa->waiters), struct thread,
-                                      elem);
-      sa_priority = ta->priority;
+      struct heap *waiters = (!heap_empty (&rw->write_waiters)
+                              ? &rw->write_waiters : &rw->read_waiters);
+
+      while (!heap_empty (waiters))
+        {
+          struct thread *t = heap_entry (heap_pop (waiters), struct thread,
+                                         waitelem);
+
+          rwlock_grant (t->waiting_rwlock);
+          t->waiting_rwlock = NULL;
+          thread_unblock (t);
+          if (waiters == &rw->write_waiters)
+            break;
+        }
+
+      /* The new holders take donations from whoever is still
+         waiting. */
+      rw->priority = rwlock_waiter_priority (rw);
+      rwlock_donate (rw);
     }
 
-  if (!list_empty (&sb->waiters))
+  if (!thread_mlfqs)
+    thread_recalculate_priority (cur);
+  spinlock_release (&synch_lock);
+  if (!intr_context ())
+    thread_sust ();
+  intr_set_level (old_level);
+}
+
+/* Moves T, whose priority just changed, to its new place among
+   the waiters of the semaphore, condition variable or
+   readers-writer lock it is waiting on, if any.  synch_lock must
+   be held. */
+void
+synch_priority_changed (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (t->waiting_sema != NULL)
+    heap_update (&t->waiting_sema->waiters, &t->waitelem);
+  if (t->waiting_for != NULL)
+    lock_waiters_changed (t->waiting_for);
+  if (t->waiting_cond != NULL)
+    heap_update (&t->waiting_cond->waiters, t->cond_elem);
+  if (t->waiting_rwlock != NULL)
     {
-      struct thread *tb = list_entry (list_front (&sb->waiters), struct thread,
-                                      elem);
-      sb_priority = tb->priority;
+      struct rwlock *rw = t->waiting_rwlock->rwlock;
+
+      heap_update (t->waiting_rwlock->write
+                   ? &rw->write_waiters : &rw->read_waiters, &t->waitelem);
+      rwlock_waiters_changed (rw);
     }
+}
 
-  return sa_priority > sb_priority;
+/* Orders threads waiting on a semaphore: returns true if A
+   should be woken after B. */
+static bool
+waiter_less (const struct heap_elem *a_, const struct heap_elem *b_,
+             void *aux UNUSED)
+{
+  const struct thread *a = heap_entry (a_, struct thread, waitelem);
+  const struct thread *b = heap_entry (b_, struct thread, waitelem);
+
+  if (a->priority != b->priority)
+    return a->priority < b->priority;
+  return seq_before (b->wait_seq, a->wait_seq);
+}
+
+/* Orders the waiters of a condition variable: returns true if A
+   should be woken after B. */
+static bool
+cond_waiter_less (const struct heap_elem *a_, const struct heap_elem *b_,
+                  void *aux UNUSED)
+{
+  const struct semaphore_elem *a = heap_entry (a_, struct semaphore_elem,
+                                               elem);
+  const struct semaphore_elem *b = heap_entry (b_, struct semaphore_elem,
+                                               elem);
+
+  if (a->thread->priority != b->thread->priority)
+    return a->thread->priority < b->thread->priority;
+  return seq_before (b->seq, a->seq);
+}
+
+/* Returns true if sequence number A was issued before B, allowing
+   for wraparound. */
+static bool
+seq_before (unsigned a, unsigned b)
+{
+  return (int) (a - b) < 0;
 }
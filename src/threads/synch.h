@@ -1,14 +1,18 @@
 #ifndef THREADS_SYNCH_H
 #define THREADS_SYNCH_H
 
+#include <heap.h>
 #include <list.h>
 #include <stdbool.h>
+#include <stdint.h>
+
+struct thread;
 
 /* A counting semaphore. */
 struct semaphore
   {
     unsigned value;             /* Current value. */
-    struct list waiters;        /* List of waiting threads. */
+    struct heap waiters;        /* Waiting threads, by priority. */
   };
 
 void sema_init (struct semaphore *, unsigned value);
@@ -22,6 +26,13 @@ struct lock
   {
     struct thread *holder;      /* Thread holding lock (for debugging). */
     struct semaphore semaphore; /* Binary semaphore controlling access. */
+
+    /* 🧵 project1/task2 */
+    struct heap_elem elem;      /* Element in holder's held_locks. */
+    int priority;               /* Highest priority among waiters,
+                                   or PRI_MIN - 1 if none. */
+
+    struct lockstat *stat;      /* Statistics, or null. */
   };
 
 void lock_init (struct lock *);
@@ -29,11 +40,56 @@ void lock_acquire (struct lock *);
 bool lock_try_acquire (struct lock *);
 void lock_release (struct lock *);
 bool lock_held_by_current_thread (const struct lock *);
+bool lock_priority_less (const struct heap_elem *, const struct heap_elem *,
+                         void *);
+
+/* Contention statistics for a lock.  Only kept for locks named
+   with lockstat_register(), and only if the kernel was started
+   with -lockstat; otherwise a lock's `stat' is null and costs
+   nothing beyond the check.  Times are in nanoseconds. */
+struct lockstat
+  {
+    struct list_elem elem;      /* Element in list of all lockstats. */
+    const char *name;           /* Lock name. */
+    uint64_t acquire_cnt;       /* # of acquisitions. */
+    uint64_t contended_cnt;     /* # of acquisitions that had to wait. */
+    int64_t wait_time;          /* Total time spent waiting. */
+    int64_t wait_max;           /* Longest wait. */
+    int64_t hold_time;          /* Total time held. */
+    int64_t hold_max;           /* Longest hold. */
+    int64_t acquired_at;        /* When last acquired. */
+  };
+
+extern bool lockstat_enabled;
+
+void lockstat_register (struct lock *, const char *name);
+void lockstat_print_stats (void);
+
+/* Spinlock.  Waits by spinning instead of sleeping, so it can
+   protect data shared between CPUs in code that must not sleep.
+   It does not turn interrupts off, so a spinlock that is also
+   taken in an interrupt handler must be held with interrupts
+   off. */
+struct spinlock
+  {
+    volatile int locked;        /* 1 if held, 0 if free. */
+  };
+
+void spinlock_init (struct spinlock *);
+void spinlock_acquire (struct spinlock *);
+bool spinlock_try_acquire (struct spinlock *);
+void spinlock_release (struct spinlock *);
+
+/* Protects the state of every semaphore, lock, condition
+   variable and readers-writer lock, and the members of struct
+   thread that priority donation and the MLFQS change (see
+   thread.h).  Held with interrupts off. */
+extern struct spinlock synch_lock;
 
 /* Condition variable. */
 struct condition
   {
-    struct list waiters;        /* List of waiting threads. */
+    struct heap waiters;        /* Waiting threads, by priority. */
   };
 
 void cond_init (struct condition *);
@@ -41,12 +97,45 @@ void cond_wait (struct condition *, struct lock *);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
-/* 🧵 project1/task2
-   Comparator function used by cond_wait to insert semaphores into
-   the waiters list */
-bool
-semaphore_priority_desc (const struct list_elem *, const struct list_elem *,
-                        void *);
+/* Readers-writer lock.  Any number of threads may hold it
+   shared ("read") at once, or one thread may hold it exclusive
+   ("write").  Writers are preferred: once a writer is waiting,
+   new readers wait behind it, so a steady stream of readers
+   cannot starve writers.  Waiters donate their priority to every
+   current holder. */
+struct rwlock
+  {
+    struct list holders;        /* Holders' rwlock_holds. */
+    int readers;                /* # of threads holding it shared. */
+    struct thread *writer;      /* Thread holding it exclusive, or null. */
+    struct heap read_waiters;   /* Threads waiting to read, by priority. */
+    struct heap write_waiters;  /* Threads waiting to write, by priority. */
+    int priority;               /* Highest priority among waiters,
+                                   or PRI_MIN - 1 if none. */
+  };
+
+/* A thread's hold on, or wait for, a readers-writer lock.  The
+   caller provides one to each acquisition, usually as a local
+   variable, and passes the same one to the matching release, so
+   a thread may hold any number of readers-writer locks. */
+struct rwlock_hold
+  {
+    struct list_elem elem;      /* Element in rwlock's holders. */
+    struct list_elem threadelem; /* Element in thread's rwlock_holds. */
+    struct rwlock *rwlock;      /* Readers-writer lock. */
+    struct thread *thread;      /* Thread holding or waiting. */
+    bool write;                 /* Exclusive? */
+    bool held;                  /* Granted yet? */
+  };
+
+void rwlock_init (struct rwlock *);
+void rwlock_acquire_read (struct rwlock *, struct rwlock_hold *);
+void rwlock_release_read (struct rwlock *, struct rwlock_hold *);
+void rwlock_acquire_write (struct rwlock *, struct rwlock_hold *);
+void rwlock_release_write (struct rwlock *, struct rwlock_hold *);
+bool rwlock_held_by_current_thread (const struct rwlock *);
+
+void synch_priority_changed (struct thread *);
 
 /* Optimization barrier.
 
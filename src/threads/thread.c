@@ -1,18 +1,26 @@
 #include "threads/thread.h"
 #include <debug.h>
 #include <stddef.h>
+#include <inttypes.h>
 #include <random.h>
+#include <schedstat.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/cpu.h"
 #include "threads/flags.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
 #include "threads/palloc.h"
+#include "threads/slab.h"
 #include "threads/switch.h"
 #include "threads/synch.h"
+#include "threads/trace.h"
 #include "threads/vaddr.h"
+#include "threads/workqueue.h"
 #include "threads/fixed_point.h" // 🧵 project1/task3
+#include "devices/timer.h"
 #ifdef USERPROG
+#include "userprog/fpu.h"
 #include "userprog/process.h"
 #endif
 #include "filesys/file.h"
@@ -23,29 +31,51 @@
    of thread.h for details. */
 #define THREAD_MAGIC 0xcd6abf4b
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
-
-/* 🧵 project1/task1
-   List of all currently-sleeping threads ordered by [wakeup_tick]
-   ascending. Processes in this list are in THREAD_BLOCKED state,
-   waiting to be woken up by the timer interrupt handler. */
-static struct list sleep_list;
+/* Processes in THREAD_READY state wait in the run queue of a
+   CPU, in that CPU's struct cpu (see cpu.h).  A thread's `rq_cpu'
+   member is the CPU whose run queue it is in, and its `cpu'
+   member the CPU that it is running on or last ran on.
+
+   A thread that wakes up goes back to the CPU it last ran on, as
+   long as that CPU is not much busier than the others, since its
+   cache may still hold the thread's working set.  A CPU whose
+   run queue runs dry steals a thread from the busiest one.
+
+   Each run queue has its own spinlock, and a thread's status
+   changes only with the lock of the run queue involved held: the
+   waker's target queue for BLOCKED to READY, the thread's own
+   CPU's queue for RUNNING to anything else, and the queue it is
+   taken from for READY to RUNNING.  Waking a thread or blocking
+   one also requires synch_lock, and so does making the running
+   thread ready, so that thread_change_priority() can tell
+   whether a thread is queued.  Locks are taken in this order:
+   all_lock, synch_lock, a run queue's lock, and then any of the
+   other spinlocks below, none of which is held while taking
+   another.  A CPU holds at most its own run queue's lock, plus
+   a victim's while stealing, which it only tries to take.
+
+   A thread stays marked `on_cpu' until the CPU it ran on has
+   switched away from it, so that another CPU that picks it from
+   a run queue in the meantime waits rather than running it on
+   the same stack. */
+
+/* A waking thread stays with the CPU it last ran on unless that
+   CPU has more than AFFINITY_SLACK more ready threads than the
+   least loaded CPU. */
+#define AFFINITY_SLACK 1
+#if PRI_MAX >= 64
+#error the run queue bitmap holds at most 64 priority levels
+#endif
 
 /* List of all processes.  Processes are added to this list
-   when they are first scheduled and removed when they exit. */
+   when they are first scheduled and removed when they exit.
+   Protected by all_lock. */
 static struct list all_list;
-
-/* Idle thread. */
-static struct thread *idle_thread;
+static struct spinlock all_lock;
 
 /* Initial thread, the thread running init.c:main(). */
 static struct thread *initial_thread;
 
-/* Lock used by allocate_tid(). */
-static struct lock tid_lock;
-
 /* Stack frame for kernel_thread(). */
 struct kernel_thread_frame
   {
@@ -54,39 +84,158 @@ struct kernel_thread_frame
     void *aux;                  /* Auxiliary data for function. */
   };
 
-/* Statistics. */
-static long long idle_ticks;    /* # of timer ticks spent idle. */
-static long long kernel_ticks;  /* # of timer ticks in kernel threads. */
-static long long user_ticks;    /* # of timer ticks in user programs. */
+/* Pages of dead threads, kept for reuse by thread_create().  A
+   cached page skips palloc_get_page()'s bitmap scan, and it is
+   not zeroed: init_thread() clears the struct thread and
+   thread_create() writes the stack frames it needs, and nothing
+   else on a new thread's page is read before it is written.
+   Protected by thread_cache_lock. */
+#define THREAD_CACHE_SIZE 16
+static struct spinlock thread_cache_lock;
+static struct thread *thread_cache[THREAD_CACHE_SIZE];
+static size_t thread_cache_cnt;
+static long long thread_cache_hits;   /* # of pages taken from the cache. */
+static long long thread_cache_misses; /* # of pages from palloc_get_page(). */
+
+/* Scheduler latency histograms.  Timestamps come from
+   timer_cycles() and are converted to nanoseconds only when a
+   sample is recorded.  Protected by schedstat_lock. */
+static struct schedstat schedstat;
+static struct spinlock schedstat_lock;
+
+#if (PRI_MAX + 1) % SCHEDSTAT_BANDS != 0
+#error SCHEDSTAT_BANDS must divide the number of priorities evenly
+#endif
 
 /* Scheduling. */
 #define TIME_SLICE 4            /* # of timer ticks to give each thread. */
-static unsigned thread_ticks;   /* # of timer ticks since last yield. */
 
 /* If false (default), use round-robin scheduler.
    If true, use multi-level feedback queue scheduler.
    Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
+
+/* Cache that PCBs are allocated from. */
+struct kmem_cache *pcb_cache;
+
+/* Completely fair scheduler.
+
+   Each thread accumulates virtual runtime while it runs, at a
+   rate inversely proportional to its weight, and the ready
+   thread with the least virtual runtime runs next.  Over time,
+   each thread gets CPU time in proportion to its weight, which
+   comes from its nice value: every nice level is worth about
+   10% of CPU time relative to its neighbours.
+
+   Instead of a fixed TIME_SLICE, CFS_LATENCY ticks are divided
+   among the runnable threads in proportion to their weights, so
+   that each of them runs at least once per CFS_LATENCY ticks when
+   there are few of them.  Priorities and priority donation are
+   ignored. */
+bool thread_cfs;
+
+#define CFS_LATENCY 8           /* Target latency, in timer ticks. */
+#define CFS_MIN_SLICE 1         /* Shortest time slice, in timer ticks. */
+#define CFS_TICK_NS (1000000000 / TIMER_FREQ)
+
+/* A woken thread preempts the running thread only if its virtual
+   runtime is less by more than this, in ns, to limit switching. */
+#define CFS_WAKEUP_GRANULARITY CFS_TICK_NS
+
+/* A thread that slept is placed at most this far, in ns, behind
+   the least virtual runtime on its run queue, so that it gets to
+   run soon but cannot bank its sleep to monopolize the CPU. */
+#define CFS_SLEEPER_CREDIT ((uint64_t) CFS_LATENCY * CFS_TICK_NS / 2)
+
+/* Weight of a thread with nice 0. */
+#define CFS_NICE_0_WEIGHT 1024
+
+/* Weights for nice values NICE_MIN (-20) through NICE_MAX (20).
+   Each is about 1.25 times the next. */
+static const unsigned cfs_weights[] =
+  {
+    /* -20 */ 88761, 71755, 56483, 46273, 36291,
+    /* -15 */ 29154, 23254, 18705, 14949, 11916,
+    /* -10 */ 9548, 7620, 6100, 4904, 3906,
+    /*  -5 */ 3121, 2501, 1991, 1586, 1277,
+    /*   0 */ 1024, 820, 655, 526, 423,
+    /*   5 */ 335, 272, 215, 172, 137,
+    /*  10 */ 110, 87, 70, 56, 45,
+    /*  15 */ 36, 29, 23, 18, 15,
+    /*  20 */ 12,
+  };
 int load_avg; // 🧵 project1/task3
 
+/* 🧵 project1/task3
+   The once-per-second recent_cpu decay is applied lazily.  Each
+   second closes an "epoch" and records its decay coefficient
+   (2 * load_avg) / (2 * load_avg + 1) in decay_coef[]; a thread
+   remembers the epoch its recent_cpu is current for and replays
+   the coefficients it missed when it is next examined.  Decays
+   older than MLFQS_DECAY_HISTORY seconds have shrunk the old
+   recent_cpu to noise, so they are not kept.  Both are
+   protected by synch_lock. */
+#define MLFQS_DECAY_HISTORY 256
+static int decay_coef[MLFQS_DECAY_HISTORY];
+static unsigned mlfqs_epoch;
+
+/* 🧵 project1/task3
+   Threads that nobody examines (e.g. sitting in the run queue)
+   are caught up once a second, after each decay, by a sweep of
+   all_list that runs on the system workqueue rather than in the
+   timer interrupt.  The sweep holds all_lock and synch_lock for
+   MLFQS_SWEEP_BATCH threads at a time; mlfqs_sweep_cursor, which
+   all_lock protects, is the next thread to visit, or null
+   between sweeps. */
+#define MLFQS_SWEEP_BATCH 32
+static struct list_elem *mlfqs_sweep_cursor;
+static struct work mlfqs_sweep_work;
+static work_func mlfqs_sweep;
+
 static void kernel_thread (thread_func *, void *aux);
 
 static void idle (void *aux UNUSED);
+static void idle_loop (void) NO_RETURN;
+static bool is_idle_thread (const struct thread *);
 static struct thread *running_thread (void);
-static struct thread *next_thread_to_run (void);
+static struct thread *next_thread_to_run (struct cpu *);
 static void init_thread (struct thread *, const char *name, int priority);
 static bool is_thread (struct thread *) UNUSED;
 static void *alloc_frame (struct thread *, size_t size);
+static struct thread *alloc_thread_page (void);
+static void schedstat_record (uint32_t hist[SCHEDSTAT_BUCKETS],
+                              uint64_t cycles);
+static void schedstat_donation (struct thread *);
+static void print_histogram (const char *label,
+                             const uint32_t hist[SCHEDSTAT_BUCKETS]);
+static void free_thread_page (struct thread *);
 static void schedule (void);
 void thread_schedule_tail (struct thread *prev);
 static tid_t allocate_tid (void);
+static struct cpu *select_cpu (struct thread *);
+static bool cpu_is_idle (const struct cpu *);
+static bool steal_thread (struct cpu *);
+static void preempt_check (struct cpu *, const struct thread *);
+static void ready_queue_push (struct cpu *, struct thread *);
+static void ready_queue_remove (struct thread *);
+static void ready_queue_lag (struct cpu *, struct thread *,
+                             uint64_t from_min_vruntime);
+static int ready_queue_max_priority (const struct runqueue *);
+static struct thread *ready_queue_front (struct runqueue *);
+static bool preempts (const struct thread *, const struct thread *);
+static rbtree_less_func cfs_less;
+static void cfs_place (struct cpu *, struct thread *);
+static void cfs_tick (struct cpu *, struct thread *);
+static unsigned cfs_slice (const struct cpu *, const struct thread *);
+static void mlfqs_catch_up (struct thread *);
+static void thread_wakeup (void *t);
 
 /* Initializes the threading system by transforming the code
    that's currently running into a thread.  This can't work in
    general and it is possible in this case only because loader.S
    was careful to put the bottom of the stack at a page boundary.
 
-   Also initializes the run queue and the tid lock.
+   Also initializes the run queues.
 
    After calling this function, be sure to initialize the page
    allocator before trying to create any threads with
@@ -97,20 +246,37 @@ static tid_t allocate_tid (void);
 void
 thread_init (void)
 {
+  int c, i;
+
   ASSERT (intr_get_level () == INTR_OFF);
 
-  lock_init (&tid_lock);
-  list_init (&ready_list);
+  for (c = 0; c < CPU_MAX; c++)
+    {
+      for (i = PRI_MIN; i <= PRI_MAX; i++)
+        list_init (&cpus[c].rq.queues[i]);
+      cpus[c].rq.bitmap = 0;
+      cpus[c].rq.cnt = 0;
+      rbtree_init (&cpus[c].rq.cfs_tree, cfs_less, NULL);
+      cpus[c].rq.min_vruntime = 0;
+      cpus[c].rq.cfs_load = 0;
+      spinlock_init (&cpus[c].rq.lock);
+    }
+  spinlock_init (&all_lock);
+  spinlock_init (&thread_cache_lock);
+  spinlock_init (&schedstat_lock);
   list_init (&all_list);
-
-  // 🧵 project1/task1
-  list_init (&sleep_list);
+  work_init (&mlfqs_sweep_work, mlfqs_sweep, NULL);
+  pcb_cache = kmem_cache_create ("pcb", sizeof (struct pcb), NULL);
 
   /* Set up a thread structure for the running thread. */
   initial_thread = running_thread ();
   init_thread (initial_thread, "main", PRI_DEFAULT);
   initial_thread->status = THREAD_RUNNING;
   initial_thread->tid = allocate_tid ();
+  initial_thread->cpu = &cpus[0];
+  initial_thread->on_cpu = true;
+  cpus[0].current = initial_thread;
+  cpus[0].started = true;
 }
 
 /* Starts preemptive thread scheduling by enabling interrupts.
@@ -127,25 +293,37 @@ thread_start (void)
   /* Start preemptive thread scheduling. */
   intr_enable ();
 
-  /* Wait for the idle thread to initialize idle_thread. */
+  /* Wait for the idle thread to initialize its CPU's idle_thread. */
   sema_down (&idle_started);
 }
 
-/* 🧵 project1/task1
-   Comparator function used by thread_sleep to insert threads into
-   the sleep_list */
-bool
-thread_wakeup_tick_less (const struct list_elem *a_, const struct list_elem *b_,
-                         void *aux UNUSED)
+/* Turns the code running on application processor C, on a
+   zeroed page allocated for the purpose, into C's idle thread
+   and starts scheduling threads on C.  Interrupts must be off;
+   they are turned on by the first thread C switches to. */
+void
+thread_start_ap (struct cpu *c)
 {
-  struct thread *a = list_entry (a_, struct thread, elem);
-  struct thread *b = list_entry (b_, struct thread, elem);
-  return a->wakeup_tick < b->wakeup_tick;
+  struct thread *t = running_thread ();
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  init_thread (t, "idle", PRI_MIN);
+  t->status = THREAD_RUNNING;
+  t->tid = allocate_tid ();
+  t->cpu = c;
+  t->on_cpu = true;
+  c->idle_thread = t;
+  c->current = t;
+  c->started = true;
+
+  idle_loop ();
 }
 
 /* 🧵 project1/task1
-   Puts the current thread to sleep until the specified number of ticks
-   has passed. */
+   Puts the current thread to sleep until the timer tick count
+   reaches TICKS.  The wakeup is a kernel timer, so going to sleep
+   costs O(1) no matter how many threads are sleeping. */
 void
 thread_sleep (int64_t ticks)
 {
@@ -153,37 +331,27 @@ thread_sleep (int64_t ticks)
   enum intr_level old_level;
 
   ASSERT (is_thread (cur));
-  ASSERT (cur != idle_thread);
+  ASSERT (!is_idle_thread (cur));
 
   old_level = intr_disable ();
+  spinlock_acquire (&synch_lock);
 
-  cur->wakeup_tick = ticks;
-  list_insert_ordered (&sleep_list, &cur->elem, thread_wakeup_tick_less, NULL);
+  ktimer_arm (&cur->sleep_timer, ticks);
   thread_block ();
 
+  spinlock_release (&synch_lock);
   intr_set_level (old_level);
 }
 
 /* 🧵 project1/task1
-   Wakes up all threads that are scheduled to wake up at or before the
-   specified number of ticks. */
-void
-thread_awake (int64_t ticks)
+   Timer function of a thread's sleep_timer: wakes up the sleeping
+   thread T_. */
+static void
+thread_wakeup (void *t_)
 {
-  struct list_elem *te = list_begin (&sleep_list);
-  struct thread *t;
-
-  while (!list_empty (&sleep_list))
-    {
-      te = list_begin (&sleep_list);
-      t = list_entry (te, struct thread, elem);
-
-      if (t->wakeup_tick > ticks)
-        break;
-
-      list_remove (te);
-      thread_unblock (t);
-    }
+  spinlock_acquire (&synch_lock);
+  thread_unblock (t_);
+  spinlock_release (&synch_lock);
 }
 
 /* Called by the timer interrupt handler at each timer tick.
@@ -192,28 +360,104 @@ void
 thread_tick (void)
 {
   struct thread *t = thread_current ();
+  struct cpu *c = cpu_current ();
 
   /* Update statistics. */
-  if (t == idle_thread)
-    idle_ticks++;
+  if (t == c->idle_thread)
+    c->idle_ticks++;
 #ifdef USERPROG
   else if (t->pagedir != NULL)
-    user_ticks++;
+    c->user_ticks++;
 #endif
   else
-    kernel_ticks++;
+    c->kernel_ticks++;
 
   /* Enforce preemption. */
-  if (++thread_ticks >= TIME_SLICE)
+  if (thread_cfs)
+    {
+      unsigned slice;
+
+      spinlock_acquire (&c->rq.lock);
+      if (t != c->idle_thread)
+        cfs_tick (c, t);
+      slice = cfs_slice (c, t);
+      spinlock_release (&c->rq.lock);
+      if (++c->thread_ticks >= slice)
+        intr_yield_on_return ();
+    }
+  else if (++c->thread_ticks >= TIME_SLICE)
     intr_yield_on_return ();
 }
 
+/* Returns the number of thread pages that thread_create() has
+   taken from the thread page cache. */
+long long
+thread_cache_hit_cnt (void)
+{
+  enum intr_level old_level = intr_disable ();
+  long long hits;
+
+  spinlock_acquire (&thread_cache_lock);
+  hits = thread_cache_hits;
+  spinlock_release (&thread_cache_lock);
+  intr_set_level (old_level);
+
+  return hits;
+}
+
 /* Prints thread statistics. */
 void
 thread_print_stats (void)
 {
+  long long idle_ticks = 0, kernel_ticks = 0, user_ticks = 0;
+  long long steal_cnt = 0, migration_cnt = 0;
+  int i;
+
+  for (i = 0; i < cpu_cnt; i++)
+    {
+      idle_ticks += cpus[i].idle_ticks;
+      kernel_ticks += cpus[i].kernel_ticks;
+      user_ticks += cpus[i].user_ticks;
+      steal_cnt += cpus[i].steal_cnt;
+      migration_cnt += cpus[i].migration_cnt;
+    }
+
   printf ("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
           idle_ticks, kernel_ticks, user_ticks);
+  printf ("Thread: %lld page cache hits, %lld misses\n",
+          thread_cache_hits, thread_cache_misses);
+  if (cpu_cnt > 1)
+    {
+      printf ("Thread: %lld steals, %lld migrations\n",
+              steal_cnt, migration_cnt);
+      for (i = 0; i < cpu_cnt; i++)
+        printf ("Thread: CPU %d: %lld idle ticks\n", i, cpus[i].idle_ticks);
+    }
+  if (timer_tickless)
+    printf ("Thread: %lld idle ticks skipped by tickless idle\n",
+            timer_skipped_ticks ());
+
+  for (i = 0; i < SCHEDSTAT_BANDS; i++)
+    {
+      int band_size = (PRI_MAX + 1) / SCHEDSTAT_BANDS;
+      char label[64];
+
+      snprintf (label, sizeof label, "dispatch latency, priority %d-%d",
+                i * band_size, (i + 1) * band_size - 1);
+      print_histogram (label, schedstat.dispatch[i]);
+    }
+  print_histogram ("donated priority", schedstat.donation);
+}
+
+/* Copies the scheduler latency statistics into STATS. */
+void
+thread_get_schedstat (struct schedstat *stats)
+{
+  enum intr_level old_level = intr_disable ();
+  spinlock_acquire (&schedstat_lock);
+  *stats = schedstat;
+  spinlock_release (&schedstat_lock);
+  intr_set_level (old_level);
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -239,18 +483,20 @@ thread_create (const char *name, int priority,
   struct kernel_thread_frame *kf;
   struct switch_entry_frame *ef;
   struct switch_threads_frame *sf;
+  enum intr_level old_level;
   tid_t tid;
 
   ASSERT (function != NULL);
 
   /* Allocate thread. */
-  t = palloc_get_page (PAL_ZERO);
+  t = alloc_thread_page ();
   if (t == NULL)
     return TID_ERROR;
 
   /* Initialize thread. */
   init_thread (t, name, priority);
   tid = t->tid = allocate_tid ();
+  trace_name (t);
 
   /* Stack frame for kernel_thread(). */
   kf = alloc_frame (t, sizeof *kf);
@@ -271,7 +517,7 @@ thread_create (const char *name, int priority,
   // We define a process hierarchy, where the parent process is the
   // current thread (caller) and the child process is the created thread.
   t->parent_process = thread_current ();
-  t->pcb = palloc_get_page (0);
+  t->pcb = kmem_cache_alloc (pcb_cache);
 
   if (t->pcb == NULL)
     return TID_ERROR;
@@ -281,7 +527,7 @@ thread_create (const char *name, int priority,
   // The list of file descriptors opened by the process
   t->pcb->fd_table = palloc_get_page (PAL_ZERO);
   if (t->pcb->fd_table == NULL) {
-    palloc_free_page (t->pcb);
+    kmem_cache_free (pcb_cache, t->pcb);
     return TID_ERROR;
   }
 
@@ -293,23 +539,28 @@ thread_create (const char *name, int priority,
   t->pcb->has_loaded = false;
   sema_init (&(t->pcb->sema_wait), 0);
   sema_init (&(t->pcb->sema_load), 0);
+  t->pcb->tid = tid;
 
   // And finally we add the child to the parent's child list
-  list_push_back (&(t->parent_process->list_child_process), &(t->elem_child_process));
+  list_push_back (&(t->parent_process->list_child_process), &(t->pcb->elem));
 
   //🧠 project3/vm: initialize the supplemental page table for the new thread
   init_spt (&t->spt);
 
   /* Add to run queue. */
+  old_level = intr_disable ();
+  spinlock_acquire (&synch_lock);
   thread_unblock (t);
+  spinlock_release (&synch_lock);
+  intr_set_level (old_level);
 
   /* 🧵 project1/task2
      When a thread is added to the ready list that has a higher priority than
      the currently running thread, the current thread should immediately yield
-     the processor to the new thread */
+     the processor to the new thread.  T may already be running, or gone, on
+     another CPU, so only our own run queue is looked at. */
 
-  if (t->priority > thread_get_priority ())
-    thread_yield ();
+  thread_sust ();
 
   return tid;
 }
@@ -317,18 +568,27 @@ thread_create (const char *name, int priority,
 /* Puts the current thread to sleep.  It will not be scheduled
    again until awoken by thread_unblock().
 
-   This function must be called with interrupts turned off.  It
-   is usually a better idea to use one of the synchronization
-   primitives in synch.h. */
+   This function must be called with interrupts turned off and
+   synch_lock held.  It releases synch_lock once the thread is
+   marked blocked, so that a waker that takes synch_lock finds it
+   blocked, and takes it again before returning.  It is usually a
+   better idea to use one of the synchronization primitives in
+   synch.h. */
 void
 thread_block (void)
 {
+  struct thread *cur = thread_current ();
+  struct cpu *c = cur->cpu;
 
   ASSERT (!intr_context ());
   ASSERT (intr_get_level () == INTR_OFF);
 
-  thread_current ()->status = THREAD_BLOCKED;
+  spinlock_acquire (&c->rq.lock);
+  cur->status = THREAD_BLOCKED;
+  cur->last_min_vruntime = c->rq.min_vruntime;
+  spinlock_release (&synch_lock);
   schedule ();
+  spinlock_acquire (&synch_lock);
 }
 
 /* Transitions a blocked thread T to the ready-to-run state.
@@ -338,23 +598,40 @@ thread_block (void)
    This function does not preempt the running thread.  This can
    be important: if the caller had disabled interrupts itself,
    it may expect that it can atomically unblock a thread and
-   update other data. */
+   update other data.  Interrupts must be off and synch_lock
+   held. */
 void
 thread_unblock (struct thread *t)
 {
-  enum intr_level old_level;
+  struct cpu *c;
 
   ASSERT (is_thread (t));
-
-  old_level = intr_disable ();
+  ASSERT (intr_get_level () == INTR_OFF);
   ASSERT (t->status == THREAD_BLOCKED);
 
-  // 🧵 project1/task2
-  // insert the thread in the correct position in the ready list
-  list_insert_ordered (&ready_list, &t->elem, thread_priority_desc, NULL);
+  // 🧵 project1/task3
+  // a thread that was blocked may have missed some recent_cpu decays
+  if (thread_mlfqs)
+    mlfqs_catch_up (t);
 
+  // 🧵 project1/task2
+  // enqueue the thread at the tail of its priority's run queue
+  c = select_cpu (t);
+  spinlock_acquire (&c->rq.lock);
   t->status = THREAD_READY;
-  intr_set_level (old_level);
+  t->ready_since = timer_cycles ();
+  trace_record (TRACE_WAKEUP, t->tid, c->id);
+  if (thread_cfs)
+    cfs_place (c, t);
+  if (t->cpu != NULL && t->cpu != c)
+    {
+      c->migration_cnt++;
+      if (thread_cfs)
+        ready_queue_lag (c, t, t->last_min_vruntime);
+    }
+  ready_queue_push (c, t);
+  preempt_check (c, t);
+  spinlock_release (&c->rq.lock);
 
   list_init(&(t->list_child_process));
 }
@@ -397,45 +674,30 @@ thread_tid (void)
 void
 thread_exit (void)
 {
+  struct thread *cur = thread_current ();
+
   ASSERT (!intr_context ());
 
 #ifdef USERPROG
   process_exit ();
+  fpu_exit ();
 #endif
 
   /* Remove thread from all threads list, set our status to dying,
      and schedule another process.  That process will destroy us
      when it calls thread_schedule_tail(). */
   intr_disable ();
-  list_remove (&thread_current()->allelem);
-  thread_current ()->status = THREAD_DYING;
+  spinlock_acquire (&all_lock);
+  if (mlfqs_sweep_cursor == &cur->allelem)
+    mlfqs_sweep_cursor = list_next (mlfqs_sweep_cursor);
+  list_remove (&cur->allelem);
+  spinlock_release (&all_lock);
+  spinlock_acquire (&cur->cpu->rq.lock);
+  cur->status = THREAD_DYING;
   schedule ();
   NOT_REACHED ();
 }
 
-/* 🧵 project1/task2
-   Comparator functions to insert threads sorting by priority descending
-*/
-bool
-thread_priority_desc (const struct list_elem *a, const struct list_elem *b,
-                         void *aux UNUSED)
-{
-  struct thread *ta = list_entry (a, struct thread, elem);
-  struct thread *tb = list_entry (b, struct thread, elem);
-  return ta->priority > tb->priority;
-}
-
-/* 🧵 project1/task2
-   Comparator functions to insert threads sorting by priority ascending */
-bool
-thread_priority_asc (const struct list_elem *a, const struct list_elem *b,
-                         void *aux UNUSED)
-{
-  struct thread *ta = list_entry (a, struct thread, elem);
-  struct thread *tb = list_entry (b, struct thread, elem);
-  return ta->priority < tb->priority;
-}
-
 /* Yields the CPU.  The current thread is not put to sleep and
    may be scheduled again immediately at the scheduler's whim. */
 void
@@ -447,20 +709,24 @@ thread_yield (void)
   ASSERT (!intr_context ());
 
   old_level = intr_disable ();
+  spinlock_acquire (&synch_lock);
+  spinlock_acquire (&cur->cpu->rq.lock);
 
   // 🧵 project1/task2
-  // Insert into the ready_list, higher priority threads first,
-  // and only if it's not the idle thread
-  if (cur != idle_thread)
-    list_insert_ordered (&ready_list, &cur->elem, thread_priority_desc,
-                         NULL);
+  // Enqueue behind the threads of the same priority, and only if
+  // it's not the idle thread
   cur->status = THREAD_READY;
+  cur->ready_since = timer_cycles ();
+  if (!is_idle_thread (cur))
+    ready_queue_push (cur->cpu, cur);
+  spinlock_release (&synch_lock);
   schedule ();
   intr_set_level (old_level);
 }
 
 /* Invoke function 'func' on all threads, passing along 'aux'.
-   This function must be called with interrupts off. */
+   This function must be called with interrupts off.  FUNC runs
+   with all_lock held, so it must not sleep. */
 void
 thread_foreach (thread_action_func *func, void *aux)
 {
@@ -468,12 +734,14 @@ thread_foreach (thread_action_func *func, void *aux)
 
   ASSERT (intr_get_level () == INTR_OFF);
 
+  spinlock_acquire (&all_lock);
   for (e = list_begin (&all_list); e != list_end (&all_list);
        e = list_next (e))
     {
       struct thread *t = list_entry (e, struct thread, allelem);
       func (t, aux);
     }
+  spinlock_release (&all_lock);
 }
 
 /* 🧵 project1/task2
@@ -482,13 +750,65 @@ thread_foreach (thread_action_func *func, void *aux)
 void
 thread_sust (void)
 {
-  if (!list_empty (&ready_list))
-  {
-    struct thread *rlt = list_entry (list_front (&ready_list), struct thread,
-                                     elem);
-    if (rlt->priority > thread_get_priority ())
-      thread_yield ();
-  }
+  enum intr_level old_level = intr_disable ();
+  struct runqueue *rq = &cpu_current ()->rq;
+  bool yield;
+
+  spinlock_acquire (&rq->lock);
+  yield = (rq->cnt != 0
+           && preempts (ready_queue_front (rq), thread_current ()));
+  spinlock_release (&rq->lock);
+  intr_set_level (old_level);
+
+  if (yield)
+    thread_yield ();
+}
+
+/* 🧵 project1/task2
+   Sets T's effective priority to PRIORITY.  If T is sitting in the
+   run queue it is moved to the queue of its new priority, so every
+   write to a thread's `priority' member must go through here.
+   synch_lock must be held. */
+void
+thread_change_priority (struct thread *t, int priority)
+{
+  ASSERT (is_thread (t));
+  ASSERT (PRI_MIN <= priority && priority <= PRI_MAX);
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (t->priority != priority)
+    {
+      struct cpu *c = NULL;
+
+      /* A ready thread may be picked or stolen until we hold the
+         lock of the run queue it is in. */
+      while (t->status == THREAD_READY && !is_idle_thread (t))
+        {
+          c = t->rq_cpu;
+          spinlock_acquire (&c->rq.lock);
+          if (t->status == THREAD_READY && t->rq_cpu == c)
+            break;
+          spinlock_release (&c->rq.lock);
+          c = NULL;
+        }
+
+      if (c != NULL)
+        {
+          ready_queue_remove (t);
+          t->priority = priority;
+          ready_queue_push (c, t);
+          preempt_check (c, t);
+          spinlock_release (&c->rq.lock);
+        }
+      else
+        {
+          t->priority = priority;
+          if (t->status == THREAD_BLOCKED)
+            synch_priority_changed (t);
+        }
+    }
+  if (!thread_mlfqs)
+    schedstat_donation (t);
 }
 
 /* Sets the current thread's priority to NEW_PRIORITY. */
@@ -500,102 +820,168 @@ thread_set_priority (int new_priority)
     return;
 
   struct thread *cur = thread_current ();
+  enum intr_level old_level = intr_disable ();
 
-  if (cur->priority == new_priority)
-    return;
+  spinlock_acquire (&synch_lock);
+  if (cur->base_priority == new_priority)
+    {
+      spinlock_release (&synch_lock);
+      intr_set_level (old_level);
+      return;
+    }
 
   // 🧵 project1/task2
-  // If the current thread has no donors, we can safely update the
-  // base priority and recalculate the priority without yielding
+  // Update the base priority, then recalculate the priority in case
+  // it's being donated a higher one
   cur->base_priority = new_priority;
   thread_recalculate_priority (cur);
+  spinlock_release (&synch_lock);
 
   // 🧵 project1/task2
   // We may've changed our priority to a lower value,
   // and thus, we need to check if we should yield
   thread_sust ();
+  intr_set_level (old_level);
 }
 
 /* 🧵 project1/task2
-   Recalculates the priority of a thread by inheriting the highest priority
-   of the highest donor. If no donors, priority is reset to its initial value.
-
-   This function assumes:
-   - That the donors list is already sorted in descending priority order.
-   - That the current thread priority is no longer valid and needs to be
-     recalculated.
-*/
+   Recalculates the priority of a thread: its base priority, or the
+   highest priority among the waiters of the locks and readers-writer
+   locks it holds, if that is higher.  Each lock caches its waiters'
+   highest priority and the held locks are kept in a heap ordered by
+   it, so this takes constant time.  synch_lock must be held. */
 void
 thread_recalculate_priority (struct thread *t)
 {
-  if (list_empty (&t->donors))
+  int priority = t->base_priority;
+  struct list_elem *e;
+
+  if (!heap_empty (&t->held_locks))
     {
-      t->priority = t->base_priority;
-      return;
+      struct lock *top = heap_entry (heap_top (&t->held_locks),
+                                     struct lock, elem);
+      if (top->priority > priority)
+        priority = top->priority;
     }
+  for (e = list_begin (&t->rwlock_holds); e != list_end (&t->rwlock_holds);
+       e = list_next (e))
+    {
+      struct rwlock_hold *hold = list_entry (e, struct rwlock_hold,
+                                             threadelem);
 
-  // New priority is the priority of the highest donor
-  struct thread *highest_donor = list_entry (list_front (&t->donors),
-                                             struct thread, donorelem);
-
-  if (highest_donor->priority > t->base_priority)
-    t->priority = highest_donor->priority;
-  else
-    t->priority = t->base_priority;
+      if (hold->held && hold->rwlock->priority > priority)
+        priority = hold->rwlock->priority;
+    }
+  thread_change_priority (t, priority);
 }
 
 /*🧵 project1/task3
-  Calculate MLFQS's priority */
+  Calculate MLFQS's priority.  synch_lock must be held. */
 void
 mlfqs_priority (struct thread *t) {
-  if (t == idle_thread)
+  if (is_idle_thread (t))
     return;
   // Formula: priority = PRI_MAX - (recent_cpu / 4) - (nice * 2)
   int priority = FP_TO_INT_ROUND (FP_ADD_INT (FP_DIV_INT (t->recent_cpu, -4),
                                                      PRI_MAX - t->nice * 2));
   // Clamp the priority to the valid range
   if (priority > PRI_MAX)
-    t->priority = PRI_MAX;
+    priority = PRI_MAX;
   else if (priority < PRI_MIN)
-    t->priority = PRI_MIN;
-  else
-    t->priority = priority;
+    priority = PRI_MIN;
+  thread_change_priority (t, priority);
 }
 
 /*🧵 project1/task3
-  Recalculate and update threads' priority */
+  Recalculate and update threads' priority.  Between two decays
+  only the running thread's recent_cpu changes, so it is the only
+  one recomputed here. */
 void
 mlfqs_update_priority (void) {
-  struct list_elem *le;
-  struct thread *t;
-
-  for (le = list_begin (&all_list); le != list_end (&all_list); le = list_next
-                                                                         (le))
-  {
-    t = list_entry (le, struct thread, allelem);
-    mlfqs_priority (t);
-  }
-
-  if (!list_empty (&ready_list)) {
-    list_sort (&ready_list, thread_priority_desc, NULL);
-  }
+  spinlock_acquire (&synch_lock);
+  mlfqs_priority (thread_current ());
+  spinlock_release (&synch_lock);
 }
 
 /*🧵 project1/task3
-  Recalculate and update threads' recent_cpu */
+  Closes the current decay epoch.  The decay itself is applied
+  to the running thread now and to every other thread lazily, by
+  mlfqs_catch_up(), or by the sweep queued here. */
 void
 mlfqs_update_recent_cpu (void) {
-  struct thread *t;
-  struct list_elem *le = list_begin (&all_list);
-
-  while (le != list_end (&all_list)) {
-    t = list_entry (le, struct thread, allelem);
-    /* Calculate MLFQS recent_cpu value. Formula:
-       recent_cpu = (2 * load_avg) / (2 * load_avg + 1) * recent_cpu + nice */
-    t->recent_cpu = FP_ADD_INT (FP_MULT (FP_DIV (FP_MULT_INT (load_avg, 2),
-      FP_ADD_INT (FP_MULT_INT (load_avg, 2), 1)), t->recent_cpu), t->nice);
-    le = list_next (le);
-  }
+  spinlock_acquire (&synch_lock);
+  decay_coef[mlfqs_epoch % MLFQS_DECAY_HISTORY] =
+    FP_DIV (FP_MULT_INT (load_avg, 2), FP_ADD_INT (FP_MULT_INT (load_avg, 2), 1));
+  mlfqs_epoch++;
+
+  mlfqs_catch_up (thread_current ());
+  spinlock_release (&synch_lock);
+  workqueue_queue (&system_wq, &mlfqs_sweep_work);
+}
+
+/*🧵 project1/task3
+  Catches up every thread with the decays it missed, a batch at
+  a time.  Runs on the system workqueue. */
+static void
+mlfqs_sweep (void *aux UNUSED)
+{
+  enum intr_level old_level;
+  bool done;
+
+  old_level = intr_disable ();
+  spinlock_acquire (&all_lock);
+  mlfqs_sweep_cursor = list_begin (&all_list);
+  spinlock_release (&all_lock);
+  intr_set_level (old_level);
+
+  do
+    {
+      int i;
+
+      old_level = intr_disable ();
+      spinlock_acquire (&all_lock);
+      spinlock_acquire (&synch_lock);
+      for (i = 0; i < MLFQS_SWEEP_BATCH
+                  && mlfqs_sweep_cursor != list_end (&all_list); i++)
+        {
+          mlfqs_catch_up (list_entry (mlfqs_sweep_cursor, struct thread,
+                                      allelem));
+          mlfqs_sweep_cursor = list_next (mlfqs_sweep_cursor);
+        }
+      done = mlfqs_sweep_cursor == list_end (&all_list);
+      if (done)
+        mlfqs_sweep_cursor = NULL;
+      spinlock_release (&synch_lock);
+      spinlock_release (&all_lock);
+      intr_set_level (old_level);
+    }
+  while (!done);
+}
+
+/*🧵 project1/task3
+  Applies to T the recent_cpu decays of the epochs it missed and
+  recalculates its priority.  synch_lock must be held. */
+static void
+mlfqs_catch_up (struct thread *t) {
+  unsigned epoch;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (is_idle_thread (t) || t->recent_cpu_epoch == mlfqs_epoch)
+    return;
+
+  epoch = t->recent_cpu_epoch;
+  if (mlfqs_epoch - epoch > MLFQS_DECAY_HISTORY)
+    epoch = mlfqs_epoch - MLFQS_DECAY_HISTORY;
+
+  /* Calculate MLFQS recent_cpu value. Formula:
+     recent_cpu = (2 * load_avg) / (2 * load_avg + 1) * recent_cpu + nice */
+  for (; epoch != mlfqs_epoch; epoch++)
+    t->recent_cpu = FP_ADD_INT (FP_MULT (decay_coef[epoch % MLFQS_DECAY_HISTORY],
+                                         t->recent_cpu), t->nice);
+  t->recent_cpu_epoch = mlfqs_epoch;
+
+  mlfqs_priority (t);
 }
 
 /*🧵 project1/task3
@@ -604,18 +990,26 @@ void
 inc_recent_cpu (void) {
   struct thread *cur = thread_current ();
 
-  if (cur != idle_thread)
-    cur->recent_cpu = FP_ADD_INT (thread_current ()->recent_cpu, 1);
+  if (is_idle_thread (cur))
+    return;
+  spinlock_acquire (&synch_lock);
+  cur->recent_cpu = FP_ADD_INT (cur->recent_cpu, 1);
+  spinlock_release (&synch_lock);
 }
 
 /*🧵 project1/task3
   Calculate and update the system-wide load_avg */
 void
 mlfqs_update_load_avg (void) {
-  int ready_threads = list_size (&ready_list); // The number of threads that are
+  int ready_threads = 0; // The number of threads that are
   // either running or ready to run at time of update
-  if (thread_current () != idle_thread) // (not including the idle thread)
-    ready_threads++;
+  int i;
+  for (i = 0; i < cpu_cnt; i++) // (not including the idle threads)
+    {
+      ready_threads += cpus[i].rq.cnt;
+      if (!is_idle_thread (cpus[i].current))
+        ready_threads++;
+    }
   // Formula: load_avg = (59 / 60) * load_avg + (1 / 60) * ready_threads
   load_avg = FP_ADD (FP_MULT (FP_DIV_INT (INT_TO_FP (59), 60), load_avg),
             FP_MULT_INT (FP_DIV_INT (INT_TO_FP (1), 60), ready_threads));
@@ -632,18 +1026,24 @@ thread_get_priority (void)
 /*🧵 project1/task3
   Sets the current thread's nice value to NICE. */
 void
-thread_set_nice (int nice UNUSED)
+thread_set_nice (int nice)
 {
     enum intr_level old_level;
+
+    ASSERT (nice >= NICE_MIN && nice <= NICE_MAX);
+
     old_level = intr_disable ();
 
     struct thread *cur = thread_current ();
+    spinlock_acquire (&synch_lock);
     cur->nice = nice;
-    mlfqs_priority (cur);
-
-    list_sort (&ready_list, thread_priority_desc, NULL);
+    if (thread_cfs)
+      cur->weight = cfs_weights[nice - NICE_MIN];
+    else
+      mlfqs_priority (cur);
+    spinlock_release (&synch_lock);
 
-    if (cur != idle_thread)
+    if (!is_idle_thread (cur))
       thread_sust ();
 
     intr_set_level (old_level);
@@ -694,42 +1094,67 @@ thread_get_recent_cpu (void) {
 
 /* Idle thread.  Executes when no other thread is ready to run.
 
-   The idle thread is initially put on the ready list by
-   thread_start().  It will be scheduled once initially, at which
-   point it initializes idle_thread, "up"s the semaphore passed
-   to it to enable thread_start() to continue, and immediately
-   blocks.  After that, the idle thread never appears in the
-   ready list.  It is returned by next_thread_to_run() as a
-   special case when the ready list is empty. */
+   The bootstrap processor's idle thread is initially put on the
+   ready list by thread_start().  It will be scheduled once
+   initially, at which point it initializes its CPU's
+   idle_thread, "up"s the semaphore passed to it to enable
+   thread_start() to continue, and immediately blocks.  After
+   that, the idle thread never appears in the ready list.  It is
+   returned by next_thread_to_run() as a special case when the
+   ready list is empty.  Application processors turn their
+   startup code into their idle thread instead; see
+   thread_start_ap(). */
 static void
 idle (void *idle_started_ UNUSED)
 {
   struct semaphore *idle_started = idle_started_;
-  idle_thread = thread_current ();
+  thread_current ()->cpu->idle_thread = thread_current ();
   sema_up (idle_started);
 
+  idle_loop ();
+}
+
+/* Body of every idle thread. */
+static void
+idle_loop (void)
+{
   for (;;)
     {
+      struct thread *cur;
+
       /* Let someone else run. */
       intr_disable ();
-      thread_block ();
-
-      /* Re-enable interrupts and wait for the next one.
+      cur = thread_current ();
+      spinlock_acquire (&cur->cpu->rq.lock);
+      cur->status = THREAD_BLOCKED;
+      schedule ();
+
+      /* Nothing else wants to run, so zero pages in advance for
+         later PAL_ZERO requests.  Interrupts stay on meanwhile,
+         so a thread that becomes ready preempts us as usual. */
+      intr_enable ();
+      while (palloc_prezero ())
+        continue;
+      intr_disable ();
+      if (thread_current ()->cpu->rq.cnt > 0)
+        continue;
 
-         The `sti' instruction disables interrupts until the
-         completion of the next instruction, so these two
-         instructions are executed atomically.  This atomicity is
-         important; otherwise, an interrupt could be handled
-         between re-enabling interrupts and waiting for the next
-         one to occur, wasting as much as one clock tick worth of
-         time.
+      /* Nothing else can run until an interrupt arrives, so the
+         timer need not tick before the next kernel timer is due. */
+      timer_tickless_enter ();
 
-         See [IA32-v2a] "HLT", [IA32-v2b] "STI", and [IA32-v3a]
-         7.11.1 "HLT Instruction". */
-      asm volatile ("sti; hlt" : : : "memory");
+      /* Re-enable interrupts and wait for the next one. */
+      intr_wait ();
     }
 }
 
+/* Returns true if T is the idle thread of some CPU. */
+static bool
+is_idle_thread (const struct thread *t)
+{
+  return t->cpu != NULL && t == t->cpu->idle_thread;
+}
+
 /* Function used as the basis for a kernel thread. */
 static void
 kernel_thread (thread_func *function, void *aux)
@@ -782,14 +1207,22 @@ init_thread (struct thread *t, const char *name, int priority)
   // 🧵 project1/task3: fields initialization
   t->nice = 0;
   t->recent_cpu = 0;
+  t->recent_cpu_epoch = mlfqs_epoch;
+  t->weight = CFS_NICE_0_WEIGHT;
 
   // 🧵 project1/task2 fields initialization
   t->base_priority = priority;
   t->waiting_for = NULL;
-  list_init (&t->donors);
+  heap_init (&t->held_locks, lock_priority_less, NULL);
+  list_init (&t->rwlock_holds);
+
+  // 🧵 project1/task1
+  ktimer_init (&t->sleep_timer, thread_wakeup, t);
 
   old_level = intr_disable ();
+  spinlock_acquire (&all_lock);
   list_push_back (&all_list, &t->allelem);
+  spinlock_release (&all_lock);
   intr_set_level (old_level);
 
   // 👤 project2/userprog fields initialization
@@ -809,22 +1242,409 @@ alloc_frame (struct thread *t, size_t size)
   return t->stack;
 }
 
-/* Chooses and returns the next thread to be scheduled.  Should
-   return a thread from the run queue, unless the run queue is
-   empty.  (If the running thread can continue running, then it
-   will be in the run queue.)  If the run queue is empty, return
-   idle_thread. */
+/* Returns a page for a new thread, from the thread page cache if
+   possible, or a null pointer if memory is exhausted.  The page
+   is not zeroed. */
 static struct thread *
-next_thread_to_run (void)
+alloc_thread_page (void)
+{
+  struct thread *t = NULL;
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  spinlock_acquire (&thread_cache_lock);
+  if (thread_cache_cnt > 0)
+    {
+      t = thread_cache[--thread_cache_cnt];
+      thread_cache_hits++;
+    }
+  else
+    thread_cache_misses++;
+  spinlock_release (&thread_cache_lock);
+  intr_set_level (old_level);
+
+  if (t == NULL)
+    t = palloc_get_page (0);
+  return t;
+}
+
+/* Frees the page of dead thread T, keeping it in the thread page
+   cache if there is room.  Interrupts must be off. */
+static void
+free_thread_page (struct thread *t)
+{
+  bool cached = false;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  /* A cached page must not pass for a live thread. */
+  t->magic = 0;
+
+  spinlock_acquire (&thread_cache_lock);
+  if (thread_cache_cnt < THREAD_CACHE_SIZE)
+    {
+      thread_cache[thread_cache_cnt++] = t;
+      cached = true;
+    }
+  spinlock_release (&thread_cache_lock);
+  if (!cached)
+    palloc_free_page (t);
+}
+
+/* Adds a sample of CYCLES TSC cycles to histogram HIST, one of
+   schedstat's.  Interrupts must be off. */
+static void
+schedstat_record (uint32_t hist[SCHEDSTAT_BUCKETS], uint64_t cycles)
+{
+  int64_t ns = timer_cycles_to_ns (cycles);
+  int bucket;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (bucket = 0; ns > 1 && bucket < SCHEDSTAT_BUCKETS - 1; bucket++)
+    ns >>= 1;
+  spinlock_acquire (&schedstat_lock);
+  hist[bucket]++;
+  spinlock_release (&schedstat_lock);
+}
+
+/* Notes whether T is running above its base priority because of
+   donation, recording how long that lasted when it ends.  Called
+   whenever T's priority may have changed.  synch_lock must be
+   held. */
+static void
+schedstat_donation (struct thread *t)
+{
+  bool donated = t->priority > t->base_priority;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (donated && !t->donated)
+    t->donated_since = timer_cycles ();
+  else if (!donated && t->donated)
+    schedstat_record (schedstat.donation, timer_cycles () - t->donated_since);
+  t->donated = donated;
+}
+
+/* Prints histogram HIST, labeled LABEL, on a single line as a
+   list of "BUCKET:COUNT" pairs for the non-empty buckets.  Prints
+   nothing if the histogram is empty. */
+static void
+print_histogram (const char *label, const uint32_t hist[SCHEDSTAT_BUCKETS])
+{
+  bool empty = true;
+  int i;
+
+  for (i = 0; i < SCHEDSTAT_BUCKETS; i++)
+    if (hist[i] != 0)
+      {
+        if (empty)
+          printf ("Thread: %s (log2 ns:count):", label);
+        printf (" %d:%"PRIu32, i, hist[i]);
+        empty = false;
+      }
+  if (!empty)
+    printf ("\n");
+}
+
+/* Chooses and returns the next thread to be scheduled on the
+   running CPU C.  Should return a thread from the CPU's run
+   queue, unless the run queue is empty.  (If the running thread
+   can continue running, then it will be in the run queue.)  If
+   the run queue is empty, return the CPU's idle thread.  C's run
+   queue lock must be held. */
+static struct thread *
+next_thread_to_run (struct cpu *c)
+{
+  struct thread *t;
+
+  if (c->rq.cnt == 0 && !steal_thread (c))
+    return c->idle_thread;
+
+  t = ready_queue_front (&c->rq);
+  ready_queue_remove (t);
+  return t;
+}
+
+/* Chooses the CPU on whose run queue T should wait.  T stays
+   with the CPU it last ran on if that CPU is idle or within
+   AFFINITY_SLACK ready threads of the least loaded CPU.
+   Otherwise it goes to an idle CPU, if there is one, or else to
+   the least loaded CPU.  The run queues are not locked, so the
+   choice is only a good guess.  Interrupts must be off. */
+static struct cpu *
+select_cpu (struct thread *t)
+{
+  struct cpu *last = t->cpu;
+  struct cpu *best = NULL;
+  int i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (last != NULL && cpu_is_idle (last))
+    return last;
+
+  for (i = 0; i < cpu_cnt; i++)
+    {
+      struct cpu *c = &cpus[i];
+
+      if (cpu_is_idle (c))
+        return c;
+      if (best == NULL || c->rq.cnt < best->rq.cnt)
+        best = c;
+    }
+
+  if (last != NULL && last->rq.cnt <= best->rq.cnt + AFFINITY_SLACK)
+    return last;
+  return best;
+}
+
+/* Returns true if C is running its idle thread and has no ready
+   threads. */
+static bool
+cpu_is_idle (const struct cpu *c)
+{
+  return is_idle_thread (c->current) && c->rq.cnt == 0;
+}
+
+/* Moves a ready thread from the CPU with the most ready threads
+   to C, whose run queue must be empty.  The thread taken is the
+   one the victim would run next: its highest-priority one,
+   counting priority donated to it, that has waited longest for a
+   CPU at that priority, or under the completely fair scheduler
+   the one with the least virtual runtime.  Returns true if
+   successful, false if no other CPU had a thread to spare.  C's
+   run queue lock must be held.  The victim's lock is only tried,
+   so that two CPUs stealing from each other cannot deadlock; if
+   it is busy, C idles until its next chance to schedule. */
+static bool
+steal_thread (struct cpu *c)
+{
+  struct cpu *victim = NULL;
+  struct thread *t;
+  int i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (c->rq.cnt == 0);
+
+  for (i = 0; i < cpu_cnt; i++)
+    if (cpus[i].rq.cnt > 0
+        && (victim == NULL || cpus[i].rq.cnt > victim->rq.cnt))
+      victim = &cpus[i];
+  if (victim == NULL || !spinlock_try_acquire (&victim->rq.lock))
+    return false;
+  if (victim->rq.cnt == 0)
+    {
+      spinlock_release (&victim->rq.lock);
+      return false;
+    }
+
+  t = ready_queue_front (&victim->rq);
+  ready_queue_remove (t);
+  if (thread_cfs)
+    ready_queue_lag (c, t, victim->rq.min_vruntime);
+  spinlock_release (&victim->rq.lock);
+  if (t->cpu != c)
+    c->migration_cnt++;
+  ready_queue_push (c, t);
+  c->steal_cnt++;
+  return true;
+}
+
+/* Kicks CPU C into rescheduling if T, which just joined C's run
+   queue, should preempt the thread running there.  A thread
+   running on the current CPU is left for the caller to preempt,
+   as it always was.  C's run queue lock must be held. */
+static void
+preempt_check (struct cpu *c, const struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (c != cpu_current ()
+      && (is_idle_thread (c->current) || preempts (t, c->current)))
+    cpu_kick (c);
+}
+
+/* Returns true if T, which is ready, should run instead of CUR,
+   which is running. */
+static bool
+preempts (const struct thread *t, const struct thread *cur)
+{
+  if (thread_cfs)
+    return (is_idle_thread (cur)
+            || t->vruntime + CFS_WAKEUP_GRANULARITY < cur->vruntime);
+  return t->priority > cur->priority;
+}
+
+/* Appends T to the tail of the run queue of its priority on CPU
+   C, or under the completely fair scheduler inserts it into C's
+   tree.  C's run queue lock must be held. */
+static void
+ready_queue_push (struct cpu *c, struct thread *t)
 {
-  if (list_empty (&ready_list))
-    return idle_thread;
+  struct runqueue *rq = &c->rq;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  t->rq_cpu = c;
+  if (thread_cfs)
+    {
+      rbtree_insert (&rq->cfs_tree, &t->cfs_elem);
+      rq->cfs_load += t->weight;
+    }
   else
-    return list_entry (list_pop_front (&ready_list), struct thread, elem);
+    {
+      list_push_back (&rq->queues[t->priority], &t->elem);
+      rq->bitmap |= (uint64_t) 1 << t->priority;
+    }
+  rq->cnt++;
+}
+
+/* Removes T from the run queue of its priority, clearing the
+   queue's bit in its CPU's bitmap if it became empty.  The lock
+   of T's run queue must be held. */
+static void
+ready_queue_remove (struct thread *t)
+{
+  struct runqueue *rq = &t->rq_cpu->rq;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (rq->cnt > 0);
+
+  if (thread_cfs)
+    {
+      rbtree_remove (&rq->cfs_tree, &t->cfs_elem);
+      rq->cfs_load -= t->weight;
+    }
+  else
+    {
+      list_remove (&t->elem);
+      if (list_empty (&rq->queues[t->priority]))
+        rq->bitmap &= ~((uint64_t) 1 << t->priority);
+    }
+  rq->cnt--;
+}
+
+/* Carries the virtual runtime of T, which is moving to C from a
+   run queue whose min_vruntime was FROM_MIN_VRUNTIME, over to
+   C's run queue, keeping its lag behind or ahead of the least
+   virtual runtime there.  C's run queue lock must be held. */
+static void
+ready_queue_lag (struct cpu *c, struct thread *t,
+                 uint64_t from_min_vruntime)
+{
+  struct runqueue *rq = &c->rq;
+  int64_t lag = t->vruntime - from_min_vruntime;
+
+  t->vruntime = (lag >= 0 || (uint64_t) -lag < rq->min_vruntime
+                 ? rq->min_vruntime + lag : 0);
+}
+
+/* Returns the highest priority that has a ready thread in RQ,
+   found as the most significant set bit of its bitmap.  RQ must
+   not be empty.  The bitmap is split into two 32-bit words so
+   that no libgcc helper is needed for the 64-bit scan. */
+static int
+ready_queue_max_priority (const struct runqueue *rq)
+{
+  uint32_t high = rq->bitmap >> 32;
+  uint32_t low = rq->bitmap;
+
+  ASSERT (rq->bitmap != 0);
+
+  if (high != 0)
+    return 63 - __builtin_clz (high);
+  return 31 - __builtin_clz (low);
+}
+
+/* Returns the thread that RQ, which must not be empty, would run
+   next. */
+static struct thread *
+ready_queue_front (struct runqueue *rq)
+{
+  ASSERT (rq->cnt > 0);
+
+  if (thread_cfs)
+    return rbtree_entry (rbtree_first (&rq->cfs_tree), struct thread,
+                         cfs_elem);
+  return list_entry (list_front (&rq->queues[ready_queue_max_priority (rq)]),
+                     struct thread, elem);
+}
+
+/* Orders threads in a CFS run queue by virtual runtime. */
+static bool
+cfs_less (const struct rbtree_elem *a_, const struct rbtree_elem *b_,
+          void *aux UNUSED)
+{
+  const struct thread *a = rbtree_entry (a_, struct thread, cfs_elem);
+  const struct thread *b = rbtree_entry (b_, struct thread, cfs_elem);
+
+  return a->vruntime < b->vruntime;
+}
+
+/* Sets the virtual runtime of T, which is becoming ready to run
+   on C, so that it competes fairly with the threads there.  A new
+   thread starts at the least virtual runtime of C's run queue,
+   and a woken thread keeps its own unless that is more than
+   CFS_SLEEPER_CREDIT behind.  C's run queue lock must be held. */
+static void
+cfs_place (struct cpu *c, struct thread *t)
+{
+  uint64_t min_vruntime;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (t->cpu == NULL)
+    {
+      t->vruntime = c->rq.min_vruntime;
+      return;
+    }
+
+  /* The run queue of another CPU is not locked, so T is placed
+     against the min_vruntime it saw there when it blocked.
+     thread_unblock() carries the placement over to C. */
+  min_vruntime = (t->cpu == c ? c->rq.min_vruntime
+                  : t->last_min_vruntime);
+  if (min_vruntime > CFS_SLEEPER_CREDIT
+      && t->vruntime < min_vruntime - CFS_SLEEPER_CREDIT)
+    t->vruntime = min_vruntime - CFS_SLEEPER_CREDIT;
+}
+
+/* Charges T, running on C, for a timer tick, and advances C's
+   min_vruntime.  Runs in an external interrupt context, with C's
+   run queue lock held. */
+static void
+cfs_tick (struct cpu *c, struct thread *t)
+{
+  struct runqueue *rq = &c->rq;
+  uint64_t floor = t->vruntime;
+
+  t->vruntime += (uint64_t) CFS_TICK_NS * CFS_NICE_0_WEIGHT / t->weight;
+
+  if (rq->cnt > 0)
+    {
+      uint64_t first = ready_queue_front (rq)->vruntime;
+      if (first < floor)
+        floor = first;
+    }
+  if (floor > rq->min_vruntime)
+    rq->min_vruntime = floor;
+}
+
+/* Returns the time slice of T, running on C, in timer ticks: its
+   share of CFS_LATENCY by weight among C's runnable threads.
+   C's run queue lock must be held. */
+static unsigned
+cfs_slice (const struct cpu *c, const struct thread *t)
+{
+  unsigned slice = CFS_LATENCY * t->weight / (c->rq.cfs_load + t->weight);
+
+  return slice > CFS_MIN_SLICE ? slice : CFS_MIN_SLICE;
 }
 
 /* Completes a thread switch by activating the new thread's page
-   tables, and, if the previous thread is dying, destroying it.
+   tables, and, if the previous thread is dying, destroying it, or
+   otherwise letting other CPUs run it.
 
    At this function's invocation, we just switched from thread
    PREV, the new thread is already running, and interrupts are
@@ -846,15 +1666,10 @@ thread_schedule_tail (struct thread *prev)
 
   ASSERT (intr_get_level () == INTR_OFF);
 
-  /* Mark us as running. */
-  cur->status = THREAD_RUNNING;
-
-  /* Start new time slice. */
-  thread_ticks = 0;
-
 #ifdef USERPROG
   /* Activate the new address space. */
   process_activate ();
+  fpu_switch (prev);
 #endif
 
   /* If the thread we switched from is dying, destroy its struct
@@ -862,17 +1677,35 @@ thread_schedule_tail (struct thread *prev)
      pull out the rug under itself.  (We don't free
      initial_thread because its memory was not obtained via
      palloc().) */
-  if (prev != NULL && prev->status == THREAD_DYING && prev != initial_thread)
+  if (prev != NULL && prev->status == THREAD_DYING)
     {
       ASSERT (prev != cur);
-      palloc_free_page (prev);
+      if (prev != initial_thread)
+        free_thread_page (prev);
+    }
+  else if (prev != NULL)
+    {
+      /* PREV's stack is no longer in use, so another CPU may now
+         run it. */
+      barrier ();
+      prev->on_cpu = false;
+    }
+
+  /* 🧵 project1/task3: bring recent_cpu up to date if we sat in the
+     run queue across a decay. */
+  if (thread_mlfqs)
+    {
+      spinlock_acquire (&synch_lock);
+      mlfqs_catch_up (cur);
+      spinlock_release (&synch_lock);
     }
 }
 
-/* Schedules a new process.  At entry, interrupts must be off and
-   the running process's state must have been changed from
-   running to some other state.  This function finds another
-   thread to run and switches to it.
+/* Schedules a new process.  At entry, interrupts must be off,
+   the running CPU's run queue lock must be held, and the running
+   process's state must have been changed from running to some
+   other state.  This function finds another thread to run,
+   releases the run queue lock, and switches to it.
 
    It's not safe to call printf() until thread_schedule_tail()
    has completed. */
@@ -880,28 +1713,57 @@ static void
 schedule (void)
 {
   struct thread *cur = running_thread ();
-  struct thread *next = next_thread_to_run ();
+  struct cpu *c = cur->cpu;
+  struct thread *next = next_thread_to_run (c);
   struct thread *prev = NULL;
 
   ASSERT (intr_get_level () == INTR_OFF);
   ASSERT (cur->status != THREAD_RUNNING);
   ASSERT (is_thread (next));
 
+  /* Mark NEXT as running and start a new time slice. */
+  next->status = THREAD_RUNNING;
+  c->current = next;
+  c->thread_ticks = 0;
+  spinlock_release (&c->rq.lock);
+
+  if (!is_idle_thread (next))
+    {
+      int band = next->priority / ((PRI_MAX + 1) / SCHEDSTAT_BANDS);
+      schedstat_record (schedstat.dispatch[band],
+                        timer_cycles () - next->ready_since);
+    }
+
   if (cur != next)
-    prev = switch_threads (cur, next);
+    {
+      /* NEXT may not be done switching away from another CPU. */
+      while (next->on_cpu)
+        asm volatile ("pause");
+      next->on_cpu = true;
+      next->cpu = c;
+
+      trace_switch (cur, next);
+      prev = switch_threads (cur, next);
+    }
   thread_schedule_tail (prev);
 }
 
-/* Returns a tid to use for a new thread. */
+/* Returns a tid to use for a new thread.  Protected by a
+   spinlock rather than a lock, because application processors
+   allocate a tid for their idle thread before they can sleep. */
 static tid_t
 allocate_tid (void)
 {
   static tid_t next_tid = 1;
+  static struct spinlock tid_lock;
+  enum intr_level old_level;
   tid_t tid;
 
-  lock_acquire (&tid_lock);
+  old_level = intr_disable ();
+  spinlock_acquire (&tid_lock);
   tid = next_tid++;
-  lock_release (&tid_lock);
+  spinlock_release (&tid_lock);
+  intr_set_level (old_level);
 
   return tid;
 }
@@ -911,19 +1773,20 @@ allocate_tid (void)
 uint32_t thread_stack_ofs = offsetof (struct thread, stack);
 
 /* 👤 project2/userprog
-   Returns the child of id [child_tid] of the current process */
-struct thread *
+   Returns the PCB of the child of id [child_tid] of the current
+   process.  The child's struct thread may already be gone. */
+struct pcb *
 thread_get_child (tid_t child_tid)
 {
   struct thread *t = thread_current ();
-  struct thread *child;
+  struct pcb *child;
   struct list *child_list = &(t->list_child_process);
   struct list_elem *e;
 
   // Iterate and find by thread id
   for (e = list_begin (child_list); e != list_end (child_list); e = list_next (e))
   {
-    child = list_entry (e, struct thread, elem_child_process);
+    child = list_entry (e, struct pcb, elem);
     if (child->tid == child_tid)
       return child;
   }
@@ -7,11 +7,14 @@
 
 #include <debug.h>
 #include <list.h>
+#include <rbtree.h>
 #include <stdint.h>
+#include "threads/slab.h"
 #include "threads/synch.h"
 
 #include "synch.h"
 #include <hash.h>
+#include "devices/timerwheel.h"
 
 /* States in a thread's life cycle. */
 enum thread_status
@@ -27,11 +30,17 @@ enum thread_status
 typedef int tid_t;
 #define TID_ERROR ((tid_t) -1)          /* Error value for tid_t. */
 
+struct cpu;
+
 /* Thread priorities. */
 #define PRI_MIN 0                       /* Lowest priority. */
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
 
+/* Thread nice values. */
+#define NICE_MIN -20                    /* Most favored. */
+#define NICE_MAX 20                     /* Least favored. */
+
 /* 👤 project2/userprog
    Process Control Block (PCB)
    Created to store general information about the process that
@@ -49,8 +58,17 @@ struct pcb
 
     struct semaphore sema_wait; // Waiter for the process to finish
     struct semaphore sema_load; // Waiter for the process to be loaded
+
+    /* A process's PCB outlives its thread: the parent frees it in
+       process_wait(), while thread_schedule_tail() frees the
+       thread's page as soon as it dies. */
+    tid_t tid;                  /* The process's thread identifier. */
+    struct list_elem elem;      /* In parent's `list_child_process'. */
   };
 
+/* Cache that PCBs are allocated from. */
+extern struct kmem_cache *pcb_cache;
+
 /* A kernel thread or user process.
 
    Each thread structure is stored in its own 4 kB page.  The
@@ -101,12 +119,16 @@ struct pcb
    the `magic' member of the running thread's `struct thread' is
    set to THREAD_MAGIC.  Stack overflow will normally change this
    value, triggering the assertion. */
-/* The `elem' member has a dual purpose.  It can be an element in
-   the run queue (thread.c), or it can be an element in a
-   semaphore wait list (synch.c).  It can be used these two ways
-   only because they are mutually exclusive: only a thread in the
-   ready state is on the run queue, whereas only a thread in the
-   blocked state is on a semaphore wait list. */
+/* Locking: the members that priority donation and the MLFQS
+   change, from `priority' through `recent_cpu_epoch', and those
+   owned by synch.c are protected by synch_lock (see synch.h).
+   `status', `elem', `cfs_elem' and `rq_cpu' are protected by the
+   lock of the run queue the thread is in or is leaving (see
+   thread.c).  The rest belong to the thread itself.
+
+   The `elem' member is an element in a run queue (thread.c).  A
+   thread blocked on a semaphore is in the semaphore's heap of
+   waiters through its `waitelem' member instead (synch.c). */
 struct thread
   {
     /* Owned by thread.c. */
@@ -120,12 +142,14 @@ struct thread
                                            Priority to be restored after
                                            priority donation */
 
-    int64_t wakeup_tick;                /* 🧵 project1/task1
-                                           The tick to wake up the thread */
+    struct ktimer sleep_timer;          /* 🧵 project1/task1
+                                           Wakes the thread up from
+                                           thread_sleep() */
 
-    struct list donors;                 /* 🧵 project1/task2
-                                           List of threads that have donated
-                                           their priority to this thread */
+    struct heap held_locks;             /* 🧵 project1/task2
+                                           Locks held, ordered by the
+                                           highest priority among their
+                                           waiters */
 
     struct lock* waiting_for;           /* 🧵 project1/task2
                                            The lock the thread is waiting for */
@@ -133,14 +157,43 @@ struct thread
     int nice;                           /* Thread's niceness value */
     int recent_cpu;                     /* Measure how much CPU time each
                                            thread has received “recently” */
-
-    /* Shared between thread.c and synch.c.
-       in ready_list, sleep_list, and as a semaphore waiters element. */
-    struct list_elem elem;              /* List element. */
+    unsigned recent_cpu_epoch;          /* Decay epoch recent_cpu is
+                                           up to date with */
+
+    /* Completely fair scheduler (-cfs). */
+    struct rbtree_elem cfs_elem;        /* Element in run queue's tree. */
+    uint64_t vruntime;                  /* Weighted run time, in ns. */
+    unsigned weight;                    /* Load weight, from nice. */
+
+    /* Scheduler latency statistics. */
+    uint64_t ready_since;               /* When last made ready. */
+    uint64_t donated_since;             /* When priority rose above
+                                           base_priority. */
+    bool donated;                       /* Above base_priority? */
+
+    struct list_elem elem;              /* Run queue element. */
+    struct cpu *rq_cpu;                 /* CPU whose run queue it is in,
+                                           while ready. */
+    volatile bool on_cpu;               /* Running, or not yet switched
+                                           away from? */
+    uint64_t last_min_vruntime;         /* min_vruntime of `cpu' when it
+                                           last blocked. */
+
+    /* Owned by synch.c. */
+    struct heap_elem waitelem;          /* Element in waiting_sema's
+                                           waiters. */
+    unsigned wait_seq;                  /* Order among equal waiters. */
+    struct semaphore *waiting_sema;     /* Semaphore waited on, or null. */
+    struct condition *waiting_cond;     /* Condition waited on, or null. */
+    struct heap_elem *cond_elem;        /* Our element in waiting_cond's
+                                           waiters. */
+    struct list rwlock_holds;           /* Holds on readers-writer locks,
+                                           granted or waited for. */
+    struct rwlock_hold *waiting_rwlock; /* Hold being waited for, or null. */
 
     struct list_elem allelem;           /* List element for all threads list. */
-    struct list_elem donorelem;         /* 🧵 project1/task2
-                                           List element for donors list. */
+    struct cpu *cpu;                    /* CPU running the thread, or
+                                           that last ran it. */
 
 #ifdef USERPROG
     /* Owned by userprog/process.c. */
@@ -148,9 +201,11 @@ struct thread
     struct pcb *pcb;                    /* 👤 project2/userprog
                                            Process Control Block, stores
                                            information about the process */
+
+    /* Owned by userprog/fpu.c. */
+    void *fpu;                          /* FPU and SSE state, or null. */
     struct thread *parent_process;
-    struct list list_child_process;
-    struct list_elem elem_child_process;
+    struct list list_child_process;     /* Children's PCBs. */
 #endif
     struct hash spt;                   /* 🧠 project3/vm
                                            Supplemental page table */
@@ -165,12 +220,21 @@ struct thread
    Controlled by kernel command-line option "-o mlfqs". */
 extern bool thread_mlfqs;
 
+/* If true, use the completely fair scheduler instead.
+   Controlled by kernel command-line option "-cfs". */
+extern bool thread_cfs;
+
 void thread_init (void);
 void thread_start (void);
+void thread_start_ap (struct cpu *) NO_RETURN;
 
 void thread_tick (void);
 void thread_print_stats (void);
 
+struct schedstat;
+void thread_get_schedstat (struct schedstat *);
+long long thread_cache_hit_cnt (void);
+
 typedef void thread_func (void *aux);
 tid_t thread_create (const char *name, int priority, thread_func *, void *);
 
@@ -180,14 +244,11 @@ void thread_unblock (struct thread *);
 // 🧵 project1/task1 definitions
 
 void thread_sleep (int64_t ticks);
-void thread_awake(int64_t ticks);
-bool thread_wakeup_tick_less (const struct list_elem*, const struct list_elem*, void*);
 
 // 🧵 project1/task2 definitions
 
-bool thread_priority_desc (const struct list_elem*, const struct list_elem*, void*);
-bool thread_priority_asc (const struct list_elem*, const struct list_elem*, void*);
 void thread_sust (void);
+void thread_change_priority (struct thread *t, int priority);
 void thread_recalculate_priority (struct thread *t);
 
 // 🧵 project1/task3 definitions
@@ -219,6 +280,6 @@ int thread_get_load_avg (void);
 
 /* 👤 project2/userprog */
 
-struct thread *thread_get_child (tid_t child_tid);
+struct pcb *thread_get_child (tid_t child_tid);
 
 #endif /* threads/thread.h */
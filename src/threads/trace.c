@@ -0,0 +1,221 @@
+#include "threads/trace.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <round.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/serial.h"
+#include "devices/timer.h"
+#include "threads/cpu.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Event tracing.
+
+   Each CPU records events into its own ring of TRACE_EVENTS
+   fixed-size binary records, overwriting the oldest once it is
+   full.  Recording takes no lock and leaves interrupts alone: a
+   writer claims a slot by atomically incrementing the ring's
+   head and only then fills it in, so an interrupt handler that
+   records an event in the middle of another just takes the next
+   slot.  A thread that moves to another CPU while recording ends
+   up writing into its old CPU's ring, which is harmless for the
+   same reason.
+
+   Timestamps are raw timer_cycles() values, converted to
+   nanoseconds only when the rings are dumped.  trace_dump()
+   writes them as text to the serial port at shutdown, where the
+   "pintos" script picks them up with the rest of the output, and
+   utils/pintos-trace2json turns that into Chrome trace-event
+   JSON. */
+
+/* Events kept per CPU.  Must be a power of 2. */
+#define TRACE_EVENTS 1024
+
+/* A recorded event. */
+struct trace_event
+  {
+    uint64_t time;              /* timer_cycles() when recorded. */
+    int32_t tid;                /* Thread that recorded it. */
+    uint32_t type;              /* An enum trace_type. */
+    uint32_t arg[4];            /* Depends on type. */
+  };
+
+/* Name of each enum trace_type in dumps. */
+static const char *type_names[TRACE_TYPE_CNT] =
+  {
+    "switch", "wakeup", "lock-wait", "lock-acquired", "fault",
+    "syscall", "syscall-end", "block-read", "block-write", "block-end",
+    "name",
+  };
+
+bool trace_enabled;
+
+/* True between trace_init() and trace_dump(). */
+static bool recording;
+
+static void record (enum trace_type, tid_t,
+                    uint32_t, uint32_t, uint32_t, uint32_t);
+static void dump_event (const struct cpu *, const struct trace_event *);
+static void dump_name (struct thread *, void *aux);
+static void trace_printf (const char *, ...) PRINTF_FORMAT (1, 2);
+
+/* Allocates a ring for each running CPU, if tracing was asked
+   for.  Called once, by init.c:main(), after the APs have been
+   started; until then, nothing is recorded. */
+void
+trace_init (void)
+{
+  size_t page_cnt = DIV_ROUND_UP (TRACE_EVENTS * sizeof (struct trace_event),
+                                  PGSIZE);
+  int i;
+
+  if (!trace_enabled)
+    return;
+
+  for (i = 0; i < cpu_cnt; i++)
+    {
+      cpus[i].trace = palloc_get_multiple (PAL_ZERO, page_cnt);
+      if (cpus[i].trace == NULL)
+        printf ("trace: out of memory, not tracing cpu %d\n", i);
+    }
+  recording = true;
+}
+
+/* Records an event of the given TYPE, with arguments ARG0 and
+   ARG1, for the running thread.  May be called from any context,
+   with interrupts on or off. */
+void
+trace_record (enum trace_type type, uint32_t arg0, uint32_t arg1)
+{
+  if (recording)
+    record (type, thread_current ()->tid, arg0, arg1, 0, 0);
+}
+
+/* Records a switch from PREV to NEXT.  Called by the scheduler,
+   which cannot use trace_record() because PREV is no longer
+   running and NEXT is not yet. */
+void
+trace_switch (const struct thread *prev, const struct thread *next)
+{
+  if (recording)
+    record (TRACE_SWITCH, prev->tid, next->tid, prev->status, 0, 0);
+}
+
+/* Records the name of T, so that the trace can name T even if it
+   is gone by the time the trace is dumped. */
+void
+trace_name (const struct thread *t)
+{
+  uint32_t arg[4];
+
+  if (!recording)
+    return;
+
+  ASSERT (sizeof arg == sizeof t->name);
+  memcpy (arg, t->name, sizeof arg);
+  record (TRACE_NAME, t->tid, arg[0], arg[1], arg[2], arg[3]);
+}
+
+/* Records an event in the running CPU's ring. */
+static void
+record (enum trace_type type, tid_t tid,
+        uint32_t arg0, uint32_t arg1, uint32_t arg2, uint32_t arg3)
+{
+  struct cpu *c = cpu_current ();
+  struct trace_event *e;
+
+  if (c->trace == NULL)
+    return;
+
+  e = &c->trace[__atomic_fetch_add (&c->trace_head, 1, __ATOMIC_RELAXED)
+                % TRACE_EVENTS];
+  e->time = timer_cycles ();
+  e->tid = tid;
+  e->type = type;
+  e->arg[0] = arg0;
+  e->arg[1] = arg1;
+  e->arg[2] = arg2;
+  e->arg[3] = arg3;
+}
+
+/* Stops recording and writes every CPU's ring, oldest events
+   first, and the names of the threads still alive to the serial
+   port.  Called at shutdown. */
+void
+trace_dump (void)
+{
+  enum intr_level old_level;
+  int i;
+
+  if (!recording)
+    return;
+  recording = false;
+
+  trace_printf ("trace: begin %d\n", cpu_cnt);
+  old_level = intr_disable ();
+  thread_foreach (dump_name, NULL);
+  intr_set_level (old_level);
+
+  for (i = 0; i < cpu_cnt; i++)
+    {
+      const struct cpu *c = &cpus[i];
+      uint32_t head = c->trace_head;
+      uint32_t n;
+
+      if (c->trace == NULL)
+        continue;
+      for (n = head < TRACE_EVENTS ? 0 : head - TRACE_EVENTS; n != head; n++)
+        dump_event (c, &c->trace[n % TRACE_EVENTS]);
+    }
+  trace_printf ("trace: end\n");
+}
+
+/* Writes event E, recorded on C, to the serial port. */
+static void
+dump_event (const struct cpu *c, const struct trace_event *e)
+{
+  int64_t ns = timer_cycles_to_ns (e->time);
+
+  if (e->type == TRACE_NAME)
+    {
+      char name[sizeof e->arg + 1];
+
+      memcpy (name, e->arg, sizeof e->arg);
+      name[sizeof e->arg] = '\0';
+      trace_printf ("trace: name %"PRId32" %s\n", e->tid, name);
+    }
+  else if (e->type < TRACE_TYPE_CNT)
+    trace_printf ("trace: event %d %"PRId64" %"PRId32" %s %"PRIx32" %"PRIx32"\n",
+                  c->id, ns, e->tid, type_names[e->type],
+                  e->arg[0], e->arg[1]);
+}
+
+/* Writes the name of thread T to the serial port. */
+static void
+dump_name (struct thread *t, void *aux UNUSED)
+{
+  trace_printf ("trace: name %d %s\n", t->tid, t->name);
+}
+
+/* Helper for trace_printf(). */
+static void
+serial_output (char c, void *aux UNUSED)
+{
+  serial_putc (c);
+}
+
+/* Formats like printf() to the serial port only.  Traces can be
+   long, and the VGA console is no use for them. */
+static void
+trace_printf (const char *format, ...)
+{
+  va_list args;
+
+  va_start (args, format);
+  __vprintf (format, args, serial_output, NULL);
+  va_end (args);
+}
@@ -0,0 +1,36 @@
+#ifndef THREADS_TRACE_H
+#define THREADS_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct thread;
+
+/* Kinds of trace events.  The event's arguments, if any, are in
+   parentheses. */
+enum trace_type
+  {
+    TRACE_SWITCH,               /* Context switch (next tid, old status). */
+    TRACE_WAKEUP,               /* Thread unblocked (tid, CPU). */
+    TRACE_LOCK_WAIT,            /* Blocked on a lock (lock). */
+    TRACE_LOCK_ACQUIRED,        /* Got the lock waited for (lock). */
+    TRACE_FAULT,                /* Page fault (address, error code). */
+    TRACE_SYSCALL,              /* System call entry (number). */
+    TRACE_SYSCALL_END,          /* System call return (number). */
+    TRACE_BLOCK_READ,           /* Sector read started (sector, type). */
+    TRACE_BLOCK_WRITE,          /* Sector write started (sector, type). */
+    TRACE_BLOCK_END,            /* Sector I/O done (sector, type). */
+    TRACE_NAME,                 /* Thread created (its name). */
+    TRACE_TYPE_CNT              /* Number of event types. */
+  };
+
+/* Set by the -trace kernel command-line option. */
+extern bool trace_enabled;
+
+void trace_init (void);
+void trace_record (enum trace_type, uint32_t arg0, uint32_t arg1);
+void trace_switch (const struct thread *prev, const struct thread *next);
+void trace_name (const struct thread *);
+void trace_dump (void);
+
+#endif /* threads/trace.h */
@@ -0,0 +1,178 @@
+#include "threads/workqueue.h"
+#include <debug.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/thread.h"
+
+/* Priority of the system workqueue's worker, above every thread
+   that could otherwise keep its work from running. */
+#define SYSTEM_WQ_PRIORITY PRI_MAX
+
+/* Under the MLFQS and the completely fair scheduler, workers take
+   the lowest niceness, so that they keep getting to run. */
+#define WORKER_NICE -20
+
+struct workqueue system_wq;
+
+/* All workqueues, for statistics. */
+static struct list workqueues = LIST_INITIALIZER (workqueues);
+static struct spinlock workqueues_lock;
+
+static thread_func worker;
+
+/* Creates the system workqueue.  Must be called after
+   thread_start(). */
+void
+workqueue_init (void)
+{
+  if (!workqueue_create (&system_wq, "system_wq", SYSTEM_WQ_PRIORITY))
+    PANIC ("cannot create system workqueue");
+}
+
+/* Initializes WQ with the given NAME, which must stay valid, and
+   starts a worker thread for it at PRIORITY.  Returns true if
+   successful, false if the worker thread could not be
+   created. */
+bool
+workqueue_create (struct workqueue *wq, const char *name, int priority)
+{
+  enum intr_level old_level;
+
+  ASSERT (wq != NULL);
+  ASSERT (name != NULL);
+
+  wq->name = name;
+  spinlock_init (&wq->lock);
+  list_init (&wq->items);
+  sema_init (&wq->pending, 0);
+  wq->worker = NULL;
+  wq->run_cnt = 0;
+  wq->latency = 0;
+  wq->latency_max = 0;
+
+  if (thread_create (name, priority, worker, wq) == TID_ERROR)
+    return false;
+
+  old_level = intr_disable ();
+  spinlock_acquire (&workqueues_lock);
+  list_push_back (&workqueues, &wq->elem);
+  spinlock_release (&workqueues_lock);
+  intr_set_level (old_level);
+  return true;
+}
+
+/* Queues W to run on WQ's worker thread, after the items already
+   queued there.  Returns true if W was queued, false if it was
+   already pending.  May be called from an interrupt handler. */
+bool
+workqueue_queue (struct workqueue *wq, struct work *w)
+{
+  enum intr_level old_level;
+  bool queued = false;
+
+  ASSERT (wq != NULL);
+  ASSERT (w != NULL);
+
+  old_level = intr_disable ();
+  spinlock_acquire (&wq->lock);
+  if (!w->pending)
+    {
+      w->pending = true;
+      w->queued_at = timer_ns ();
+      list_push_back (&wq->items, &w->elem);
+      queued = true;
+    }
+  spinlock_release (&wq->lock);
+
+  if (queued)
+    {
+      sema_up (&wq->pending);
+
+      /* sema_up() does not yield in an interrupt handler, so make
+         sure the worker gets to run as soon as we return. */
+      if (intr_context () && wq->worker != NULL
+          && wq->worker->priority > thread_get_priority ())
+        intr_yield_on_return ();
+    }
+  intr_set_level (old_level);
+  return queued;
+}
+
+/* Prints workqueue statistics. */
+void
+workqueue_print_stats (void)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&workqueues); e != list_end (&workqueues);
+       e = list_next (e))
+    {
+      struct workqueue *wq = list_entry (e, struct workqueue, elem);
+
+      printf ("Workqueue %s: %llu items, latency %lld ns avg, %lld ns max\n",
+              wq->name, wq->run_cnt,
+              wq->run_cnt > 0 ? wq->latency / (int64_t) wq->run_cnt : 0,
+              wq->latency_max);
+    }
+}
+
+/* Initializes work item W to call FUNC, passing AUX. */
+void
+work_init (struct work *w, work_func *func, void *aux)
+{
+  ASSERT (w != NULL);
+  ASSERT (func != NULL);
+
+  w->func = func;
+  w->aux = aux;
+  w->pending = false;
+}
+
+/* Returns true if W is queued and has not started running. */
+bool
+work_pending (const struct work *w)
+{
+  return w->pending;
+}
+
+/* Worker thread for the workqueue WQ_.  Runs its work items in
+   the order they were queued. */
+static void
+worker (void *wq_)
+{
+  struct workqueue *wq = wq_;
+
+  wq->worker = thread_current ();
+  if (thread_mlfqs || thread_cfs)
+    thread_set_nice (WORKER_NICE);
+
+  for (;;)
+    {
+      enum intr_level old_level;
+      struct work *w;
+      work_func *func;
+      void *aux;
+      int64_t latency;
+
+      sema_down (&wq->pending);
+
+      /* W may be queued again as soon as it is off the list, even
+         while it runs. */
+      old_level = intr_disable ();
+      spinlock_acquire (&wq->lock);
+      w = list_entry (list_pop_front (&wq->items), struct work, elem);
+      w->pending = false;
+      func = w->func;
+      aux = w->aux;
+      latency = timer_ns () - w->queued_at;
+      wq->run_cnt++;
+      wq->latency += latency;
+      if (latency > wq->latency_max)
+        wq->latency_max = latency;
+      spinlock_release (&wq->lock);
+      intr_set_level (old_level);
+
+      func (aux);
+    }
+}
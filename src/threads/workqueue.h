@@ -0,0 +1,63 @@
+#ifndef THREADS_WORKQUEUE_H
+#define THREADS_WORKQUEUE_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "threads/synch.h"
+
+/* Deferred work.
+
+   A workqueue runs work items in a dedicated kernel thread, so
+   that an interrupt handler can hand off anything longer than
+   unblocking a thread and return quickly.  Queuing a work item
+   takes constant time and never sleeps, so it may be done from
+   interrupt handlers.  A work item that is already queued is not
+   queued again; it runs once.
+
+   Work functions run in a kernel thread, with interrupts on, so
+   unlike ktimer functions they may sleep, although doing so
+   delays the rest of their queue. */
+
+/* Function run for a work item, given the item's AUX. */
+typedef void work_func (void *aux);
+
+/* A work item. */
+struct work
+  {
+    work_func *func;            /* Function to run. */
+    void *aux;                  /* Auxiliary data for FUNC. */
+    bool pending;               /* Queued and not yet started? */
+    int64_t queued_at;          /* When queued, in nanoseconds. */
+    struct list_elem elem;      /* Element in a workqueue's items. */
+  };
+
+/* A queue of work items and the thread that runs them. */
+struct workqueue
+  {
+    const char *name;           /* Name, also the worker's name. */
+    struct spinlock lock;       /* Protects `items', the statistics
+                                   and the queued items. */
+    struct list items;          /* Pending work items, in order. */
+    struct semaphore pending;   /* Number of pending items. */
+    struct thread *worker;      /* Worker thread, once started. */
+    struct list_elem elem;      /* Element in list of all workqueues. */
+
+    /* Statistics. */
+    uint64_t run_cnt;           /* # of items run. */
+    int64_t latency;            /* Total time items waited, in ns. */
+    int64_t latency_max;        /* Longest time an item waited. */
+  };
+
+/* Queue for work that does not need a queue of its own. */
+extern struct workqueue system_wq;
+
+void workqueue_init (void);
+bool workqueue_create (struct workqueue *, const char *name, int priority);
+bool workqueue_queue (struct workqueue *, struct work *);
+void workqueue_print_stats (void);
+
+void work_init (struct work *, work_func *, void *aux);
+bool work_pending (const struct work *);
+
+#endif /* threads/workqueue.h */
@@ -1,9 +1,11 @@
 #include "userprog/exception.h"
 #include <inttypes.h>
 #include <stdio.h>
+#include "userprog/fpu.h"
 #include "userprog/gdt.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
 #include "vm/page.h"
 #include "vm/swap.h"
 #include "threads/palloc.h"
@@ -13,6 +15,7 @@ static long long page_fault_cnt;
 
 static void kill (struct intr_frame *);
 static void page_fault (struct intr_frame *);
+static void device_not_available (struct intr_frame *);
 
 /* Registers handlers for interrupts that can be caused by user
    programs.
@@ -48,7 +51,7 @@ exception_init (void)
   intr_register_int (0, 0, INTR_ON, kill, "#DE Divide Error");
   intr_register_int (1, 0, INTR_ON, kill, "#DB Debug Exception");
   intr_register_int (6, 0, INTR_ON, kill, "#UD Invalid Opcode Exception");
-  intr_register_int (7, 0, INTR_ON, kill,
+  intr_register_int (7, 0, INTR_ON, device_not_available,
                      "#NM Device Not Available Exception");
   intr_register_int (11, 0, INTR_ON, kill, "#NP Segment Not Present");
   intr_register_int (12, 0, INTR_ON, kill, "#SS Stack Fault Exception");
@@ -111,6 +114,17 @@ kill (struct intr_frame *f)
     }
 }
 
+/* #NM handler.  A user program used the FPU or SSE for the
+   first time since it was switched in, so give it its registers
+   (see fpu.c).  Kills the process if they cannot be provided, and
+   panics if the kernel itself used the FPU. */
+static void
+device_not_available (struct intr_frame *f)
+{
+  if (f->cs != SEL_UCSEG || !fpu_trap ())
+    kill (f);
+}
+
 /* Page fault handler.  This is a skeleton that must be filled in
    to implement virtual memory.  Some solutions to project 2 may
    also require modifying this code.
@@ -153,6 +167,7 @@ page_fault (struct intr_frame *f)
 
   /* Count page faults. */
   page_fault_cnt++;
+  trace_record (TRACE_FAULT, (uintptr_t) fault_addr, f->error_code);
 
   // 👤 project2/userprog
   // page fault exits
@@ -0,0 +1,234 @@
+#include "userprog/fpu.h"
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/cpu.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+
+/* x87 FPU and SSE register state of user processes.
+
+   The kernel itself is compiled with -msoft-float and never
+   touches these registers, so only user threads need them saved,
+   and most user threads never use them at all.  Instead of
+   saving and restoring them on every thread switch, a CPU leaves
+   them in place and sets CR0.TS, which makes the next FPU or SSE
+   instruction raise #NM (see exception.c).  fpu_trap() then
+   saves the registers for the thread that last used them on this
+   CPU, its "owner", and loads the current thread's.  A thread
+   that never uses the FPU never pays for it, and one that is the
+   only FPU user on its CPU keeps its registers loaded across
+   switches.
+
+   A thread's state is saved with FXSAVE into its `fpu' area,
+   allocated on its first use.  See [IA32-v2a] "FXSAVE" and
+   [IA32-v3a] 13.4 "Designing OS Facilities for Saving x87 FPU,
+   SSE, and Extended States on Task or Context Switches".
+
+   With more than one CPU, a thread may next run on a different
+   CPU, so an owner's registers are saved as soon as it is
+   switched out.  Loading them remains lazy. */
+
+/* Size and alignment of an FXSAVE area. */
+#define FXSAVE_SIZE 512
+#define FXSAVE_ALIGN 16
+
+/* Control register bits. */
+#define CR0_MP 0x00000002       /* Monitor coprocessor. */
+#define CR0_EM 0x00000004       /* (Floating-point) Emulation. */
+#define CR0_TS 0x00000008       /* Task switched. */
+#define CR0_NE 0x00000020       /* Numeric error reporting. */
+#define CR4_OSFXSR 0x00000200   /* FXSAVE, FXRSTOR, and SSE. */
+#define CR4_OSXMMEXCPT 0x00000400 /* #XF on SIMD errors. */
+
+/* CPUID leaf 1, EDX. */
+#define CPUID_FXSR (1 << 24)    /* FXSAVE and FXRSTOR. */
+#define CPUID_SSE (1 << 25)     /* SSE. */
+
+/* Default MXCSR: all SIMD exceptions masked. */
+#define MXCSR_DEFAULT 0x1f80
+
+/* True if the FPU may be used by user programs. */
+static bool fpu_enabled;
+
+/* Register state of a thread that has just started using the
+   FPU. */
+static uint8_t initial_state[FXSAVE_SIZE] __attribute__ ((aligned (FXSAVE_ALIGN)));
+
+static void enable (void);
+static void *fxsave_area (struct thread *);
+static inline void clts (void);
+static inline void stts (void);
+
+/* Enables the FPU on the bootstrap processor, if it supports
+   FXSAVE and SSE.  Otherwise, user programs that use the FPU are
+   killed, as before. */
+void
+fpu_init (void)
+{
+  uint32_t eax, ebx, ecx, edx;
+  uint32_t mxcsr = MXCSR_DEFAULT;
+
+  /* See [IA32-v2a] "CPUID". */
+  asm ("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "a" (1));
+  if ((edx & (CPUID_FXSR | CPUID_SSE)) != (CPUID_FXSR | CPUID_SSE))
+    {
+      printf ("fpu: no FXSAVE or SSE, user FPU use disabled\n");
+      return;
+    }
+
+  enable ();
+  clts ();
+  asm volatile ("fninit; ldmxcsr %0" : : "m" (mxcsr));
+  asm volatile ("fxsave %0" : "=m" (initial_state));
+  stts ();
+
+  /* Don't hand whatever the registers held at boot to user
+     programs: clear the x87 and XMM register images. */
+  memset (initial_state + 32, 0, FXSAVE_SIZE - 32);
+  fpu_enabled = true;
+}
+
+/* Enables the FPU on an application processor, the same way
+   fpu_init() did on the bootstrap processor. */
+void
+fpu_init_ap (void)
+{
+  if (fpu_enabled)
+    {
+      enable ();
+      stts ();
+    }
+}
+
+/* Handles #NM, raised by a user program using the FPU while
+   CR0.TS is set, by giving the running thread the FPU.  Returns
+   false if the FPU is not available to user programs or memory
+   for the thread's register state could not be allocated. */
+bool
+fpu_trap (void)
+{
+  struct thread *t = thread_current ();
+  enum intr_level old_level;
+  struct cpu *c;
+
+  if (!fpu_enabled)
+    return false;
+
+  /* First use by this thread.  malloc() may sleep, so this must
+     happen before the registers are touched. */
+  if (t->fpu == NULL)
+    {
+      t->fpu = malloc (FXSAVE_SIZE + FXSAVE_ALIGN - 1);
+      if (t->fpu == NULL)
+        return false;
+      memcpy (fxsave_area (t), initial_state, FXSAVE_SIZE);
+    }
+
+  old_level = intr_disable ();
+  c = cpu_current ();
+  clts ();
+  if (c->fpu_owner != t)
+    {
+      if (c->fpu_owner != NULL)
+        asm volatile ("fxsave (%0)" : : "r" (fxsave_area (c->fpu_owner))
+                      : "memory");
+      asm volatile ("fxrstor (%0)" : : "r" (fxsave_area (t)) : "memory");
+      c->fpu_owner = t;
+    }
+  intr_set_level (old_level);
+  return true;
+}
+
+/* Called by thread_schedule_tail() after switching from PREV to
+   the running thread, with interrupts off.  Arms the #NM trap
+   unless the running thread's registers are already loaded. */
+void
+fpu_switch (struct thread *prev)
+{
+  struct cpu *c = cpu_current ();
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!fpu_enabled)
+    return;
+
+  if (cpu_cnt > 1 && prev != NULL && c->fpu_owner == prev)
+    {
+      clts ();
+      asm volatile ("fxsave (%0)" : : "r" (fxsave_area (prev)) : "memory");
+      c->fpu_owner = NULL;
+    }
+
+  if (c->fpu_owner == thread_current ())
+    clts ();
+  else
+    stts ();
+}
+
+/* Frees the running thread's FPU state.  Called by thread_exit()
+   with interrupts on. */
+void
+fpu_exit (void)
+{
+  struct thread *t = thread_current ();
+  enum intr_level old_level;
+  struct cpu *c;
+
+  if (t->fpu == NULL)
+    return;
+
+  old_level = intr_disable ();
+  c = cpu_current ();
+  if (c->fpu_owner == t)
+    {
+      c->fpu_owner = NULL;
+      stts ();
+    }
+  intr_set_level (old_level);
+
+  free (t->fpu);
+  t->fpu = NULL;
+}
+
+/* Lets the running CPU execute FPU and SSE instructions. */
+static void
+enable (void)
+{
+  uint32_t cr0, cr4;
+
+  asm volatile ("movl %%cr0, %0" : "=r" (cr0));
+  cr0 = (cr0 & ~CR0_EM) | CR0_MP | CR0_NE;
+  asm volatile ("movl %0, %%cr0" : : "r" (cr0));
+
+  asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+  cr4 |= CR4_OSFXSR | CR4_OSXMMEXCPT;
+  asm volatile ("movl %0, %%cr4" : : "r" (cr4));
+}
+
+/* Returns T's FXSAVE area, within its `fpu' block. */
+static void *
+fxsave_area (struct thread *t)
+{
+  return (void *) ROUND_UP ((uintptr_t) t->fpu, FXSAVE_ALIGN);
+}
+
+/* Clears CR0.TS, allowing FPU instructions without a trap. */
+static inline void
+clts (void)
+{
+  asm volatile ("clts");
+}
+
+/* Sets CR0.TS, so that the next FPU instruction traps. */
+static inline void
+stts (void)
+{
+  uint32_t cr0;
+
+  asm volatile ("movl %%cr0, %0" : "=r" (cr0));
+  asm volatile ("movl %0, %%cr0" : : "r" (cr0 | CR0_TS));
+}
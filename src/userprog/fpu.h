@@ -0,0 +1,14 @@
+#ifndef USERPROG_FPU_H
+#define USERPROG_FPU_H
+
+#include <stdbool.h>
+
+struct thread;
+
+void fpu_init (void);
+void fpu_init_ap (void);
+bool fpu_trap (void);
+void fpu_switch (struct thread *prev);
+void fpu_exit (void);
+
+#endif /* userprog/fpu.h */
@@ -2,6 +2,7 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <string.h>
+#include "threads/cpu.h"
 #include "threads/init.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
@@ -137,9 +138,9 @@ pagedir_get_page (uint32_t *pd, const void *uaddr)
 }
 
 /* Marks user virtual page UPAGE "not present" in page
-   directory PD.  Later accesses to the page will fault.  Other
-   bits in the page table entry are preserved.
-   UPAGE need not be mapped. */
+   directory PD.  Later accesses to the page will fault, on every
+   CPU.  Other bits in the page table entry are preserved.
+   UPAGE need not be mapped.  Interrupts must be on. */
 void
 pagedir_clear_page (uint32_t *pd, void *upage)
 {
@@ -153,6 +154,7 @@ pagedir_clear_page (uint32_t *pd, void *upage)
     {
       *pte &= ~PTE_P;
       invalidate_pagedir (pd);
+      cpu_flush_tlb (pd);
     }
 }
 
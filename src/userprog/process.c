@@ -17,6 +17,7 @@
 #include "threads/palloc.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#include "vm/frame.h"
 #include "vm/page.h"
 
 static thread_func start_process NO_RETURN;
@@ -55,7 +56,7 @@ process_execute (const char *file_name)
   if (tid == TID_ERROR)
     palloc_free_page (fn_copy);
   else
-    sema_down (&(thread_get_child (tid)->pcb->sema_load));
+    sema_down (&(thread_get_child (tid)->sema_load));
 
   palloc_free_page (parsed_fn);
   return tid;
@@ -117,22 +118,24 @@ start_process (void *file_name_)
 int
 process_wait (tid_t child_tid)
 {
-  struct thread *child = thread_get_child (child_tid);
+  struct pcb *child = thread_get_child (child_tid);
   int exit_code;
 
   if (child == NULL)
     return -1;
 
-  if (child->pcb == NULL || child->pcb->exit_code == -2 || !child->pcb->has_loaded) {
+  if (child->exit_code == -2 || !child->has_loaded) {
     return -1;
   }
 
-  sema_down (&(child->pcb->sema_wait));
-  exit_code = child->pcb->exit_code;
+  sema_down (&(child->sema_wait));
+  exit_code = child->exit_code;
 
-  list_remove (&(child->elem_child_process));
-  palloc_free_page (child->pcb);
-  palloc_free_page (child);
+  /* The child's thread page is freed by thread_schedule_tail()
+     once it has switched away for the last time, so only the
+     PCB is ours to free. */
+  list_remove (&(child->elem));
+  kmem_cache_free (pcb_cache, child);
 
   return exit_code;
 }
@@ -146,6 +149,7 @@ process_exit (void)
   int i;
 
   // 🧠 project3/vm
+  falloc_exit ();
   destroy_spt (&cur->spt);
   file_close (cur->pcb->exec_file);
 
@@ -594,14 +598,13 @@ setup_stack (void **esp)
   kpage = falloc_get_page (PAL_USER | PAL_ZERO, PHYS_BASE - PGSIZE);
   if (kpage != NULL)
     {
+      // 🧠 project3/vm
+      // We need to initialize the page table entry for the stack,
+      // before the frame is mapped and can be evicted
+      init_frame_spte (&thread_current ()->spt, PHYS_BASE - PGSIZE, kpage);
       success = install_page (((uint8_t *) PHYS_BASE) - PGSIZE, kpage, true);
       if (success)
-        {
-          // 🧠 project3/vm
-          // We need to initialize the page table entry for the stack
-          init_frame_spte (&thread_current ()->spt, PHYS_BASE - PGSIZE, kpage);
-          *esp = PHYS_BASE;
-        }
+        *esp = PHYS_BASE;
       else
         {
           // 🧠 project3/vm
@@ -1,8 +1,12 @@
 #include "userprog/syscall.h"
+#include <schedstat.h>
 #include <stdio.h>
+#include <string.h>
 #include <syscall-nr.h>
+#include "devices/timer.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
 #include "filesys/filesys.h"
 #include "filesys/file.h"
 #include "threads/synch.h"
@@ -18,6 +22,7 @@ syscall_init (void)
 {
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
   lock_init (&file_lock);
+  lockstat_register (&file_lock, "file_lock");
   read_count = 0;
 }
 
@@ -87,7 +92,9 @@ syscall_handler (struct intr_frame *f)
   int argv[3]; // at most 3 arguments
 
   // The system call number is stored in the first argument
-  switch (*(int *)f->esp)
+  int nr = *(int *)f->esp;
+  trace_record (TRACE_SYSCALL, nr, 0);
+  switch (nr)
   {
     case SYS_HALT:
       shutdown_power_off ();
@@ -142,7 +149,20 @@ syscall_handler (struct intr_frame *f)
       get_syscall_args (f->esp, &argv[0], 1);
       sys_close (argv[0]);
       break;
+    case SYS_CLOCK_NS:
+      {
+        /* 64-bit results are returned in EDX:EAX. */
+        int64_t ns = sys_clock_ns ();
+        f->eax = (uint32_t) ns;
+        f->edx = (uint32_t) (ns >> 32);
+      }
+      break;
+    case SYS_SCHEDSTAT:
+      get_syscall_args (f->esp, &argv[0], 1);
+      sys_schedstat ((struct schedstat *) argv[0]);
+      break;
   }
+  trace_record (TRACE_SYSCALL_END, nr, 0);
 }
 
 /* 👤 project2/userprog
@@ -178,7 +198,7 @@ pid_t
 sys_exec (const char *cmd_line)
 {
   pid_t pid = process_execute (cmd_line);
-  struct pcb *child_pcb = thread_get_child (pid)->pcb;
+  struct pcb *child_pcb = thread_get_child (pid);
   if (pid == -1 || !child_pcb->has_loaded)
     return -1;
 
@@ -385,3 +405,27 @@ sys_close (int fd)
 
   t->pcb->fd_count--;
 }
+
+/* Returns the number of nanoseconds since boot, from the TSC
+   clock of timer_ns(). */
+int64_t
+sys_clock_ns (void)
+{
+  return timer_ns ();
+}
+
+/* Copies the scheduler latency statistics into STATS. */
+void
+sys_schedstat (struct schedstat *stats)
+{
+  struct schedstat copy;
+
+  if (!is_valid_uaddr (stats)
+      || !is_valid_uaddr ((uint8_t *) (stats + 1) - 1))
+    sys_exit (-1);
+
+  /* Take a consistent snapshot before touching user memory,
+     which may fault. */
+  thread_get_schedstat (&copy);
+  memcpy (stats, &copy, sizeof copy);
+}
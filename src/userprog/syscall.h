@@ -5,6 +5,7 @@
 #define STACK_BOTTOM 0x8048000
 
 #include <stdbool.h>
+#include <stdint.h>
 
 typedef int pid_t;
 
@@ -29,4 +30,9 @@ void sys_seek (int fd, unsigned position);
 unsigned sys_tell (int fd);
 void sys_close (int fd);
 
+struct schedstat;
+
+int64_t sys_clock_ns (void);
+void sys_schedstat (struct schedstat *stats);
+
 #endif /* userprog/syscall.h */
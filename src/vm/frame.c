@@ -1,4 +1,5 @@
 #include "vm/frame.h"
+#include "threads/slab.h"
 #include "threads/synch.h"
 #include "vm/swap.h"
 
@@ -7,6 +8,13 @@
 static struct list frame_table;
 static struct lock frame_lock;
 static struct fte *clock_cursor; // clock algorithm: pointer to the current frame
+static struct kmem_cache *fte_cache;
+
+static struct fte *clock_next (struct fte *);
+static void frame_remove (struct fte *);
+static bool frame_mapped (struct fte *);
+static void evict_frame (struct fte *);
+static palloc_reclaim_func reclaim_lent_frames;
 
 // 🧠 project3/vm
 // Frame table initialization
@@ -15,7 +23,10 @@ frame_init ()
 {
   list_init (&frame_table);
   lock_init (&frame_lock);
+  lockstat_register (&frame_lock, "frame_lock");
   clock_cursor = NULL;
+  fte_cache = kmem_cache_create ("fte", sizeof (struct fte), NULL);
+  palloc_set_reclaim (reclaim_lent_frames);
 }
 
 // 🧠 project3/vm
@@ -35,13 +46,16 @@ falloc_get_page(enum palloc_flags flags, void *upage)
 
   if (kpage == NULL)
     {
-      evict_page();
-      kpage = palloc_get_page (flags);
+      if (evict_page ())
+        kpage = palloc_get_page (flags);
       if (kpage == NULL)
-        return NULL;
+        {
+          lock_release (&frame_lock);
+          return NULL;
+        }
     }
 
-  e = (struct fte *)malloc (sizeof *e);
+  e = kmem_cache_alloc (fte_cache);
   e->kpage = kpage;
   e->upage = upage;
   e->t = thread_current ();
@@ -64,11 +78,37 @@ falloc_free_page (void *kpage)
     sys_exit (-1); // In future versions we may want to treat this error
                    // in a more elegant way
 
-  list_remove (&e->list_elem);
+  frame_remove (e);
   palloc_free_page (e->kpage);
   // FIX: also remove the page from the page table
   pagedir_clear_page (e->t->pagedir, e->upage);
-  free (e);
+  kmem_cache_free (fte_cache, e);
+  lock_release (&frame_lock);
+}
+
+// 🧠 project3/vm
+// Drops the current thread's frames from the frame table when its
+// process exits, before its supplemental page table goes away.
+// The pages themselves are freed along with its page directory.
+// Waits for an eviction in progress, if any, to finish first.
+void
+falloc_exit (void)
+{
+  struct thread *cur = thread_current ();
+  struct list_elem *e, *next;
+
+  lock_acquire (&frame_lock);
+  for (e = list_begin (&frame_table); e != list_end (&frame_table); e = next)
+    {
+      struct fte *f = list_entry (e, struct fte, list_elem);
+
+      next = list_next (e);
+      if (f->t == cur)
+        {
+          frame_remove (f);
+          kmem_cache_free (fte_cache, f);
+        }
+    }
   lock_release (&frame_lock);
 }
 
@@ -88,33 +128,126 @@ get_fte (void* kpage)
 
 // 🧠 project3/vm
 // Eviction policy based on the clock algorithm
-void
-evict_page () {
-  ASSERT(lock_held_by_current_thread(&frame_lock));
+//
+// Starting at the clock hand, evicts the first frame that was not
+// accessed since the hand last passed it, clearing the accessed
+// bits of the frames it skips.  Gives up after two sweeps, that is
+// once every frame had its bit cleared and still none could be
+// evicted, and returns false.
+bool
+evict_page (void)
+{
+  struct fte *e, *next;
+  size_t n;
 
-  struct fte *e = clock_cursor;
-  struct spte *s;
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+
+  if (list_empty (&frame_table))
+    return false;
 
-  // We find a page to evict
-  do
+  e = clock_cursor;
+  if (e == NULL)
+    e = list_entry (list_begin (&frame_table), struct fte, list_elem);
+
+  for (n = 2 * list_size (&frame_table); n > 0; n--)
     {
-      if (e != NULL)
-        pagedir_set_accessed(e->t->pagedir, e->upage, false);
+      next = clock_next (e);
+      if (frame_mapped (e))
+        {
+          if (!pagedir_is_accessed (e->t->pagedir, e->upage))
+            {
+              clock_cursor = next != e ? next : NULL;
+              evict_frame (e);
+              return true;
+            }
+          pagedir_set_accessed (e->t->pagedir, e->upage, false);
+        }
+      e = next;
+    }
+
+  clock_cursor = e;
+  return false;
+}
 
-      if (clock_cursor == NULL || list_next (&clock_cursor->list_elem) == list_end (&frame_table))
-        e = list_entry(list_begin(&frame_table), struct fte, list_elem);
-      else
-        e = list_next (e);
+// Returns the frame after E in the frame table, wrapping around
+static struct fte *
+clock_next (struct fte *e)
+{
+  struct list_elem *next = list_next (&e->list_elem);
+
+  if (next == list_end (&frame_table))
+    next = list_begin (&frame_table);
+  return list_entry (next, struct fte, list_elem);
+}
+
+// Removes E from the frame table, moving the clock hand off it
+static void
+frame_remove (struct fte *e)
+{
+  if (clock_cursor == e)
+    clock_cursor = clock_next (e) != e ? clock_next (e) : NULL;
+  list_remove (&e->list_elem);
+}
+
+// Returns true if frame E is mapped in its owner's page table.
+// A frame is not mapped while load_page() is still filling it, and
+// must not be evicted then.
+static bool
+frame_mapped (struct fte *e)
+{
+  return pagedir_get_page (e->t->pagedir, e->upage) != NULL;
+}
+
+// Swaps out frame E and frees it.  frame_lock must be held, and
+// stays held throughout: the owner's page fault and its exit both
+// wait for it, so neither can see the frame half evicted.
+static void
+evict_frame (struct fte *e)
+{
+  void *kpage = e->kpage;
+  struct spte *s;
+
+  ASSERT (lock_held_by_current_thread (&frame_lock));
 
-    } while (!pagedir_is_accessed(e->t->pagedir, e->upage));
+  frame_remove (e);
 
-  // And now we evict it
+  // Unmap the page, on every CPU, before writing it out, so that
+  // the owner cannot change it meanwhile
+  pagedir_clear_page (e->t->pagedir, e->upage);
 
-  s = get_spte (&thread_current()->spt, e->upage);
+  s = get_spte (&e->t->spt, e->upage);
   s->status = PAGE_SWAP;
-  s->swap_id = swap_out (e->kpage); // swap_out returns the swap id
+  s->swap_id = swap_out (kpage); // swap_out returns the swap id
 
-  lock_release (&frame_lock);
-  falloc_free_page (e->kpage);
+  palloc_free_page (kpage);
+  kmem_cache_free (fte_cache, e);
+}
+
+// Evicts frames that the kernel pool lent to the user pool, for
+// as long as the kernel pool wants its pages back.  Called by
+// palloc in a workqueue thread.
+static void
+reclaim_lent_frames (void)
+{
   lock_acquire (&frame_lock);
+  while (palloc_reclaim_wanted ())
+    {
+      struct list_elem *e;
+      struct fte *victim = NULL;
+
+      for (e = list_begin (&frame_table); e != list_end (&frame_table);
+           e = list_next (e))
+        {
+          struct fte *f = list_entry (e, struct fte, list_elem);
+          if (palloc_is_lent (f->kpage) && frame_mapped (f))
+            {
+              victim = f;
+              break;
+            }
+        }
+      if (victim == NULL)
+        break;
+      evict_frame (victim);
+    }
+  lock_release (&frame_lock);
 }
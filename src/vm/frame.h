@@ -30,6 +30,8 @@ struct fte
 void frame_init (void);
 void *falloc_get_page (enum palloc_flags, void *);
 void falloc_free_page (void *);
+void falloc_exit (void);
+bool evict_page (void);
 struct fte *get_fte (void* );
 
 #endif
@@ -2,6 +2,7 @@
 #include "vm/page.h"
 #include "vm/frame.h"
 #include <string.h>
+#include "threads/slab.h"
 #include "threads/vaddr.h"
 
 static hash_hash_func spt_hash_func;
@@ -9,6 +10,16 @@ static hash_less_func spt_less_func;
 static void page_destructor (struct hash_elem *elem, void *aux);
 extern struct lock file_lock;
 
+/* Cache that supplemental page table entries are allocated from. */
+static struct kmem_cache *spte_cache;
+
+/* Initializes the supplemental page table entry cache. */
+void
+page_init (void)
+{
+  spte_cache = kmem_cache_create ("spte", sizeof (struct spte), NULL);
+}
+
 void
 init_spt (struct hash *spt)
 {
@@ -29,7 +40,7 @@ void
 init_spte (struct hash *spt, void *upage, void *kpage)
 {
   struct spte *e;
-  e = (struct spte *) malloc (sizeof *e);
+  e = kmem_cache_alloc (spte_cache);
 
   e->upage = upage;
   e->kpage = kpage;
@@ -45,7 +56,7 @@ void
 init_zero_spte (struct hash *spt, void *upage)
 {
   struct spte *e;
-  e = (struct spte *) malloc (sizeof *e);
+  e = kmem_cache_alloc (spte_cache);
 
   e->upage = upage;
   e->kpage = NULL; // no frame page
@@ -62,7 +73,7 @@ void
 init_frame_spte (struct hash *spt, void *upage, void *kpage)
 {
   struct spte *e;
-  e = (struct spte *) malloc (sizeof *e); // will be freed in page_destructor
+  e = kmem_cache_alloc (spte_cache); // will be freed in page_destructor
 
   e->upage = upage;
   e->kpage = kpage;
@@ -92,7 +103,7 @@ init_file_spte (
 {
   struct spte *e;
 
-  e = (struct spte *)malloc (sizeof *e);
+  e = kmem_cache_alloc (spte_cache);
 
   e->upage = upage;
   e->kpage = NULL;
@@ -160,15 +171,17 @@ load_page (struct hash *spt, void *upage)
 
   pagedir = thread_current ()->pagedir;
 
+  // The frame may be evicted as soon as it is mapped, which
+  // changes the status again
+  e->kpage = kpage;
+  e->status = PAGE_FRAME;
+
   if (!pagedir_set_page (pagedir, upage, kpage, e->writable))
     {
       falloc_free_page (kpage);
       sys_exit (-1);
     }
 
-  e->kpage = kpage;
-  e->status = PAGE_FRAME;
-
   return true;
 }
 
@@ -207,12 +220,12 @@ page_destructor (struct hash_elem *elem, void *aux)
 
   e = hash_entry (elem, struct spte, hash_elem);
 
-  free(e);
+  kmem_cache_free (spte_cache, e);
 }
 
 void
 page_delete (struct hash *spt, struct spte *entry)
 {
   hash_delete (spt, &entry->hash_elem);
-  free (entry);
+  kmem_cache_free (spte_cache, entry);
 }
@@ -33,6 +33,7 @@ struct spte
 
 /* 🧠 project3/vm: definitions */
 
+void page_init (void);
 void init_spt (struct hash *);
 void destroy_spt (struct hash *);
 void init_spte (struct hash *, void *, void *);
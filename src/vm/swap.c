@@ -6,6 +6,7 @@
 static struct bitmap *swap_valid_table; // swap table
 static struct block *swap_disk;         // swap disk
 static struct lock swap_lock;           // swap lock
+static size_t swap_hint;                // where to look for an empty slot
 
 /* 🧠 project3/vm
    Initializes the swap table and the swap disk
@@ -17,6 +18,7 @@ void init_swap_valid_table ()
 
   bitmap_set_all (swap_valid_table, true);
   lock_init (&swap_lock);
+  lockstat_register (&swap_lock, "swap_lock");
 }
 
 /* 🧠 project3/vm
@@ -57,7 +59,7 @@ int swap_out (void *kva)
 
   lock_acquire (&swap_lock);
   // Find an empty slot in the swap disk
-  id = bitmap_scan_and_flip (swap_valid_table, 0, 1, true);
+  id = bitmap_scan_and_flip_next (swap_valid_table, &swap_hint, 1, true);
   lock_release (&swap_lock);
 
   // Swap disk is full